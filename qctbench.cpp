@@ -0,0 +1,110 @@
+/* > qctbench.cpp
+ * 1.01 arb Mon Oct 19 23:59:35 BST 2026 - usage comment
+ * 1.00 arb Mon Oct 19 21:26:52 BST 2026
+ */
+
+static const char SCCSid[] = "@(#)qctbench.cpp  1.01 (C) 2026 arb QCT decoding benchmark";
+
+/*
+ * Compares the time taken to decode the whole image of QCT files using
+ * the osmap QCT class (QCT::openFilename) with QCTFile in one thread and
+ * with QCTTiles::copyLevel (as used to save the chart) in several.
+ * Also checks that they decode exactly the same pixels, eg. with 8 threads
+ * for the charts qct/BA0734_1.qct and qct/BA0735_1.qct
+ *   ./qctbench 8 qct/BA0734_1.qct qct/BA0735_1.qct
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <qdatetime.h>
+#include <qimage.h>
+#include "satlib/dundee.h"
+#include "osmap/qct.h"
+#include "qctfile.h"
+#include "qcttiles.h"
+
+
+/*
+ * Count the pixels which differ from the osmap image, which has no
+ * padding at the end of the rows.
+ */
+static int
+countDifferences(const unsigned char *expected, int width, int height, const unsigned char *image, int stride)
+{
+	int count = 0;
+	for (int yy=0; yy<height; yy++)
+	{
+		const unsigned char *ep = expected + yy * width, *ip = image + yy * stride;
+		if (memcmp(ep, ip, width) == 0)
+			continue;
+		for (int xx=0; xx<width; xx++)
+			if (ep[xx] != ip[xx])
+				count++;
+	}
+	return count;
+}
+
+
+int
+main(int argc, char *argv[])
+{
+	int nthreads = (argc > 1) ? atoi(argv[1]) : 0;
+	int osmap_total = 0, single_total = 0, multi_total = 0;
+	QTime timer;
+
+	if (argc < 3)
+	{
+		fprintf(stderr, "usage: qctbench threads file.qct...\n");
+		exit(1);
+	}
+	if (nthreads <= 0)
+		nthreads = 4;
+
+	for (int ff=2; ff<argc; ff++)
+	{
+		QCT qct;
+		timer.start();
+		if (!qct.openFilename(argv[ff], false))
+		{
+			fprintf(stderr, "cannot read %s\n", argv[ff]);
+			continue;
+		}
+		int osmap_ms = timer.elapsed();
+		int width = qct.getImageWidth(), height = qct.getImageHeight();
+
+		// One thread decoding every tile in turn
+		timer.start();
+		QCTFile qctfile(argv[ff]);
+		if (!qctfile.isOk())
+			continue;
+		QImage single(qctfile.getImageWidth(), qctfile.getImageHeight(), 8, 256);
+		for (int ty=0; ty<qctfile.getTilesHigh(); ty++)
+			for (int tx=0; tx<qctfile.getTilesWide(); tx++)
+				qctfile.decodeTile(tx, ty, single.scanLine(ty * QCTFILE_TILE_SIZE) + tx * QCTFILE_TILE_SIZE, single.bytesPerLine());
+		int single_ms = timer.elapsed();
+
+		// Several threads, as when saving the chart
+		timer.start();
+		QCTTiles tiles(argv[ff]);
+		QImage multi(tiles.getLevelWidth(0), tiles.getLevelHeight(0), 8, 256);
+		tiles.copyLevel(0, &multi, nthreads);
+		int multi_ms = timer.elapsed();
+
+		int diffs = -1;
+		if (width == single.width() && height == single.height())
+			diffs = countDifferences(qct.getImage(), width, height, single.bits(), single.bytesPerLine())
+				+ countDifferences(qct.getImage(), width, height, multi.bits(), multi.bytesPerLine());
+		qct.unloadImage();
+
+		printf("%s %d x %d, %d pixels differ\n", argv[ff], width, height, diffs);
+		printf("  osmap QCT     %6d ms\n", osmap_ms);
+		printf("  QCTFile       %6d ms  %5.1f x\n", single_ms, osmap_ms / (double)QMAX(1, single_ms));
+		printf("  %2d threads    %6d ms  %5.1f x\n", nthreads, multi_ms, osmap_ms / (double)QMAX(1, multi_ms));
+		osmap_total += osmap_ms;
+		single_total += single_ms;
+		multi_total += multi_ms;
+	}
+	printf("total osmap %d ms, QCTFile %d ms, %d threads %d ms\n", osmap_total, single_total, nthreads, multi_total);
+	return(0);
+}
@@ -0,0 +1,8 @@
+TEMPLATE    = app
+CONFIG      += qt warn_on release thread
+DEFINES     +=
+INCLUDEPATH += $(SWDEV)
+LIBS        += -lsatqt -losmap -lsat -lutils -lgif -larb
+HEADERS     = qctfile.h qcttiles.h qctdiskcache.h
+SOURCES     = qctfile.cpp qcttiles.cpp qctdiskcache.cpp qctbench.cpp
+TARGET      = qctbench
@@ -0,0 +1,399 @@
+/* > qctdiskcache.cpp
+ * 1.03 arb Mon Oct 19 23:59:58 BST 2026 - replace a mismatched file instead of truncating it
+ * 1.02 arb Mon Oct 19 23:59:27 BST 2026 - locked appends, checksums, size limit for the directory
+ * 1.01 arb Mon Oct 19 23:59:25 BST 2026 - hash the key from a string which is still there
+ * 1.00 arb Mon Oct 19 17:48:26 BST 2026
+ */
+
+static const char SCCSid[] = "@(#)qctdiskcache.cpp 1.03 (C) 2026 arb QCT tile cache on disk";
+
+/*
+ * Each cache file has a header identifying the chart and level, then an
+ * index giving the offset, length and checksum of every tile (zero if not
+ * cached) and then the tiles in the order they were made.  The length has
+ * the top bit set if the tile is compressed.  The files are only used on
+ * the machine which wrote them so the numbers are in the native byte order.
+ * Several processes (eg. xqct and xqctrender) can use the same file so
+ * the header is checked and tiles appended while holding a lock on the
+ * file, at its current end rather than where this process last wrote.
+ * Readers don't lock so an index entry can be seen half written, or point
+ * to a tile not in this process's map, the checksum catches the former.
+ */
+
+/*
+ * Configuration:
+ * Define USE_LZ4 to compress the tiles with LZ4 (add -llz4).
+ * Define TRIM_TO_FRACTION as how full the cache is left after trimming
+ * so there's room for the tiles of the chart being opened.
+ * Define RECOUNT_BYTES as how much is written between looking at the size
+ * of the whole directory, which other charts and processes also write to.
+ */
+#define TRIM_TO_FRACTION 0.75
+#define RECOUNT_BYTES    (8 * 1048576.0)
+
+
+#include <string.h>
+#include <qdir.h>
+#include <qfile.h>
+#include <qfileinfo.h>
+#include <qdatetime.h>
+#include <qstringlist.h>
+#include "satlib/dundee.h" // for debugf
+#include "qctdiskcache.h"
+
+#ifdef Q_OS_UNIX
+#include <sys/types.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/file.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <utime.h>
+#endif
+#ifdef USE_LZ4
+#include <lz4.h>
+#endif
+
+
+#define CACHE_MAGIC       "XQCTDC2"
+#define CACHE_SUFFIX      ".tiles"
+#define CACHE_HEADER_SIZE 1024
+#define CACHE_KEY_SIZE    (CACHE_HEADER_SIZE - 16)
+#define CACHE_COMPRESSED  0x80000000
+
+struct CacheHeader
+{
+	char magic[8];
+	int level;
+	int ntiles;
+	char key[CACHE_KEY_SIZE];
+};
+
+struct CacheEntry
+{
+	unsigned int offset;
+	unsigned int length;
+	unsigned int checksum;  // of the length bytes at offset
+};
+
+
+/*
+ * FNV-1a hash, for the name of the files and to check the tiles
+ */
+static unsigned int
+fnv1a(const unsigned char *data, unsigned int length)
+{
+	unsigned int hash = 2166136261u;
+	while (length-- > 0)
+		hash = (hash ^ *data++) * 16777619u;
+	return hash;
+}
+
+
+/* ---------------------------------------------------------------------------
+ * The cache files are named after a hash of the key, the key itself is
+ * kept in the header to check it really is the same chart.
+ */
+QCTDiskCache::QCTDiskCache(const QString &cachedir, int megabytes, const QString &chartfile)
+{
+	int ii;
+
+	ok = false;
+	dir = cachedir;
+	maxbytes = budget = megabytes * 1048576.0;
+	unrecounted = 0;
+	for (ii=0; ii<QCTDISKCACHE_LEVELS; ii++)
+	{
+		levels[ii].fd = -1;
+		levels[ii].ntiles = 0;
+		levels[ii].base = 0;
+		levels[ii].mapsize = 0;
+	}
+
+#ifdef Q_OS_UNIX
+	if (megabytes <= 0 || dir.isEmpty())
+		return;
+	QDir qdir(dir);
+	if (!qdir.exists() && !qdir.mkdir(dir))
+	{
+		log_error_message("cannot create tile cache %s", (const char*)dir);
+		return;
+	}
+
+	QFileInfo fi(chartfile);
+	key = fi.absFilePath() + "|" + QString::number(fi.lastModified().toTime_t()) + "|" + QString::number(fi.size());
+	QCString k = key.utf8();
+	basename.sprintf("%08x-", fnv1a((const unsigned char*)k.data(), k.length()));
+
+	trim();
+	ok = true;
+#endif
+	debugf(1, "QCTDiskCache %s for %s\n", ok ? (const char*)basename : "disabled", (const char*)key);
+}
+
+
+QCTDiskCache::~QCTDiskCache()
+{
+	for (int ii=0; ii<QCTDISKCACHE_LEVELS; ii++)
+		closeLevel(ii);
+}
+
+
+/*
+ * Delete the least recently used cache files (other than those of this
+ * chart) until the cache is small enough, and work out how much more
+ * can be written.  Files still open in another process can be deleted,
+ * that process carries on using its copy until it closes it.
+ */
+void
+QCTDiskCache::trim()
+{
+	QDir qdir(dir);
+	QStringList files = qdir.entryList("*" CACHE_SUFFIX, QDir::Files, QDir::Time | QDir::Reversed);
+	QStringList::Iterator it;
+	double total = directorySize();
+
+	for (it = files.begin(); it != files.end() && total > maxbytes * TRIM_TO_FRACTION; ++it)
+	{
+		if ((*it).startsWith(basename))
+			continue;
+		total -= QFileInfo(qdir.filePath(*it)).size();
+		debugf(1, "QCTDiskCache removing %s\n", (const char*)*it);
+		qdir.remove(*it);
+	}
+	budget = maxbytes - total;
+}
+
+
+/*
+ * The size of all the cache files, whichever chart or process wrote them
+ */
+double
+QCTDiskCache::directorySize() const
+{
+	QDir qdir(dir);
+	QStringList files = qdir.entryList("*" CACHE_SUFFIX, QDir::Files);
+	double total = 0;
+
+	for (QStringList::Iterator it = files.begin(); it != files.end(); ++it)
+		total += QFileInfo(qdir.filePath(*it)).size();
+	return total;
+}
+
+
+/*
+ * Open the cache file for a level, starting it again if it's for a
+ * different chart (the hash could clash) or is damaged.
+ */
+void
+QCTDiskCache::openLevel(int lev, int ntiles)
+{
+#ifdef Q_OS_UNIX
+	QMutexLocker locker(&mutex);
+	Level &level = levels[lev];
+	struct CacheHeader header;
+	struct stat st;
+
+	if (!ok || lev < 0 || lev >= QCTDISKCACHE_LEVELS || level.fd >= 0)
+		return;
+
+	QString path = QDir(dir).filePath(basename + QString::number(lev) + CACHE_SUFFIX);
+	level.fd = ::open(QFile::encodeName(path), O_RDWR | O_CREAT, 0644);
+	if (level.fd < 0)
+	{
+		log_error_message("cannot open tile cache %s", (const char*)path);
+		return;
+	}
+	level.ntiles = ntiles;
+	unsigned int indexend = CACHE_HEADER_SIZE + ntiles * sizeof(CacheEntry);
+
+	// Another process could be starting the same file
+	flock(level.fd, LOCK_EX);
+	memset(&header, 0, sizeof(header));
+	if (fstat(level.fd, &st) != 0 || (unsigned int)st.st_size < indexend
+		|| pread(level.fd, &header, sizeof(header), 0) != sizeof(header)
+		|| strcmp(header.magic, CACHE_MAGIC) != 0 || header.level != lev
+		|| header.ntiles != ntiles || strncmp(header.key, key.utf8(), CACHE_KEY_SIZE) != 0)
+	{
+		debugf(1, "QCTDiskCache starting %s\n", (const char*)path);
+		memset(&header, 0, sizeof(header));
+		strcpy(header.magic, CACHE_MAGIC);
+		header.level = lev;
+		header.ntiles = ntiles;
+		strncpy(header.key, key.utf8(), CACHE_KEY_SIZE-1);
+		// Another process may have the old file mapped so rather than
+		// truncate it start a new file and rename it over the old one.
+		// The index is all zeros, meaning no tiles
+		QString temppath = path + "." + QString::number(getpid());
+		int fd = ::open(QFile::encodeName(temppath), O_RDWR | O_CREAT | O_TRUNC, 0644);
+		if (fd < 0)
+		{
+			log_error_message("cannot create tile cache %s", (const char*)temppath);
+			closeLevel(lev);
+			return;
+		}
+		flock(fd, LOCK_EX);
+		if (ftruncate(fd, indexend) != 0
+			|| pwrite(fd, &header, sizeof(header), 0) != sizeof(header)
+			|| rename(QFile::encodeName(temppath), QFile::encodeName(path)) != 0)
+		{
+			::close(fd);
+			unlink(QFile::encodeName(temppath));
+			closeLevel(lev);
+			return;
+		}
+		::close(level.fd);
+		level.fd = fd;
+		st.st_size = indexend;
+	}
+	flock(level.fd, LOCK_UN);
+
+	void *addr = mmap(0, st.st_size, PROT_READ, MAP_SHARED, level.fd, 0);
+	if (addr == MAP_FAILED)
+	{
+		closeLevel(lev);
+		return;
+	}
+	level.base = (const unsigned char*)addr;
+	level.mapsize = st.st_size;
+
+	// Mark as recently used
+	utime(QFile::encodeName(path), 0);
+#endif
+}
+
+
+void
+QCTDiskCache::closeLevel(int lev)
+{
+#ifdef Q_OS_UNIX
+	Level &level = levels[lev];
+	if (level.base)
+		munmap((void*)level.base, level.mapsize);
+	if (level.fd >= 0)
+		::close(level.fd);
+#endif
+	levels[lev].fd = -1;
+	levels[lev].base = 0;
+	levels[lev].mapsize = 0;
+}
+
+
+/*
+ * Tiles added since the file was opened aren't in the memory map but
+ * they will still be in memory anyway, unless another process added them.
+ */
+bool
+QCTDiskCache::readTile(int lev, int index, int width, int height, unsigned char *dst, int stride)
+{
+	CacheEntry entry;
+	int yy;
+
+	if (lev < 0 || lev >= QCTDISKCACHE_LEVELS)
+		return false;
+	const Level &level = levels[lev];
+	mutex.lock();
+	if (level.base == 0 || index < 0 || index >= level.ntiles)
+	{
+		mutex.unlock();
+		return false;
+	}
+	memcpy(&entry, level.base + CACHE_HEADER_SIZE + index * sizeof(CacheEntry), sizeof(entry));
+	mutex.unlock();
+
+	unsigned int length = entry.length & ~CACHE_COMPRESSED;
+	unsigned int rawlength = width * height;
+	if (entry.offset == 0 || entry.offset > level.mapsize || length > level.mapsize - entry.offset)
+		return false;
+	const unsigned char *src = level.base + entry.offset;
+	if (fnv1a(src, length) != entry.checksum)
+	{
+		debugf(1, "QCTDiskCache tile %d of level %d is damaged\n", index, lev);
+		return false;
+	}
+
+	if (entry.length & CACHE_COMPRESSED)
+	{
+#ifdef USE_LZ4
+		QMemArray<char> buf(rawlength);
+		if (LZ4_decompress_safe((const char*)src, buf.data(), length, rawlength) != (int)rawlength)
+			return false;
+		for (yy=0; yy<height; yy++)
+			memcpy(dst + yy * stride, buf.data() + yy * width, width);
+		return true;
+#else
+		return false;
+#endif
+	}
+	if (length != rawlength)
+		return false;
+	for (yy=0; yy<height; yy++)
+		memcpy(dst + yy * stride, src + yy * width, width);
+	return true;
+}
+
+
+/*
+ * Append a tile to the end of the file and then set its index entry,
+ * unless the cache is full.  Every RECOUNT_BYTES the size of the whole
+ * directory is looked at again to allow for the other writers.
+ */
+void
+QCTDiskCache::writeTile(int lev, int index, int width, int height, const unsigned char *src, int stride)
+{
+#ifdef Q_OS_UNIX
+	unsigned int rawlength = width * height;
+	QMemArray<char> raw(rawlength);
+	CacheEntry entry;
+	int yy;
+
+	if (lev < 0 || lev >= QCTDISKCACHE_LEVELS)
+		return;
+	for (yy=0; yy<height; yy++)
+		memcpy(raw.data() + yy * width, src + yy * stride, width);
+	const char *data = raw.data();
+	entry.length = rawlength;
+#ifdef USE_LZ4
+	QMemArray<char> packed(LZ4_compressBound(rawlength));
+	int packedlength = LZ4_compress_default(raw.data(), packed.data(), rawlength, packed.size());
+	if (packedlength > 0 && (unsigned int)packedlength < rawlength)
+	{
+		data = packed.data();
+		entry.length = packedlength | CACHE_COMPRESSED;
+	}
+#endif
+	unsigned int length = entry.length & ~CACHE_COMPRESSED;
+	entry.checksum = fnv1a((const unsigned char*)data, length);
+
+	QMutexLocker locker(&mutex);
+	Level &level = levels[lev];
+	struct stat st;
+	if (level.fd < 0 || index < 0 || index >= level.ntiles)
+		return;
+	if (unrecounted >= RECOUNT_BYTES)
+	{
+		budget = maxbytes - directorySize();
+		unrecounted = 0;
+	}
+	if (budget < length)
+		return;
+	flock(level.fd, LOCK_EX);
+	bool written = (fstat(level.fd, &st) == 0 && st.st_size <= (off_t)(0xFFFFFFFFu - length));
+	if (written)
+	{
+		entry.offset = st.st_size;
+		written = (pwrite(level.fd, data, length, entry.offset) == (ssize_t)length
+			&& pwrite(level.fd, &entry, sizeof(entry), CACHE_HEADER_SIZE + index * sizeof(CacheEntry)) == sizeof(entry));
+	}
+	flock(level.fd, LOCK_UN);
+	if (!written)
+	{
+		// Stop writing, but the file stays mapped for reading
+		log_error_message("cannot write tile cache");
+		budget = 0;
+		return;
+	}
+	budget -= length;
+	unrecounted += length;
+#endif
+}
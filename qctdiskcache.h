@@ -0,0 +1,63 @@
+/* > qctdiskcache.h
+ * 1.01 arb
+ */
+
+#ifndef QCTDISKCACHE_H
+#define QCTDISKCACHE_H
+
+#include <qstring.h>
+#include <qmutex.h>
+#include <qmemarray.h>
+
+
+#define QCTDISKCACHE_LEVELS 4  // must be at least QCTTILES_LEVELS
+
+
+/*
+ * A cache on disk of the decoded 8-bit display tiles of one QCT file,
+ * so opening a chart again doesn't need the QCT tiles decompressed again.
+ * There is one cache file for each level of the pyramid, named after the
+ * chart's path, modification time and size, so an edited chart gets a new
+ * cache.  Tiles are read from a memory map of the file and appended when
+ * made, optionally compressed with LZ4, by any process using the cache.
+ * The size limit is for the whole cache directory, however many charts
+ * and processes share it: the least recently used files are deleted when
+ * a chart is opened, and no more is written once the directory is full
+ * (it can go over by a few megabytes for each chart being written).
+ * readTile and writeTile can be called from any thread.
+ */
+class QCTDiskCache
+{
+public:
+	QCTDiskCache(const QString &dir, int megabytes, const QString &chartfile);
+	~QCTDiskCache();
+	bool isOk() const { return ok; }
+	// Must be called for each level before reading or writing its tiles
+	void openLevel(int level, int ntiles);
+	bool readTile(int level, int index, int width, int height, unsigned char *dst, int stride);
+	void writeTile(int level, int index, int width, int height, const unsigned char *src, int stride);
+private:
+	void closeLevel(int level);
+	void trim();
+	double directorySize() const;
+private:
+	struct Level
+	{
+		int fd;
+		int ntiles;
+		const unsigned char *base;  // memory map of the file when opened
+		unsigned int mapsize;
+	};
+	bool ok;
+	QString dir;
+	double maxbytes;
+	double budget;                  // bytes which can still be written
+	double unrecounted;             // bytes written since the directory was sized
+	QString key;                    // identifies the chart
+	QString basename;               // of the cache files
+	Level levels[QCTDISKCACHE_LEVELS];
+	QMutex mutex;                   // guards levels and budget
+};
+
+
+#endif // !QCTDISKCACHE_H
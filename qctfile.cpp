@@ -0,0 +1,468 @@
+/* > qctfile.cpp
+ * 1.03 arb Mon Oct 19 23:59:47 BST 2026 - check the Huffman table against the end of the file
+ * 1.02 arb Mon Oct 19 21:26:52 BST 2026 - table-driven Huffman decoding
+ * 1.01 arb Mon Oct 19 15:48:10 BST 2026 - decode straight into the destination
+ * 1.00 arb Mon Oct 19 15:02:44 BST 2026
+ */
+
+static const char SCCSid[] = "@(#)qctfile.cpp   1.03 (C) 2026 arb QCT tile decoder";
+
+/*
+ * QCTFile decodes the image data of a QCT file a tile at a time so that
+ * QCTImage only has to decode the part of the chart being displayed.
+ *
+ * A QCT file has a fixed size header followed by an index of the offset
+ * of every 64x64 pixel tile, row by row.  Each tile starts with a byte
+ * giving its encoding:
+ *   0 or 255 - Huffman coded pixels
+ *   128..254 - pixel packing, 256-n colours packed into 32-bit words
+ *   1..127   - run-length encoding with n colours
+ * The last two use a sub-palette of colours listed after the first byte.
+ * The rows of a tile are stored interleaved so that the first rows give
+ * a coarse version of the whole tile: row r is stored at position
+ * bit-reverse(r) within the tile.
+ * Tiles are independent so QCTTiles decodes them in several threads,
+ * see qctbench.cpp for a comparison with the osmap QCT class.
+ */
+
+/*
+ * Configuration:
+ * Define HUFFMAN_LOOKUP_BITS as the number of bits of Huffman data which
+ * are looked up at once.  Shorter codes take a single lookup, longer ones
+ * continue down the tree from where the lookup left off.
+ */
+#define HUFFMAN_LOOKUP_BITS 8
+
+
+#include <stdio.h>
+#include <string.h>
+#include <qfile.h>
+#include "satlib/dundee.h" // for debugf
+#include "qctfile.h"
+
+#ifdef Q_OS_UNIX
+#include <sys/types.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+
+#define QCT_MAGIC           0x1423D5FE
+#define QCT_WIDTH_OFFSET    0x08
+#define QCT_HEIGHT_OFFSET   0x0C
+#define QCT_PALETTE_OFFSET  0x01A0  // 256 entries of blue,green,red,unused
+#define QCT_INDEX_OFFSET    0x45A0  // after the 128x128 interpolation matrix
+#define QCT_TILE_PIXELS     (QCTFILE_TILE_SIZE * QCTFILE_TILE_SIZE)
+
+// QCT files are always little-endian
+#define GET16(p) ((unsigned int)(p)[0] | ((unsigned int)(p)[1]<<8))
+#define GET32(p) (GET16(p) | (GET16((p)+2)<<16))
+
+
+/* ----------------------------------------------------------------------------
+ */
+QCTFile::QCTFile(const QString &filename)
+{
+	ok = false;
+	tilesWide = tilesHigh = 0;
+	base = 0;
+	size = 0;
+	mapped = false;
+	palette = tileIndex = 0;
+
+	if (!mapFile(filename))
+	{
+		log_error_message("cannot read %s", (const char*)filename);
+		return;
+	}
+	ok = readHeader();
+	if (!ok)
+		log_error_message("not a QCT file %s", (const char*)filename);
+	debugf(1, "QCTFile %s has %d x %d tiles\n", (const char*)filename, tilesWide, tilesHigh);
+}
+
+
+QCTFile::~QCTFile()
+{
+	unmapFile();
+}
+
+
+/*
+ * Map the whole file into memory, or if that's not possible read it all.
+ * Only the pages of the tiles actually decoded are read from the disk.
+ */
+bool
+QCTFile::mapFile(const QString &filename)
+{
+#ifdef Q_OS_UNIX
+	int fd = ::open(QFile::encodeName(filename), O_RDONLY);
+	if (fd >= 0)
+	{
+		struct stat st;
+		if (fstat(fd, &st) == 0 && st.st_size > 0)
+		{
+			void *addr = mmap(0, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+			if (addr != MAP_FAILED)
+			{
+				base = (const unsigned char*)addr;
+				size = st.st_size;
+				mapped = true;
+			}
+		}
+		::close(fd);
+		if (mapped)
+			return true;
+	}
+#endif
+	QFile file(filename);
+	if (!file.open(IO_ReadOnly))
+		return false;
+	filedata = file.readAll();
+	file.close();
+	base = (const unsigned char*)filedata.data();
+	size = filedata.size();
+	return (size > 0);
+}
+
+
+void
+QCTFile::unmapFile()
+{
+#ifdef Q_OS_UNIX
+	if (mapped)
+		munmap((void*)base, size);
+#endif
+	mapped = false;
+	filedata.resize(0);
+	base = 0;
+	size = 0;
+}
+
+
+bool
+QCTFile::readHeader()
+{
+	if (size < QCT_INDEX_OFFSET || GET32(base) != QCT_MAGIC)
+		return false;
+	tilesWide = GET32(base + QCT_WIDTH_OFFSET);
+	tilesHigh = GET32(base + QCT_HEIGHT_OFFSET);
+	// Sanity check the size before using it to check the index
+	if (tilesWide <= 0 || tilesHigh <= 0 || tilesWide > 65535 || tilesHigh > 65535)
+		return false;
+	if ((size - QCT_INDEX_OFFSET) / 4 / tilesWide < (unsigned int)tilesHigh)
+		return false;
+	palette = base + QCT_PALETTE_OFFSET;
+	tileIndex = base + QCT_INDEX_OFFSET;
+	return true;
+}
+
+
+void
+QCTFile::getColour(int index, int *R, int *G, int *B) const
+{
+	if (!ok || index < 0 || index > 255)
+	{
+		*R = *G = *B = 0;
+		return;
+	}
+	*B = palette[index * 4 + 0];
+	*G = palette[index * 4 + 1];
+	*R = palette[index * 4 + 2];
+}
+
+
+/* ----------------------------------------------------------------------------
+ * The decoders fill a tile in the order stored, writing row r of the data
+ * to rows[r] which undoes the interleaving without copying the pixels.
+ * They return false if the data runs off the end of the file.
+ */
+#define PIXEL(rows, ii) (rows[(ii) / QCTFILE_TILE_SIZE][(ii) % QCTFILE_TILE_SIZE])
+
+/*
+ * The Huffman table is a tree stored as bytes: below 128 is a colour,
+ * above 128 is a branch with a jump of 257-value, and 128 is a far branch
+ * with a jump given by the following 16-bit value.  A set bit in the data
+ * (taken from the least significant bit first) takes the branch.
+ * Nodes are given as offsets into the table so a broken jump can be
+ * checked against the size of the table before it is followed.
+ */
+static inline int
+huffmanBranch(const unsigned char *table, int node, int bit)
+{
+	if (table[node] == 128)
+		return node + (bit ? 65537 - (int)GET16(table+node+1) + 2 : 3);
+	return node + (bit ? 257 - table[node] : 1);
+}
+
+
+/*
+ * What to do for each value of the next HUFFMAN_LOOKUP_BITS bits: if
+ * length is non-zero a colour has been reached using that many bits,
+ * otherwise continue from node after using all the bits.
+ */
+struct HuffmanLookup
+{
+	int node;              // offset into the table
+	unsigned char colour;
+	unsigned char length;  // or HUFFMAN_BAD if the tree is broken
+};
+#define HUFFMAN_BAD 255
+
+
+static bool
+decodeHuffman(const unsigned char *p, const unsigned char *end, unsigned char **rows)
+{
+	const unsigned char *table = p;
+	HuffmanLookup lookup[1 << HUFFMAN_LOOKUP_BITS];
+	int colours = 0, branches = 0;
+	int ii, kk;
+
+	// Find the end of the table, which is when every branch has a colour
+	// (checking there is room for the jump of a far branch before using it)
+	while (colours <= branches)
+	{
+		if (p >= end)
+			return false;
+		if (*p == 128)
+		{
+			if (end - p < 3)
+				return false;
+			p += 3;
+			branches++;
+		}
+		else if (*p > 128)
+		{
+			p++;
+			branches++;
+		}
+		else
+		{
+			p++;
+			colours++;
+		}
+	}
+	int tablelen = p - table;
+
+	// Only one colour so no bits are needed
+	if (colours == 1)
+	{
+		for (ii=0; ii<QCTFILE_TILE_SIZE; ii++)
+			memset(rows[ii], table[0], QCTFILE_TILE_SIZE);
+		return true;
+	}
+
+	// Walk the tree once for every possible value of the next few bits
+	for (ii=0; ii<(1 << HUFFMAN_LOOKUP_BITS); ii++)
+	{
+		int node = 0;
+		for (kk=0; kk<HUFFMAN_LOOKUP_BITS && table[node] >= 128; kk++)
+		{
+			node = huffmanBranch(table, node, (ii >> kk) & 1);
+			if (node < 0 || node >= tablelen)
+				break;
+		}
+		lookup[ii].node = node;
+		lookup[ii].colour = 0;
+		if (node < 0 || node >= tablelen)
+			lookup[ii].length = HUFFMAN_BAD;
+		else if (table[node] < 128)
+		{
+			lookup[ii].colour = table[node];
+			lookup[ii].length = kk;
+		}
+		else
+			lookup[ii].length = 0;
+	}
+
+	// Bits are taken from the bottom of a 64-bit buffer, which is padded
+	// with zeros past the end of the file (an error if they're used)
+	unsigned long long bits = 0;
+	int nbits = 0, padbits = 0;
+	for (ii=0; ii<QCT_TILE_PIXELS; ii++)
+	{
+		if (nbits < HUFFMAN_LOOKUP_BITS)
+		{
+			for (; nbits <= 56; nbits += 8)
+			{
+				if (p < end)
+					bits |= (unsigned long long)*p++ << nbits;
+				else
+					padbits += 8;
+			}
+		}
+		const HuffmanLookup &entry = lookup[bits & ((1 << HUFFMAN_LOOKUP_BITS) - 1)];
+		if (entry.length == HUFFMAN_BAD)
+			return false;
+		if (entry.length)
+		{
+			PIXEL(rows, ii) = entry.colour;
+			bits >>= entry.length;
+			nbits -= entry.length;
+			continue;
+		}
+		// A long code continues one bit at a time
+		bits >>= HUFFMAN_LOOKUP_BITS;
+		nbits -= HUFFMAN_LOOKUP_BITS;
+		int node = entry.node;
+		while (table[node] >= 128)
+		{
+			if (nbits == 0)
+			{
+				if (p >= end)
+					return false;
+				bits = *p++;
+				nbits = 8;
+			}
+			node = huffmanBranch(table, node, bits & 1);
+			bits >>= 1;
+			nbits--;
+			if (node < 0 || node >= tablelen)
+				return false;
+		}
+		PIXEL(rows, ii) = table[node];
+	}
+	return (padbits <= nbits);
+}
+
+
+/*
+ * Number of bits needed to index a sub-palette of n colours
+ */
+static inline int
+bitsForColours(int n)
+{
+	int bits = 0;
+	while ((1 << bits) < n)
+		bits++;
+	return bits;
+}
+
+
+/*
+ * The type byte is 256 minus the number of colours in the sub-palette
+ * and the pixels are packed into 32-bit words, least significant first.
+ * They're unpacked in order into a buffer and then copied to the rows,
+ * so the inner loop has no checks.
+ */
+static bool
+decodePacked(const unsigned char *p, const unsigned char *end, unsigned char **rows)
+{
+	int ncolours = 256 - *p++;
+	const unsigned char *subpalette = p;
+	if (p + ncolours > end)
+		return false;
+	p += ncolours;
+	int bpp = bitsForColours(ncolours);
+	int perword = 32 / bpp;
+	unsigned int mask = (1 << bpp) - 1;
+	int nwords = (QCT_TILE_PIXELS + perword - 1) / perword;
+	unsigned char colours[256];
+	unsigned char pixels[QCT_TILE_PIXELS + 32];
+	int ii, kk;
+
+	if (p + nwords * 4 > end)
+		return false;
+	// Indexes beyond the sub-palette use its first colour
+	for (ii=0; ii<=(int)mask; ii++)
+		colours[ii] = subpalette[ii < ncolours ? ii : 0];
+
+	for (ii=0; ii<nwords*perword; ii+=perword)
+	{
+		unsigned int word = GET32(p);
+		p += 4;
+		for (kk=0; kk<perword; kk++)
+		{
+			pixels[ii+kk] = colours[word & mask];
+			word >>= bpp;
+		}
+	}
+	for (ii=0; ii<QCTFILE_TILE_SIZE; ii++)
+		memcpy(rows[ii], pixels + ii * QCTFILE_TILE_SIZE, QCTFILE_TILE_SIZE);
+	return true;
+}
+
+
+/*
+ * The type byte is the number of colours in the sub-palette and each byte
+ * has the colour index in the low bits and the run length in the rest.
+ */
+static bool
+decodeRLE(const unsigned char *p, const unsigned char *end, unsigned char **rows)
+{
+	int ncolours = *p++;
+	const unsigned char *subpalette = p;
+	if (p + ncolours > end)
+		return false;
+	p += ncolours;
+	int bpp = bitsForColours(ncolours);
+	unsigned int mask = (1 << bpp) - 1;
+	int ii = 0;
+
+	while (ii < QCT_TILE_PIXELS)
+	{
+		if (p >= end)
+			return false;
+		unsigned int index = *p & mask;
+		int run = *p++ >> bpp;
+		unsigned char colour = subpalette[index < (unsigned int)ncolours ? index : 0];
+		if (run > QCT_TILE_PIXELS - ii)
+			run = QCT_TILE_PIXELS - ii;
+		// Runs can continue onto the next row
+		while (run > 0)
+		{
+			int col = ii % QCTFILE_TILE_SIZE;
+			int len = QMIN(run, QCTFILE_TILE_SIZE - col);
+			memset(rows[ii / QCTFILE_TILE_SIZE] + col, colour, len);
+			ii += len;
+			run -= len;
+		}
+	}
+	return true;
+}
+
+
+/*
+ * Decode one tile into the destination which must have room for
+ * QCTFILE_TILE_SIZE rows of QCTFILE_TILE_SIZE bytes, stride bytes apart.
+ * A tile which cannot be decoded is filled with colour zero.
+ */
+bool
+QCTFile::decodeTile(int tx, int ty, unsigned char *dst, int stride) const
+{
+	unsigned char *rows[QCTFILE_TILE_SIZE];
+	bool rc = false;
+	int row;
+
+	// Row r of the data is row bit-reverse(r) of the tile
+	for (row=0; row<QCTFILE_TILE_SIZE; row++)
+	{
+		int rev = ((row & 1) << 5) | ((row & 2) << 3) | ((row & 4) << 1)
+			| ((row & 8) >> 1) | ((row & 16) >> 3) | ((row & 32) >> 5);
+		rows[row] = dst + rev * stride;
+	}
+
+	if (ok && tx >= 0 && ty >= 0 && tx < tilesWide && ty < tilesHigh)
+	{
+		unsigned int offset = GET32(tileIndex + 4 * (ty * tilesWide + tx));
+		if (offset > 0 && offset < size)
+		{
+			const unsigned char *p = base + offset, *end = base + size;
+			if (*p == 0 || *p == 255)
+				rc = decodeHuffman(p+1, end, rows);
+			else if (*p >= 128)
+				rc = decodePacked(p, end, rows);
+			else
+				rc = decodeRLE(p, end, rows);
+		}
+	}
+	if (!rc)
+	{
+		debugf(1, "QCTFile cannot decode tile %d,%d\n", tx, ty);
+		for (row=0; row<QCTFILE_TILE_SIZE; row++)
+			memset(rows[row], 0, QCTFILE_TILE_SIZE);
+	}
+	return rc;
+}
@@ -0,0 +1,54 @@
+/* > qctfile.h
+ * 1.00 arb
+ */
+
+#ifndef QCTFILE_H
+#define QCTFILE_H
+
+#include <qstring.h>
+#include <qmemarray.h>
+
+
+#define QCTFILE_TILE_SIZE 64  // pixels square
+
+
+/*
+ * Read-only access to the image data in a QCT file, one tile at a time.
+ * The file is memory-mapped (or read into memory if that's not possible)
+ * and the header and tile index parsed once, so any tile can then be
+ * decoded directly without reading the rest of the image.
+ * decodeTile only reads shared data so it can be called from any thread.
+ * The georeferencing and metadata are still read by the osmap QCT class.
+ */
+class QCTFile
+{
+public:
+	QCTFile(const QString &filename);
+	~QCTFile();
+	bool isOk() const { return ok; }
+	int getTilesWide() const { return tilesWide; }
+	int getTilesHigh() const { return tilesHigh; }
+	int getImageWidth() const  { return tilesWide * QCTFILE_TILE_SIZE; }
+	int getImageHeight() const { return tilesHigh * QCTFILE_TILE_SIZE; }
+	void getColour(int index, int *R, int *G, int *B) const;
+	// Decode one tile into dst which has stride bytes per row
+	bool decodeTile(int tx, int ty, unsigned char *dst, int stride) const;
+private:
+	bool mapFile(const QString &filename);
+	void unmapFile();
+	bool readHeader();
+private:
+	bool ok;
+	int tilesWide, tilesHigh;
+	// The whole file, either mapped or read into memory
+	const unsigned char *base;
+	unsigned int size;
+	bool mapped;
+	QByteArray filedata;
+	// Pointers into the file
+	const unsigned char *palette;
+	const unsigned char *tileIndex;
+};
+
+
+#endif // !QCTFILE_H
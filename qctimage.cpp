@@ -1,13 +1,50 @@
 /* > qctimage.cpp
+ * 1.20 arb Mon Oct 19 23:59:53 BST 2026 - stream field over part of the chart
+ * 1.19 arb Mon Oct 19 23:59:51 BST 2026 - save between levels from the nearest level
+ * 1.18 arb Mon Oct 19 23:59:37 BST 2026 - redraw the layer for tiles made by any thread
+ * 1.17 arb Mon Oct 19 23:59:20 BST 2026 - save between levels by resampling
+ * 1.16 arb Mon Oct 19 23:59:14 BST 2026 - print in bands at the printer's resolution
+ * 1.15 arb Mon Oct 19 23:58:21 BST 2026 - resample in QCTTiles, arrow outline for other renderers
+ * 1.14 arb Mon Oct 19 23:57:48 BST 2026 - particle trails
+ * 1.13 arb Mon Oct 19 23:56:12 BST 2026 - stream field
+ * 1.12 arb Mon Oct 19 23:52:06 BST 2026 - keep the visible chart in a layer under the overlays
+ * 1.11 arb Mon Oct 19 23:41:20 BST 2026 - repaint all the overlay changes at once
+ * 1.10 arb Mon Oct 19 23:10:52 BST 2026 - draw arrows from cached anti-aliased sprites
+ * 1.09 arb Mon Oct 19 22:38:15 BST 2026 - trace painting instead of debugf
+ * 1.08 arb Mon Oct 19 22:03:39 BST 2026 - only look at the overlays near the area painted
+ * 1.07 arb Mon Oct 19 20:41:07 BST 2026 - keep the tiles of recent charts in a shared cache
+ * 1.06 arb Mon Oct 19 19:55:18 BST 2026 - zoom by any factor, resampled from the pyramid
+ * 1.05 arb Mon Oct 19 18:30:05 BST 2026 - draw tiles from pixmaps in the display format
+ * 1.04 arb Mon Oct 19 17:48:26 BST 2026 - keep decoded tiles in a disk cache
+ * 1.03 arb Mon Oct 19 17:05:12 BST 2026 - make tiles in background threads ahead of the view
+ * 1.02 arb Mon Oct 19 16:20:31 BST 2026 - pyramid of reduced tiles for each zoom level
+ * 1.01 arb Mon Oct 19 15:02:44 BST 2026 - decode tiles as they become visible
  * 1.00 arb Thu May 27 09:18:38 BST 2010
  */
 
-static const char SCCSid[] = "@(#)qctimage.cpp  1.00 (C) 2010 arb QCT image scrollview";
+static const char SCCSid[] = "@(#)qctimage.cpp  1.20 (C) 2010 arb QCT image scrollview";
 
 /*
  * QCTImage is a class to display a QCT (QuickChart) image.
  * It is a subclass of QScrollView so it can be used like a widget
  * that displays an image with scrollbars.
+ * The image is held as a grid of tiles which are only decoded when they
+ * are needed.  Background threads make the tiles which are visible and
+ * those in the direction the view is moving, and a placeholder is drawn
+ * for any which aren't ready, so the user interface never waits for
+ * tiles to be decoded, however big the chart is.
+ * The tiles near the view are also kept as pixmaps in the display's own
+ * format so scrolling only has to copy them to the screen.
+ * The zoomed out levels are a pyramid of tiles each half the size of the
+ * level above (see qcttiles.cpp), made when first needed, so changing
+ * zoom level doesn't need to read the file again.  Zooms in between the
+ * levels are resampled from the next larger level as they are drawn.
+ * The pyramids of charts viewed recently are kept (see QCTTileCache)
+ * so going back to one doesn't need its tiles to be made again.
+ * The visible part of the chart is kept in a layer pixmap, which is only
+ * drawn again where the view has scrolled, the zoom has changed or tiles
+ * have arrived, so changing the overlays just copies the chart back from
+ * the layer and draws the overlays on top.
  */
 
 /*
@@ -19,44 +56,107 @@ static const char SCCSid[] = "@(#)qctimage.cpp  1.00 (C) 2010 arb QCT image scro
  * it to remain stationary.
  */
 #define STOP_MAP_MOVING_AFTER_MSEC 50
+/*
+ * Define FLOAT_STEP_MSEC as the time between each step of a floating map.
+ */
+#define FLOAT_STEP_MSEC 100
+/*
+ * Define PREFETCH_AHEAD_MSEC as how far ahead of a moving map to have
+ * the tiles made, in time, and PREFETCH_STEPS as the number of points
+ * along that path at which to look for tiles.
+ * Define PLACEHOLDER_COLOUR as the colour drawn where tiles are not ready.
+ */
+#define PREFETCH_AHEAD_MSEC 1000
+#define PREFETCH_STEPS 4
+/*
+ * Define DISPLAY_TILES as the number of tiles to keep as pixmaps, and
+ * DISPLAY_TILES_MARGIN as how many tiles around the view to keep when
+ * there are more.
+ */
+#define DISPLAY_TILES 128
+#define DISPLAY_TILES_MARGIN 2
+/*
+ * Define MIN_ZOOM as the largest the chart can be shown, 0.5 is double size.
+ */
+#define MIN_ZOOM 0.5
+#define PLACEHOLDER_COLOUR QColor(0xd8, 0xd8, 0xd8)
+/*
+ * Arrows are drawn on the screen from sprites made the first time they
+ * are needed, with the bearing rounded to ARROW_BEARING_STEP degrees and
+ * the length to ARROW_LENGTH_STEP pixels.  Sprites are drawn
+ * ARROW_SUPERSAMPLE times larger and reduced, using the coverage of
+ * each pixel as its alpha so the edges are smooth.  Define
+ * ARROW_SPRITE_BYTES as the memory which can be used by sprites before
+ * they're all discarded and made again as needed.
+ */
+#define ARROW_BEARING_STEP 2
+#define ARROW_LENGTH_STEP  2
+#define ARROW_SUPERSAMPLE  4
+#define ARROW_SPRITE_BYTES (16 * 1048576)
+#define ARROW_FILL_COLOUR   QColor(0xff, 0, 0)
+#define ARROW_FIELD_COLOUR  QColor(0xff, 0xa0, 0x40)
+#define ARROW_FIELD_STEM    2  // half the width of a field arrow's stem
+#define TRAIL_COLOUR        qRgb(0x00, 0x30, 0xa0)
+#define TRAIL_MAX_LENGTH    64 // pixels, anything longer has jumped
+#define ARROW_BORDER_COLOUR QColor(0, 0, 0)
+#define ARROW_KEY_COLOUR    QColor(0, 0, 255)  // not used by the arrow
+/*
+ * Define PRINT_BAND_BYTES as the size of each band of the chart drawn
+ * when printing, which limits the memory used however big the section.
+ */
+#define PRINT_BAND_BYTES (16 * 1048576)
 
 
+#include <math.h>
+#include <string.h>
 #include <qapplication.h> // for OverrideCursor
 #include <qcursor.h>      // for QCursor::pos
 #include <qpainter.h>
 #include <qtimer.h>
 
 #include "satlib/dundee.h"
+#include "trace.h"
 #include "osmap/qct.h"
 #include "qctimage.h"
 
 
 /* ---------------------------------------------------------------------------
- *
+ * The sprites are shared by every arrow with the same rounded bearing and
+ * length.  The offset is from the arrow's origin to the top left.
  */
-ArrowPlot::ArrowPlot(int x, int y, float bearing, float length)
+struct ArrowSprite
 {
-	stemwidth = 8;
-	filled = true;
+	QPixmap pixmap;
+	QPoint offset;
+};
 
-	QPointArray prepoints(8);
-	prepoints[0] = QPoint(-stemwidth, 0);
-	prepoints[1] = QPoint(-stemwidth, NINT(-length));
-	prepoints[2] = QPoint(-stemwidth*2, NINT(-length));
-	prepoints[3] = QPoint(0, NINT(-length)-stemwidth*2);
-	prepoints[4] = QPoint(stemwidth*2, NINT(-length));
-	prepoints[5] = QPoint(stemwidth, NINT(-length));
-	prepoints[6] = QPoint(stemwidth, 0);
-	prepoints[7] = QPoint(-stemwidth, 0);
+static QMap<int, ArrowSprite> arrowSprites;
+static int arrowSpriteBytes = 0;
 
-	// Translate origin THEN rotate all the points
-	QWMatrix wm;
-	wm.translate(x, y);
-	wm.rotate(bearing);
-	points = wm.map(prepoints);
 
-	// For speed extract the bounding box and keep it
-	boundingBox = points.boundingRect();
+// Round down, even for negative numbers
+static inline int
+floorDiv(int a, int b)
+{
+	return (a >= 0) ? a / b : -((-a + b - 1) / b);
+}
+
+
+ArrowPlot::ArrowPlot(int ax, int ay, float abearing, float alength, bool afield)
+{
+	stemwidth = stemWidth(afield);
+	filled = true;
+	field = afield;
+
+	x = ax;
+	y = ay;
+	bearing = NINT(abearing / ARROW_BEARING_STEP) * ARROW_BEARING_STEP;
+	bearing = ((bearing % 360) + 360) % 360;
+	length = NINT(alength / ARROW_LENGTH_STEP) * ARROW_LENGTH_STEP;
+
+	findSprite();
+	// For speed keep the bounding box, which includes the smoothed edges
+	boundingBox = QRect(x + spriteOffset.x(), y + spriteOffset.y(), sprite.width(), sprite.height());
 }
 
 ArrowPlot::~ArrowPlot()
@@ -69,13 +169,136 @@ ArrowPlot::rect() const
 	return boundingBox;
 }
 
+
+int
+ArrowPlot::stemWidth(bool afield)
+{
+	return afield ? ARROW_FIELD_STEM : 8;
+}
+
+
+/*
+ * The outline of the arrow, scaled up and placed at x,y
+ */
+QPointArray
+ArrowPlot::shape(int scale, int ox, int oy) const
+{
+	return outline(ox, oy, bearing, length * scale, stemwidth * scale);
+}
+
+
+/*
+ * The outline of an arrow pointing along the bearing from x,y (its tail)
+ * with a stem sw either side and a head twice as wide.
+ */
+QPointArray
+ArrowPlot::outline(int ox, int oy, int bearing, int len, int sw)
+{
+	QPointArray prepoints(8);
+	prepoints[0] = QPoint(-sw, 0);
+	prepoints[1] = QPoint(-sw, -len);
+	prepoints[2] = QPoint(-sw*2, -len);
+	prepoints[3] = QPoint(0, -len-sw*2);
+	prepoints[4] = QPoint(sw*2, -len);
+	prepoints[5] = QPoint(sw, -len);
+	prepoints[6] = QPoint(sw, 0);
+	prepoints[7] = QPoint(-sw, 0);
+
+	// Translate origin THEN rotate all the points
+	QWMatrix wm;
+	wm.translate(ox, oy);
+	wm.rotate(bearing);
+	return wm.map(prepoints);
+}
+
+
+/*
+ * Find the sprite for this bearing and length, making it if necessary.
+ * The arrow is drawn large on a key colour then each block of pixels is
+ * reduced to one pixel, its colour the average of those in the arrow
+ * and its alpha the fraction of them in the arrow.
+ */
 void
-ArrowPlot::plot(QPainter *painter)
+ArrowPlot::findSprite()
 {
-	if (filled)
-		painter->drawPolygon(points);
+	const int ss = ARROW_SUPERSAMPLE;
+	int key = (field ? 1 << 24 : 0) + (bearing / ARROW_BEARING_STEP) * 65536 + length / ARROW_LENGTH_STEP;
+	int xx, yy, kx, ky;
+
+	QMap<int, ArrowSprite>::Iterator it = arrowSprites.find(key);
+	if (it == arrowSprites.end())
+	{
+		if (arrowSpriteBytes > ARROW_SPRITE_BYTES)
+		{
+			// Arrows already plotted keep their own copy
+			arrowSprites.clear();
+			arrowSpriteBytes = 0;
+		}
+		// Whole pixels around the large outline with room for the border
+		QPointArray big = shape(ss, 0, 0);
+		QRect bb = big.boundingRect();
+		int left = floorDiv(bb.left() - ss, ss), top = floorDiv(bb.top() - ss, ss);
+		int width = floorDiv(bb.right() + ss, ss) - left + 1;
+		int height = floorDiv(bb.bottom() + ss, ss) - top + 1;
+		big.translate(-left * ss, -top * ss);
+
+		QPixmap canvas(width * ss, height * ss);
+		canvas.fill(ARROW_KEY_COLOUR);
+		QPainter painter(&canvas);
+		painter.setPen(QPen(ARROW_BORDER_COLOUR, ss, Qt::SolidLine));
+		painter.setBrush(QBrush(field ? ARROW_FIELD_COLOUR : ARROW_FILL_COLOUR, Qt::SolidPattern));
+		painter.drawPolygon(big);
+		painter.end();
+		QImage large = canvas.convertToImage().convertDepth(32);
+		QRgb keyrgb = ARROW_KEY_COLOUR.rgb() & RGB_MASK;
+
+		QImage small(width, height, 32);
+		small.setAlphaBuffer(true);
+		for (yy=0; yy<height; yy++)
+		{
+			QRgb *dst = (QRgb*)small.scanLine(yy);
+			for (xx=0; xx<width; xx++)
+			{
+				int r = 0, g = 0, b = 0, n = 0;
+				for (ky=0; ky<ss; ky++)
+				{
+					const QRgb *src = (const QRgb*)large.scanLine(yy * ss + ky) + xx * ss;
+					for (kx=0; kx<ss; kx++)
+						if ((src[kx] & RGB_MASK) != keyrgb)
+						{
+							r += qRed(src[kx]);
+							g += qGreen(src[kx]);
+							b += qBlue(src[kx]);
+							n++;
+						}
+				}
+				dst[xx] = n ? qRgba(r / n, g / n, b / n, n * 255 / (ss * ss)) : 0;
+			}
+		}
+
+		ArrowSprite newsprite;
+		newsprite.pixmap.convertFromImage(small);
+		newsprite.offset = QPoint(left, top);
+		arrowSpriteBytes += width * height * 4;
+		it = arrowSprites.insert(key, newsprite);
+	}
+	sprite = it.data().pixmap;
+	spriteOffset = it.data().offset;
+}
+
+
+/*
+ * The painter's pen and brush are used when not drawing the sprite.
+ */
+void
+ArrowPlot::plot(QPainter *painter, bool usesprite)
+{
+	if (usesprite && filled)
+		painter->drawPixmap(x + spriteOffset.x(), y + spriteOffset.y(), sprite);
+	else if (filled)
+		painter->drawPolygon(shape(1, x, y));
 	else
-		painter->drawPolyline(points);
+		painter->drawPolyline(shape(1, x, y));
 }
 
 
@@ -97,8 +320,7 @@ TidePlot::TidePlot(int x, int y, float min, float max, float currently)
 	prepoints[4] = QPoint(-dimension, -dimension*2);
 	prepoints[5] = QPoint(-dimension,  dimension*2-level);
 	prepoints[6] = QPoint( dimension,  dimension*2-level);
-	debugf(1,"TIDEPLOT %f < %f < %f =  %d < %d(%f) < %d\n",
-		min,currently,max, -dimension*2,-dimension*2+level,((currently-min)/(max-min)*dimension*4),dimension*2);
+	TRACE("TidePlot level", currently, level);
 
 	// Translate origin to move all the points
 	QWMatrix wm;
@@ -135,11 +357,27 @@ TidePlot::plot(QPainter *painter)
 QCTImage::QCTImage(QWidget *parent) : QScrollView(parent, "qcti", WNoAutoErase|WStaticContents|WPaintClever)
 {
 	qct = 0;
+	tiles = 0;
+	npixmaps = 0;
+	zoom = 1;
+	level = 0;
+	scale = 1;
+	imagewidth = imageheight = 0;
+	tilesx = tilesy = 0;
 	dragging = floating = false;
 	startx = starty = 0;
+	plotting = 0;
+	fieldLeft = fieldTop = fieldSpacing = fieldColumns = fieldRows = fieldMaxLength = 0;
+	trailsEmpty = true;
+	trailsChanged = false;
+
+	pixmaps.setAutoDelete(true);
 
-	arrowList.setAutoDelete(true);
-	tideList.setAutoDelete(true);
+	// Tiles are made in the background ahead of being needed
+	decoder = new QCTTileDecoder();
+	prefetchTimer = new QTimer(this);
+	connect(prefetchTimer, SIGNAL(timeout()), this, SLOT(prefetchTiles()));
+	connect(this, SIGNAL(contentsMoving(int,int)), this, SLOT(viewMoving(int,int)));
 
 	// Allow mouse move events through to contentsMouseMoveEvent
 	viewport()->setMouseTracking(true);
@@ -155,91 +393,454 @@ QCTImage::QCTImage(QWidget *parent) : QScrollView(parent, "qcti", WNoAutoErase|W
 QCTImage::~QCTImage()
 {
 	unload();
+	delete decoder;
 }
 
 
 void
 QCTImage::unload()
 {
+	prefetchTimer->stop();
+	// Wait for the decoder to finish with the tiles before closing them
+	decoder->setTiles(0);
+	if (tiles)
+	{
+		tiles->removeReceiver(this);
+		QCTTileCache::instance()->close(tiles);
+		tiles = 0;
+	}
 	if (qct)
 	{
 		delete qct;
 		qct = 0;
 	}
-	arrowList.clear();
-	tideList.clear();
+	imagewidth = imageheight = 0;
+	tilesx = tilesy = 0;
+	clearDisplayTiles();
+	chartLayerValid = QRegion();
+	motion = QPoint(0, 0);
+	arrowGrid.clear();
+	tideGrid.clear();
+	fieldColumns = fieldRows = 0;
+	trailImage.reset();
+	trailsEmpty = true;
 }
 
 
 /*
- * Load a QCT, create a QImage, copy the image data from the QCT,
- * resize the internal dimensions of the scrollview, scroll to middle.
+ * Load the QCT header for its georeferencing and open the file for
+ * decoding tiles, resize the internal dimensions of the scrollview,
+ * scroll to middle.  No image data is decoded until it's needed.
+ * The QCT is always opened at full size and the coordinates converted
+ * to the zoom level by latLonToXY and xyToLatLon.
  */
 bool
-QCTImage::load(QString filename, int scalefactor)
+QCTImage::load(QString filename, double scalefactor)
 {
-	int ii, yy, width, height;
-
 	qct = new QCT();
-	QApplication::setOverrideCursor(waitCursor);
-	if (!qct->openFilename((const char*)filename, false, scalefactor))
+	// pass headeronly=true to prevent reading whole image
+	if (!qct->openFilename((const char*)filename, true))
 	{
 		log_error_message("cannot read %s", (const char*)filename);
+		delete qct;
+		qct = 0;
 		return false;
 	}
-	QApplication::restoreOverrideCursor();
-
-	// Create the internal image with the correct dimensions
-	width = qct->getImageWidth();
-	height = qct->getImageHeight();
-	image.reset();
-	image.create(width, height, 8, 256);
-	debugf(1, "loaded QCT %d x %d (reduced %d) from %s\n", width, height, scalefactor, (const char*)filename);
-
-	// Fill in the colourmap by querying the QCT colourmap
-	for (ii=0; ii<256; ii++)
+	// The pyramid may still be in the cache with its tiles already made
+	tiles = QCTTileCache::instance()->open(filename);
+	if (tiles == 0)
 	{
-		int R, G, B;
-		qct->getColour(ii, &R, &G, &B);
-		image.setColor(ii, qRgb(R, G, B));
+		delete qct;
+		qct = 0;
+		return false;
 	}
+	debugf(1, "opened QCT %d x %d from %s\n", tiles->getLevelWidth(0), tiles->getLevelHeight(0), (const char*)filename);
+	decoder->setTiles(tiles);
+	tiles->addReceiver(this);
 
-	// Fill in the image data by reading the QCT image data
-	for (yy=0; yy<height; yy++)
+	// Tell the scrollview how big its image is
+	level = -1;
+	zoom = 0;
+	setZoom(scalefactor);
+
+	// Scroll to the middle
+	center(imagewidth/2, imageheight/2);
+
+	return true;
+}
+
+
+/*
+ * Change the zoom, using the level of the pyramid which is the same size
+ * or the next larger.  Zooms within a small fraction of a level are
+ * treated as that level as its tiles can be drawn without resampling.
+ * Tiles already made at any level are kept so changing back is instant.
+ * The arrows and tides are removed as their positions are no longer
+ * correct, so they must be plotted again.
+ */
+void
+QCTImage::setZoom(double newzoom)
+{
+	int lev;
+
+	if (tiles == 0)
+		return;
+	newzoom = QMAX(MIN_ZOOM, QMIN(1 << (QCTTILES_LEVELS-1), newzoom));
+	for (lev=0; lev<QCTTILES_LEVELS-1 && (2 << lev) <= newzoom * 1.001; lev++)
+		;
+	if (fabs(newzoom - (1 << lev)) < newzoom * 0.001)
+		newzoom = 1 << lev;
+	if (newzoom == zoom && lev == level)
+		return;
+
+	if (lev != level)
 	{
-		memcpy(image.scanLine(yy), qct->getImage()+yy*width*sizeof(unsigned char), width*sizeof(unsigned char));
+		level = lev;
+		tilesx = tiles->tilesAcross(level);
+		tilesy = tiles->tilesDown(level);
+		clearDisplayTiles();
 	}
+	zoom = newzoom;
+	scale = (1 << level) / zoom;
+	imagewidth = (int)(tiles->getLevelWidth(level) * scale);
+	imageheight = (int)(tiles->getLevelHeight(level) * scale);
+	motion = QPoint(0, 0);
+	chartLayerValid = QRegion();
+	arrowGrid.clear();
+	tideGrid.clear();
+	fieldColumns = fieldRows = 0;
+	trailImage.reset();
+	trailsEmpty = true;
+	debugf(1, "zoom %f is %d x %d from level %d\n", zoom, imagewidth, imageheight, level);
+
+	resizeContents(imagewidth, imageheight);
+	updateContents();
+	prefetchTimer->start(0, true);
+}
 
-	// Free the image memory from within the QCT object now we've copied it
-	qct->unloadImage();
 
-	// Tell the scrollview how big its image is
-	resizeContents(width, height);
+/*
+ * Zoom keeping the same part of the chart under the point in the viewport,
+ * eg. the mouse.
+ */
+void
+QCTImage::zoomAt(double newzoom, int vx, int vy)
+{
+	double fx = (contentsX() + vx) * zoom;
+	double fy = (contentsY() + vy) * zoom;
+	setZoom(newzoom);
+	setContentsPos(NINT(fx / zoom) - vx, NINT(fy / zoom) - vy);
+}
 
-	// Scroll to the middle
-	center(width/2, height/2);
 
-	return true;
+/*
+ * Convert an area of the view to the pixels of the level it's drawn from,
+ * including the neighbours needed for resampling, and back again.
+ */
+QRect
+QCTImage::toLevel(const QRect &area) const
+{
+	return QCTTiles::sourceRect(area, scale);
+}
+
+
+QRect
+QCTImage::fromLevel(const QRect &rect) const
+{
+	if (scale == 1)
+		return rect;
+	int left = (int)floor((rect.left() - 1) * scale);
+	int top = (int)floor((rect.top() - 1) * scale);
+	int right = (int)ceil((rect.right() + 2) * scale);
+	int bottom = (int)ceil((rect.bottom() + 2) * scale);
+	return QRect(QPoint(left, top), QPoint(right, bottom));
 }
 
 
 /*
- * Save the image to a file
+ * Save the image to a file, at the level of the pyramid nearest the zoom
+ * shown.  The tiles not already made are decoded straight into the 8-bit
+ * image, in several threads, so it is the only copy of the chart made.
+ * Between levels the chart is not resampled, as that would need the
+ * whole of it in 32 bits as well as the level it came from.
  */
 bool
 QCTImage::save(QString filename, const char *fmt)
 {
+	int lev = level;
+	int ii;
+
+	if (tiles == 0)
+		return false;
+
+	// The next level is nearer if the zoom is past the geometric mean
+	if (lev < QCTTILES_LEVELS-1 && zoom * zoom > (double)(1 << lev) * (2 << lev))
+		lev++;
+	QImage image(tiles->getLevelWidth(lev), tiles->getLevelHeight(lev), 8, 256);
+	for (ii=0; ii<256; ii++)
+		image.setColor(ii, tiles->getColour(ii));
+	tiles->copyLevel(lev, &image, decoder->getThreadCount());
 	return image.save(filename, fmt);
 }
 
 
 /* --------------------------------------------------------------------------
- * Paint the portion of the image onto the screen or printer.
+ * Keep track of where the view is heading so the tiles there can be made
+ * before they're needed.  motion is how far the view is expected to move
+ * in the next PREFETCH_AHEAD_MSEC.  While floating that is known exactly,
+ * otherwise it is estimated from the speed of the last move.
+ */
+void
+QCTImage::viewMoving(int x, int y)
+{
+	int elapsed = lastViewMoveTime.restart();
+
+	if (floating)
+		motion = dragDelta / 4 * (PREFETCH_AHEAD_MSEC / FLOAT_STEP_MSEC);
+	else if (elapsed > 0 && elapsed < PREFETCH_AHEAD_MSEC)
+		motion = (QPoint(x, y) - QPoint(contentsX(), contentsY())) * PREFETCH_AHEAD_MSEC / elapsed;
+	else
+		motion = QPoint(0, 0);
+
+	// No further than a screen ahead
+	motion.setX(QMAX(-visibleWidth(), QMIN(visibleWidth(), motion.x())));
+	motion.setY(QMAX(-visibleHeight(), QMIN(visibleHeight(), motion.y())));
+
+	if (!prefetchTimer->isActive())
+		prefetchTimer->start(0, true);
+}
+
+
+/*
+ * Give the decoder a new list of tiles to make, most urgent first:
+ * those visible now, nearest the middle first, then those along the
+ * path the view is taking, then a margin around the view, and last the
+ * same view at the adjacent levels of the pyramid ready for zooming.
+ * Tiles which are no longer wanted are dropped from the list.
+ */
+void
+QCTImage::prefetchTiles()
+{
+	if (tiles == 0)
+		return;
+
+	// Everything is worked out in pixels of the level
+	QRect vis = toLevel(QRect(contentsX(), contentsY(), visibleWidth(), visibleHeight()));
+	QPoint mid = vis.center();
+	QPoint heading((int)(motion.x() / scale), (int)(motion.y() / scale));
+	QValueList<QCTTileJob> jobs;
+	int step;
+
+	addJobs(jobs, level, vis, mid);
+	if (!heading.isNull())
+	{
+		for (step=1; step<=PREFETCH_STEPS; step++)
+		{
+			QRect ahead(vis);
+			ahead.moveBy(heading.x() * step / PREFETCH_STEPS, heading.y() * step / PREFETCH_STEPS);
+			addJobs(jobs, level, ahead, ahead.center());
+		}
+	}
+	QRect margin(vis);
+	margin.addCoords(-QCTTILES_TILE_SIZE, -QCTTILES_TILE_SIZE, QCTTILES_TILE_SIZE, QCTTILES_TILE_SIZE);
+	addJobs(jobs, level, margin, mid);
+	if (level+1 < QCTTILES_LEVELS)
+		addJobs(jobs, level+1, QRect(vis.x()/2, vis.y()/2, vis.width()/2, vis.height()/2), mid/2);
+	if (level > 0)
+	{
+		QRect below(vis);
+		below.moveCenter(mid*2);
+		addJobs(jobs, level-1, below, mid*2);
+	}
+	decoder->setJobs(jobs);
+}
+
+
+/*
+ * Add the tiles in the area which haven't been made and aren't already
+ * in the list, nearest to mid first.
+ */
+void
+QCTImage::addJobs(QValueList<QCTTileJob> &jobs, int lev, const QRect &area, const QPoint &mid)
+{
+	QRect clipped = area & QRect(0, 0, tiles->getLevelWidth(lev), tiles->getLevelHeight(lev));
+	QValueList<QCTTileJob> found;
+	QValueList<int> dists;
+	int tx, ty;
+
+	if (clipped.isEmpty())
+		return;
+	for (ty = clipped.top() / QCTTILES_TILE_SIZE; ty <= clipped.bottom() / QCTTILES_TILE_SIZE; ty++)
+	{
+		for (tx = clipped.left() / QCTTILES_TILE_SIZE; tx <= clipped.right() / QCTTILES_TILE_SIZE; tx++)
+		{
+			QCTTileJob job(lev, ty * tiles->tilesAcross(lev) + tx);
+			if (tiles->find(job.level, job.index) || jobs.find(job) != jobs.end())
+				continue;
+			int dist = (tiles->tileRect(lev, job.index).center() - mid).manhattanLength();
+			QValueList<QCTTileJob>::Iterator jt = found.begin();
+			QValueList<int>::Iterator dt = dists.begin();
+			while (dt != dists.end() && *dt <= dist)
+			{
+				++jt;
+				++dt;
+			}
+			found.insert(jt, job);
+			dists.insert(dt, dist);
+		}
+	}
+	jobs += found;
+}
+
+
+/*
+ * A tile has been made so draw it if it's still wanted, whether it was
+ * made by the decoder or while painting in this thread (when the chart
+ * layer may still have a placeholder for it).
+ */
+void
+QCTImage::customEvent(QCustomEvent *event)
+{
+	if (event->type() != QCTTILES_EVENT)
+		return;
+	QCTTileEvent *tileEvent = (QCTTileEvent*)event;
+	if (tileEvent->tiles == tiles && tiles && tileEvent->job.level == level)
+	{
+		QRect rect = fromLevel(tiles->tileRect(level, tileEvent->job.index));
+		invalidateChartLayer(rect);
+		updateContents(rect);
+	}
+	// Not drawing now so tiles can be evicted
+	QCTTileCache::instance()->trim();
+}
+
+
+/* --------------------------------------------------------------------------
+ * Paint the tiles in the area, either making any which are needed
+ * (wait=true) or drawing a placeholder until the decoder has made them.
+ * When the zoom is between levels the area is resampled instead.
+ */
+void
+QCTImage::renderChart(QPainter *painter, const QRect &area, bool wait)
+{
+	int tx, ty;
+	bool missing = false;
+
+	for (ty = area.top() / QCTTILES_TILE_SIZE; scale == 1 && ty <= area.bottom() / QCTTILES_TILE_SIZE && ty < tilesy; ty++)
+	{
+		for (tx = area.left() / QCTTILES_TILE_SIZE; tx <= area.right() / QCTTILES_TILE_SIZE && tx < tilesx; tx++)
+		{
+			int index = ty * tilesx + tx;
+			QRect tilerect = tiles->tileRect(level, index);
+			QRect rect = tilerect & area;
+			QPoint offset = rect.topLeft() - tilerect.topLeft();
+			QImage *tile;
+			QPixmap *pixmap;
+			if (wait && (tile = tiles->make(level, index)) != 0)
+				painter->drawImage(rect.x(), rect.y(), *tile, offset.x(), offset.y(), rect.width(), rect.height());
+			else if (!wait && (pixmap = displayTile(index)) != 0)
+				painter->drawPixmap(rect.x(), rect.y(), *pixmap, offset.x(), offset.y(), rect.width(), rect.height());
+			else
+			{
+				painter->fillRect(rect, QBrush(PLACEHOLDER_COLOUR));
+				missing = true;
+			}
+		}
+	}
+	if (scale != 1)
+		missing = !resampleArea(painter, area, wait);
+	if (missing && !prefetchTimer->isActive())
+		prefetchTimer->start(0, true);
+	if (npixmaps > DISPLAY_TILES)
+		trimDisplayTiles();
+}
+
+
+/*
+ * Resample the pixels of the level into the area of the view.  This is
+ * only done for the area being painted, with no file reading, as the
+ * level is no more than twice the size of the view.
+ * Returns false if any tiles weren't ready, which are left as placeholders.
+ */
+bool
+QCTImage::resampleArea(QPainter *painter, const QRect &area, bool wait)
+{
+	QValueList<QRect> missing;
+
+	if ((toLevel(area) & QRect(0, 0, tiles->getLevelWidth(level), tiles->getLevelHeight(level))).isEmpty())
+		return true;
+	QImage image(area.width(), area.height(), 32);
+	tiles->resample(level, scale, area, &image, wait ? QCTTiles::MakeTiles : QCTTiles::FindTiles, &missing);
+	painter->drawImage(area.x(), area.y(), image);
+
+	for (QValueList<QRect>::Iterator it = missing.begin(); it != missing.end(); ++it)
+		painter->fillRect(fromLevel(*it) & area, QBrush(PLACEHOLDER_COLOUR));
+	return missing.isEmpty();
+}
+
+
+/*
+ * Return the pixmap of a tile, converting it from the 8-bit tile if it's
+ * been made, otherwise 0.  The conversion through the colour table is only
+ * done once rather than every time the tile is painted.
+ */
+QPixmap *
+QCTImage::displayTile(int index)
+{
+	if (pixmaps[index])
+		return pixmaps[index];
+	QImage *tile = tiles->find(level, index);
+	if (tile == 0)
+		return 0;
+	QImage rgb(tile->width(), tile->height(), 32);
+	tiles->expandTile(tile, &rgb);
+	pixmaps.insert(index, new QPixmap(rgb));
+	npixmaps++;
+	return pixmaps[index];
+}
+
+
+/*
+ * Forget the pixmaps which are well away from the view.
+ */
+void
+QCTImage::trimDisplayTiles()
+{
+	QRect keep(contentsX(), contentsY(), visibleWidth(), visibleHeight());
+	keep.addCoords(-DISPLAY_TILES_MARGIN * QCTTILES_TILE_SIZE, -DISPLAY_TILES_MARGIN * QCTTILES_TILE_SIZE,
+		DISPLAY_TILES_MARGIN * QCTTILES_TILE_SIZE, DISPLAY_TILES_MARGIN * QCTTILES_TILE_SIZE);
+	for (int index=0; index<(int)pixmaps.size(); index++)
+	{
+		if (pixmaps[index] && !tiles->tileRect(level, index).intersects(keep))
+		{
+			pixmaps.remove(index);
+			npixmaps--;
+		}
+	}
+}
+
+
+/*
+ * The pixmaps must be made again when the zoom level (or the colours) change.
+ */
+void
+QCTImage::clearDisplayTiles()
+{
+	pixmaps.clear();
+	npixmaps = 0;
+	if (tiles)
+		pixmaps.resize(tilesx * tilesy);
+}
+
+
+/*
+ * Paint the portion of the image onto a pixmap at the zoom shown
+ * so all the tiles needed are decoded first.
  */
 void
 QCTImage::render(QPainter *painter, int cx, int cy, int cw, int ch)
 {
-	if (image.isNull())
+	if (tiles == 0)
 	{
 		//painter->eraseRect(area);
 		return;
@@ -247,28 +848,120 @@ QCTImage::render(QPainter *painter, int cx, int cy, int cw, int ch)
 
 	// Plot the visible part of the image
 	QRect area(cx, cy, cw, ch);
-	painter->drawImage(area.topLeft(), image, area);
+	renderChart(painter, area, true);
+	renderOverlays(painter, area, false);
+}
+
+
+/*
+ * Print the section of the chart (in contents coordinates) onto the view
+ * (in the printer's coordinates) at the printer's resolution, rather than
+ * scaling up the pixels of the zoom being shown.  The chart is resampled
+ * from the level of the pyramid at least as detailed as the printer, a
+ * band of rows at a time, each drawn on the printer before the next is
+ * started.  The tiles not already made are decoded for the band without
+ * being kept, so a large section doesn't fill the memory with tiles.
+ * The overlays are then drawn as vectors over the whole section.
+ */
+void
+QCTImage::printSection(QPainter *painter, const QRect &section, const QRect &view)
+{
+	int lev, yy;
+
+	if (tiles == 0 || section.isEmpty() || view.isEmpty())
+		return;
+
+	// Pixels of the full size chart for each printer pixel, and where
+	// the section is in the chart reduced by that much
+	double printzoom = section.width() * zoom / view.width();
+	for (lev=0; lev<QCTTILES_LEVELS-1 && (2 << lev) <= printzoom * 1.001; lev++)
+		;
+	double printscale = (1 << lev) / printzoom;
+	int left = NINT(section.x() * zoom / printzoom), top = NINT(section.y() * zoom / printzoom);
+	int rows = QMAX(1, PRINT_BAND_BYTES / (view.width() * 4));
+	debugf(1, "print %d x %d at zoom %f from level %d in bands of %d rows\n",
+		view.width(), view.height(), printzoom, lev, rows);
+
+	QImage band;
+	for (yy=0; yy<view.height(); yy+=rows)
+	{
+		int height = QMIN(rows, view.height() - yy);
+		if (band.height() != height)
+			band.create(view.width(), height, 32);
+		TRACE("print band", yy, height);
+		tiles->resample(lev, printscale, QRect(left, top + yy, view.width(), height), &band, QCTTiles::DecodeTiles);
+		painter->drawImage(view.x(), view.y() + yy, band);
+	}
 
-	// Border and fill colour of arrows
 	painter->save();
-	painter->setPen(QPen(black, 1, SolidLine));   // ! use no thicker than 1
-	painter->setBrush(QBrush(red, SolidPattern));
+	painter->setViewport(view);   // device coordinate system (paper)
+	painter->setWindow(section);  // logical coordinate system (map pixels)
+	renderOverlays(painter, section, false);
+	painter->restore();
+}
 
-	// Get all the arrows to draw themselves
-	for (ArrowPlot *arrow = arrowList.first(); arrow; arrow = arrowList.next())
+
+/*
+ * Paint the arrows and tides which are inside the area, with the arrows
+ * drawn from sprites on the screen but as polygons when printing.
+ */
+void
+QCTImage::renderOverlays(QPainter *painter, const QRect &area, bool sprites)
+{
+	QPtrList<ArrowPlot> arrows;
+	QPtrList<TidePlot> tides;
+
+	arrowGrid.find(area, arrows);
+	tideGrid.find(area, tides);
+
+	// The field is under the diamonds' arrows, each field arrow is made
+	// as it's drawn as the sprites are shared anyway
+	if (fieldColumns > 0)
 	{
-		debugf(1, "ARROW %d %d %d %d ",arrow->rect().x(), arrow->rect().y(),
-			arrow->rect().width(), arrow->rect().height());
-		if (arrow->rect().intersects(area))
+		int margin = fieldMaxLength + ARROW_FIELD_STEM * 2 + 2;
+		int col0 = QMAX(0, (area.left() - margin - fieldLeft) / fieldSpacing);
+		int col1 = QMIN(fieldColumns-1, (area.right() + margin - fieldLeft) / fieldSpacing);
+		int row0 = QMAX(0, (area.top() - margin - fieldTop) / fieldSpacing);
+		int row1 = QMIN(fieldRows-1, (area.bottom() + margin - fieldTop) / fieldSpacing);
+		painter->save();
+		painter->setPen(QPen(black, 1, SolidLine));
+		painter->setBrush(QBrush(ARROW_FIELD_COLOUR, SolidPattern));
+		for (int row=row0; row<=row1; row++)
 		{
-			debugf(1, "plot\n");
-			arrow->plot(painter);
+			for (int col=col0; col<=col1; col++)
+			{
+				int cell = row * fieldColumns + col;
+				if (fieldLength[cell] == 0)
+					continue;
+				ArrowPlot arrow(fieldLeft + col * fieldSpacing + fieldSpacing/2, fieldTop + row * fieldSpacing + fieldSpacing/2,
+					fieldBearing[cell], fieldLength[cell], true);
+				arrow.plot(painter, sprites);
+			}
 		}
-		else
+		painter->restore();
+	}
+
+	// The trails are under the arrows too
+	if (!trailsEmpty)
+	{
+		if (trailsChanged)
 		{
-			debugf(1, "invisible\n");
+			trailPixmap.convertFromImage(trailImage);
+			trailsChanged = false;
 		}
+		QRect part = area.intersect(QRect(trailOrigin, QSize(trailImage.width(), trailImage.height())));
+		if (!part.isEmpty())
+			painter->drawPixmap(part.topLeft(), trailPixmap, QRect(part.topLeft() - trailOrigin, part.size()));
 	}
+
+	// Border and fill colour of arrows
+	painter->save();
+	painter->setPen(QPen(black, 1, SolidLine));   // ! use no thicker than 1
+	painter->setBrush(QBrush(red, SolidPattern));
+
+	// Get all the arrows to draw themselves
+	for (ArrowPlot *arrow = arrows.first(); arrow; arrow = arrows.next())
+		arrow->plot(painter, sprites);
 	painter->restore();
 
 	// Border and fill colour of tides
@@ -277,28 +970,84 @@ QCTImage::render(QPainter *painter, int cx, int cy, int cw, int ch)
 	painter->setBrush(QBrush(green, SolidPattern));
 
 	// Get all the tide marks to draw themselves
-	for (TidePlot *tideplot = tideList.first(); tideplot; tideplot = tideList.next())
+	for (TidePlot *tideplot = tides.first(); tideplot; tideplot = tides.next())
+		tideplot->plot(painter);
+	painter->restore();
+}
+
+
+/*
+ * Copy the chart from the layer, first drawing the parts of it which
+ * are out of date.  When the view has scrolled the layer is moved to
+ * match and only the newly visible part needs drawing.  Placeholders
+ * count as up to date as the layer is invalidated when tiles arrive.
+ */
+void
+QCTImage::drawChartLayer(QPainter *painter, const QRect &area)
+{
+	QRect vis(contentsX(), contentsY(), visibleWidth(), visibleHeight());
+	uint ii;
+
+	if (chartLayer.width() != vis.width() || chartLayer.height() != vis.height())
 	{
-		debugf(1, "TIDEPLOT %d %d %d %d ", tideplot->rect().x(), tideplot->rect().y(),
-			tideplot->rect().width(), tideplot->rect().height());
-		if (tideplot->rect().intersects(area))
-		{
-			debugf(1, "plot\n");
-			tideplot->plot(painter);
-		}
-		else
-		{
-			debugf(1, "invisible\n");
-		}
+		chartLayer.resize(vis.width(), vis.height());
+		chartLayerValid = QRegion();
 	}
-	painter->restore();
+	else if (chartLayerRect.topLeft() != vis.topLeft() && !chartLayerValid.isEmpty())
+	{
+		QPoint delta = chartLayerRect.topLeft() - vis.topLeft();
+		bitBlt(&chartLayer, delta.x(), delta.y(), &chartLayer, 0, 0, vis.width(), vis.height());
+	}
+	chartLayerRect = vis;
+	chartLayerValid = chartLayerValid.intersect(QRegion(vis));
+
+	QRect wanted = area.intersect(vis);
+	QRegion missing = QRegion(wanted).subtract(chartLayerValid);
+	if (!missing.isEmpty())
+	{
+		QMemArray<QRect> rects = missing.rects();
+		QPainter layerPainter(&chartLayer);
+		layerPainter.translate(-vis.x(), -vis.y());
+		for (ii=0; ii<rects.size(); ii++)
+			renderChart(&layerPainter, rects[ii], false);
+		layerPainter.end();
+		chartLayerValid = chartLayerValid.unite(missing);
+	}
+	if (!wanted.isEmpty())
+		painter->drawPixmap(wanted.topLeft(), chartLayer, QRect(wanted.topLeft() - vis.topLeft(), wanted.size()));
+
+	// Anything outside the view isn't kept in the layer
+	QMemArray<QRect> outside = QRegion(area).subtract(QRegion(wanted)).rects();
+	for (ii=0; ii<outside.size(); ii++)
+		renderChart(painter, outside[ii], false);
+}
+
+
+/*
+ * Part of the chart has changed, in contents coordinates.
+ */
+void
+QCTImage::invalidateChartLayer(const QRect &rect)
+{
+	chartLayerValid = chartLayerValid.subtract(QRegion(rect));
 }
 
 
+/*
+ * Paint the portion of the image onto the screen without waiting for
+ * tiles to be decoded.
+ */
 void
 QCTImage::drawContents(QPainter *painter, int cx, int cy, int cw, int ch)
 {
-	render(painter, cx, cy, cw, ch);
+	if (tiles == 0)
+		return;
+
+	QRect area(cx, cy, cw, ch);
+	TRACE("drawContents", cw, ch);
+	drawChartLayer(painter, area);
+	renderOverlays(painter, area, true);
+	TRACE("drawContents done", cw, ch);
 }
 
 
@@ -308,15 +1057,15 @@ QCTImage::drawContents(QPainter *painter, int cx, int cy, int cw, int ch)
 void
 QCTImage::contentsContextMenuEvent(QContextMenuEvent *event)
 {
+	if (qct == 0)
+		return;
 	int mx = event->pos().x();
 	int my = event->pos().y();
-	int imagewidth = image.width();
-	int imageheight = image.height();
 	if (mx < 0 || my < 0 || mx > imagewidth || my > imageheight)
 		return;
 
 	double lat, lon;
-	qct->xy_to_latlon(mx,my, &lat, &lon);
+	xyToLatLon(mx,my, &lat, &lon);
 	debugf(1,"QCTImage::contentsContextMenuEvent %d, %d = %f, %f\n", mx, my, lat, lon);
 
 	emit contextMenu(lat, lon);
@@ -337,19 +1086,17 @@ void
 QCTImage::contentsMouseMoveEvent(QMouseEvent *event)
 {
 	// Do nothing if no image has been loaded
-	if (image.isNull() || qct == 0)
+	if (tiles == 0 || qct == 0)
 		return;
 
 	// Do nothing if point is not within image
 	int mx = event->pos().x();
 	int my = event->pos().y();
-	int imagewidth = image.width();
-	int imageheight = image.height();
 	if (mx < 0 || my < 0 || mx > imagewidth || my > imageheight)
 		return;
 
 	double lat, lon;
-	qct->xy_to_latlon(mx,my, &lat, &lon);
+	xyToLatLon(mx,my, &lat, &lon);
 	//debugf(1,"QCTImage::contentsMouseMoveEvent %d, %d = %f, %f (TL %d %d)\n", mx, my, lat, lon, contentsX(), contentsY());
 
 	// Could set val as colour of pixel at mx,my
@@ -432,7 +1179,7 @@ QCTImage::keepFloating()
 
 	// Come back later and move further
 	if (floating)
-		QTimer::singleShot(100, this, SLOT(keepFloating()));
+		QTimer::singleShot(FLOAT_STEP_MSEC, this, SLOT(keepFloating()));
 }
 
 
@@ -451,6 +1198,47 @@ QCTImage::contentsWheelEvent(QWheelEvent *event)
 }
 
 
+/* --------------------------------------------------------------------------
+ * Plotting a new set of overlays changes the area of every old one and
+ * every new one, which would otherwise be hundreds of separate updates.
+ */
+void
+QCTImage::beginPlot()
+{
+	plotting++;
+}
+
+
+void
+QCTImage::commitPlot()
+{
+	if (plotting == 0 || --plotting > 0)
+		return;
+	if (plotRegion.isEmpty())
+		return;
+	// The region is in contents coordinates
+	QRegion region = plotRegion;
+	plotRegion = QRegion();
+	region.translate(-contentsX(), -contentsY());
+	region = region.intersect(QRegion(0, 0, visibleWidth(), visibleHeight()));
+	if (!region.isEmpty())
+		viewport()->repaint(region, false);
+}
+
+
+/*
+ * The area of an overlay has changed.
+ */
+void
+QCTImage::updateOverlay(const QRect &rect)
+{
+	if (plotting)
+		plotRegion = plotRegion.unite(QRegion(rect));
+	else
+		updateContents(rect);
+}
+
+
 /* --------------------------------------------------------------------------
  * Delete all info about plotted items ready to have new items plotted
  * (so doesn't bother to update the screen)
@@ -459,17 +1247,15 @@ void
 QCTImage::unplotArrows()
 {
 	// Only erase the visible bits
-	QRect vis(contentsX(), contentsY(), contentsWidth(), contentsHeight());
+	QRect vis(contentsX(), contentsY(), visibleWidth(), visibleHeight());
+	QPtrList<ArrowPlot> arrows;
 
 	// Erase all the old arrows before their shape changes to new bbox
-	for (ArrowPlot *arrow = arrowList.first(); arrow; arrow = arrowList.next())
-	{
-		QRect arrect = arrow->rect();
-		if (arrect.intersects(vis))
-			updateContents(arrect);
-	}
+	arrowGrid.find(vis, arrows);
+	for (ArrowPlot *arrow = arrows.first(); arrow; arrow = arrows.next())
+		updateOverlay(arrow->rect());
 	// Empty the list
-	arrowList.clear();
+	arrowGrid.clear();
 }
 
 
@@ -477,17 +1263,127 @@ void
 QCTImage::unplotTides()
 {
 	// Only erase the visible bits
-	QRect vis(contentsX(), contentsY(), contentsWidth(), contentsHeight());
+	QRect vis(contentsX(), contentsY(), visibleWidth(), visibleHeight());
+	QPtrList<TidePlot> tides;
 
 	// Erase all the old arrows before their shape changes to new bbox
-	for (TidePlot *tideplot = tideList.first(); tideplot; tideplot = tideList.next())
+	tideGrid.find(vis, tides);
+	for (TidePlot *tideplot = tides.first(); tideplot; tideplot = tides.next())
+		updateOverlay(tideplot->rect());
+	// Empty the list
+	tideGrid.clear();
+}
+
+
+/*
+ * The field covers most of the view so all of it is repainted.
+ */
+void
+QCTImage::unplotField()
+{
+	if (fieldColumns > 0)
+		updateOverlay(QRect(contentsX(), contentsY(), visibleWidth(), visibleHeight()));
+	fieldColumns = fieldRows = 0;
+	fieldMaxLength = 0;
+}
+
+
+void
+QCTImage::plotField(int left, int top, int spacing, int columns, int rows)
+{
+	unplotField();
+	if (!qct || spacing <= 0 || columns <= 0 || rows <= 0)
+		return;
+	fieldLeft = left;
+	fieldTop = top;
+	fieldSpacing = spacing;
+	fieldColumns = columns;
+	fieldRows = rows;
+	fieldBearing.resize(columns * rows);
+	fieldLength.resize(columns * rows);
+	fieldLength.fill(0);
+	updateOverlay(QRect(contentsX(), contentsY(), visibleWidth(), visibleHeight()));
+}
+
+
+void
+QCTImage::plotFieldArrow(int cell, float bearing, float length)
+{
+	if (cell < 0 || cell >= fieldColumns * fieldRows)
+		return;
+	fieldBearing[cell] = NINT(bearing);
+	fieldLength[cell] = NINT(length);
+	fieldMaxLength = QMAX(fieldMaxLength, (int)fieldLength[cell]);
+}
+
+
+void
+QCTImage::unplotTrails()
+{
+	if (!trailsEmpty)
+		updateOverlay(QRect(trailOrigin, QSize(trailImage.width(), trailImage.height())));
+	trailImage.reset();
+	trailsEmpty = true;
+}
+
+
+/*
+ * The trails are only kept for the visible area, so they start again if
+ * the view moves.  Fading takes the alpha of every pixel down; the lines
+ * are drawn opaque a pixel at a time as they're only a pixel wide.
+ */
+void
+QCTImage::plotTrails(int n, const float *x0, const float *y0, const float *x1, const float *y1, int fade)
+{
+	QRect vis(contentsX(), contentsY(), visibleWidth(), visibleHeight());
+	int width = vis.width(), height = vis.height();
+	int ii, xx, yy, ss;
+
+	if (!qct || vis.isEmpty())
+		return;
+	TRACE("plotTrails", n, fade);
+	if (trailImage.isNull() || trailImage.width() != width || trailImage.height() != height || trailOrigin != vis.topLeft())
 	{
-		QRect tidrect = tideplot->rect();
-		if (tidrect.intersects(vis))
-			updateContents(tidrect);
+		unplotTrails();
+		trailImage.create(width, height, 32);
+		trailImage.setAlphaBuffer(true);
+		trailImage.fill(0);
+		trailOrigin = vis.topLeft();
 	}
-	// Empty the list
-	tideList.clear();
+	else
+	{
+		for (yy=0; yy<height; yy++)
+		{
+			QRgb *p = (QRgb*)trailImage.scanLine(yy);
+			for (xx=0; xx<width; xx++)
+			{
+				if (p[xx] == 0)
+					continue;
+				int alpha = (qAlpha(p[xx]) * fade) >> 8;
+				p[xx] = alpha ? (p[xx] & RGB_MASK) | (alpha << 24) : 0;
+			}
+		}
+	}
+
+	QRgb colour = TRAIL_COLOUR | 0xff000000;
+	for (ii=0; ii<n; ii++)
+	{
+		float ax = x0[ii] - trailOrigin.x(), ay = y0[ii] - trailOrigin.y();
+		float dx = x1[ii] - x0[ii], dy = y1[ii] - y0[ii];
+		int steps = (int)QMAX(fabs(dx), fabs(dy)) + 1;
+		if (steps > TRAIL_MAX_LENGTH)
+			continue;
+		for (ss=0; ss<steps; ss++)
+		{
+			xx = (int)(ax + dx * ss / steps);
+			yy = (int)(ay + dy * ss / steps);
+			if (xx >= 0 && yy >= 0 && xx < width && yy < height)
+				((QRgb*)trailImage.scanLine(yy))[xx] = colour;
+		}
+	}
+	trailsEmpty = false;
+	trailsChanged = true;
+	updateOverlay(vis);
 }
 
 
@@ -501,13 +1397,13 @@ QCTImage::plotArrow(float lat, float lon, float bearing, float length)
 	if (!qct)
 		return;
 	int x, y;
-	qct->latlon_to_xy(lat, lon, &x, &y);
+	latLonToXY(lat, lon, &x, &y);
 	ArrowPlot *arrow = new ArrowPlot(x, y, bearing, length);
-	arrowList.append(arrow);
+	arrowGrid.append(arrow);
 
-	debugf(1,"plot at %f %f = %d %d bearing %f length %f\n",lat,lon, x,y, bearing,length);
+	TRACE("plotArrow", bearing, length);
 
-	updateContents(arrow->rect());
+	updateOverlay(arrow->rect());
 }
 
 
@@ -517,13 +1413,40 @@ QCTImage::plotTide(float lat, float lon, float min, float max, float currently)
 	if (!qct)
 		return;
 	int x, y;
-	qct->latlon_to_xy(lat, lon, &x, &y);
+	latLonToXY(lat, lon, &x, &y);
 	TidePlot *tideplot = new TidePlot(x, y, min, max, currently);
-	tideList.append(tideplot);
+	tideGrid.append(tideplot);
+
+	TRACE("plotTide", x, y);
+
+	updateOverlay(tideplot->rect());
+}
 
-	debugf(1,"plot at %f %f = %d %d min %f max %f currently %f\n",lat,lon, x,y, min,max,currently);
 
-	updateContents(tideplot->rect());
+/* --------------------------------------------------------------------------
+ * Convert between latitude, longitude and pixel coordinates at this zoom.
+ * The QCT georeferencing is always for the full size image.
+ */
+void
+QCTImage::latLonToXY(double lat, double lon, int *x, int *y)
+{
+	qct->latlon_to_xy(lat, lon, x, y);
+	*x = NINT(*x / zoom);
+	*y = NINT(*y / zoom);
+}
+
+
+void
+QCTImage::xyToLatLon(int x, int y, double *lat, double *lon)
+{
+	qct->xy_to_latlon(NINT(x * zoom), NINT(y * zoom), lat, lon);
+}
+
+
+float
+QCTImage::getDegreesPerPixel()
+{
+	return qct ? qct->getDegreesPerPixel() * zoom : 0;
 }
 
 
@@ -537,8 +1460,8 @@ QCTImage::scrollToLatLon(double lat, double lon)
 		return false;
 
 	int x, y;
-	qct->latlon_to_xy(lat, lon, &x, &y);
-	if (x<0 || y<0 || x>image.width()-1 || y>image.height()-1)
+	latLonToXY(lat, lon, &x, &y);
+	if (x<0 || y<0 || x>imagewidth-1 || y>imageheight-1)
 		return false;
 	debugf(1,"scrollToLatLon %f %f -> %d %d\n", lat,lon, x,y);
 	center(x, y);
@@ -576,7 +1499,7 @@ QCTImage::latLonOfCenter(double *lat, double *lon)
 
 	x = contentsX() + visibleWidth() / 2;
 	y = contentsY() + visibleHeight() / 2;
-	qct->xy_to_latlon(x, y, lat, lon);
+	xyToLatLon(x, y, lat, lon);
 	debugf(1,"latLonOfCenter %d %d -> %f %f\n",x,y, *lat,*lon);
 	return true;
 }
@@ -1,4 +1,20 @@
 /* > qctimage.h
+ * 1.16 arb Mon Oct 19 23:59:53 BST 2026 - stream field over part of the chart
+ * 1.15 arb Mon Oct 19 23:59:14 BST 2026 - banded printing
+ * 1.14 arb Mon Oct 19 23:58:21 BST 2026 - overlay geometry
+ * 1.13 arb Mon Oct 19 23:57:48 BST 2026 - particle trails
+ * 1.12 arb Mon Oct 19 23:56:12 BST 2026 - stream field
+ * 1.11 arb Mon Oct 19 23:52:06 BST 2026 - chart layer
+ * 1.10 arb Mon Oct 19 23:41:20 BST 2026 - coalesced overlay updates
+ * 1.09 arb Mon Oct 19 23:10:52 BST 2026 - arrow sprites
+ * 1.08 arb Mon Oct 19 22:03:39 BST 2026 - grid of overlays
+ * 1.07 arb Mon Oct 19 20:41:07 BST 2026 - shared tile cache
+ * 1.06 arb Mon Oct 19 19:55:18 BST 2026 - fractional zoom
+ * 1.05 arb Mon Oct 19 18:30:05 BST 2026 - display tiles
+ * 1.04 arb Mon Oct 19 17:48:26 BST 2026 - disk cache
+ * 1.03 arb Mon Oct 19 17:05:12 BST 2026 - background decoding
+ * 1.02 arb Mon Oct 19 16:20:31 BST 2026 - pyramid
+ * 1.01 arb Mon Oct 19 15:02:44 BST 2026 - tiles
  * 1.00 arb
  */
 
@@ -10,24 +26,47 @@
 #include <qpixmap.h>
 #include <qimage.h>
 #include <qpointarray.h>
+#include <qregion.h>
+#include <qptrvector.h>
+#include <qptrlist.h>
+#include <qvaluelist.h>
+#include <qvaluevector.h>
+#include <qmemarray.h>
+#include <qmap.h>
+#include <qtl.h>          // for qHeapSort
+#include "qcttiles.h"
 
 class QPainter;
+class QTimer;
 class QCT;
 
 
 class ArrowPlot
 {
 public:
-	ArrowPlot(int x, int y, float bearing, float length);
+	// Field arrows are the small ones showing the stream between diamonds
+	ArrowPlot(int x, int y, float bearing, float length, bool field = false);
 	~ArrowPlot();
-	void plot(QPainter *);
+	// Draw from the cached sprite, or as a polygon (eg. when printing)
+	void plot(QPainter *, bool sprite = true);
 	QRect rect() const;
+	// The outline of an arrow length long from x,y, with stems sw wide
+	// either side, for rendering without a painter
+	static QPointArray outline(int x, int y, int bearing, int length, int sw);
+	static int stemWidth(bool field);
+private:
+	QPointArray shape(int scale, int x, int y) const;
+	void findSprite();
 private:
 	// constant data could be made static to the class
 	int stemwidth;
 	bool filled;
-	// the array of transformed points and a quick-access bounding box
-	QPointArray points;
+	bool field;
+	// position, and the bearing and length rounded for the sprite
+	int x, y, bearing, length;
+	// the sprite (shared with other arrows) and a quick-access bounding box
+	QPixmap sprite;
+	QPoint spriteOffset;
 	QRect boundingBox;
 };
 
@@ -39,6 +78,8 @@ public:
 	~TidePlot();
 	void plot(QPainter *);
 	QRect rect() const;
+	// The polyline drawn, for rendering without a painter
+	const QPointArray &getPoints() const { return points; }
 private:
 	// constant data could be made static to the class
 	int dimension;
@@ -48,6 +89,105 @@ private:
 };
 
 
+#define QCTIMAGE_OVERLAY_CELL 256  // size of the grid cells in pixels
+
+
+/*
+ * The overlays (ArrowPlot or TidePlot) plotted on the image, kept in a
+ * uniform grid of cells listing the overlays whose bounding box touches
+ * each cell, so painting an area only has to look at the overlays near
+ * it rather than all of them.
+ */
+template<class T> class OverlayGrid
+{
+public:
+	OverlayGrid() : count(0), stamp(0) { items.setAutoDelete(true); }
+	void clear();
+	void append(T *item);
+	bool isEmpty() const { return count == 0; }
+	// Fill found with the overlays which intersect area, in the order added
+	void find(const QRect &area, QPtrList<T> &found);
+private:
+	int cellKey(int col, int row) const { return (row << 16) | col; }
+	int cellOf(int coord) const { return QMAX(0, QMIN(32767, coord / QCTIMAGE_OVERLAY_CELL)); }
+private:
+	QPtrVector<T> items;               // owns the overlays
+	int count;
+	QMap<int, QValueList<int> > cells; // indexes of the items in each cell
+	QMemArray<unsigned int> seen;      // stamp of the last find to see each
+	unsigned int stamp;
+};
+
+
+template<class T> void
+OverlayGrid<T>::clear()
+{
+	items.clear();
+	count = 0;
+	cells.clear();
+	seen.resize(0);
+}
+
+
+template<class T> void
+OverlayGrid<T>::append(T *item)
+{
+	QRect rect = item->rect();
+	if (count == (int)items.size())
+	{
+		items.resize(QMAX(16, count * 2));
+		seen.resize(items.size());
+		seen.fill(0);
+		stamp = 0;
+	}
+	items.insert(count, item);
+	for (int row = cellOf(rect.top()); row <= cellOf(rect.bottom()); row++)
+		for (int col = cellOf(rect.left()); col <= cellOf(rect.right()); col++)
+			cells[cellKey(col, row)].append(count);
+	count++;
+}
+
+
+/*
+ * An overlay can be in several cells, the stamp stops it being found twice.
+ */
+template<class T> void
+OverlayGrid<T>::find(const QRect &area, QPtrList<T> &found)
+{
+	QValueVector<int> indexes;
+
+	found.clear();
+	if (count == 0 || area.isEmpty())
+		return;
+	if (++stamp == 0)
+	{
+		seen.fill(0);
+		stamp = 1;
+	}
+	for (int row = cellOf(area.top()); row <= cellOf(area.bottom()); row++)
+	{
+		for (int col = cellOf(area.left()); col <= cellOf(area.right()); col++)
+		{
+			typename QMap<int, QValueList<int> >::Iterator cell = cells.find(cellKey(col, row));
+			if (cell == cells.end())
+				continue;
+			QValueList<int> &list = cell.data();
+			for (QValueList<int>::Iterator it = list.begin(); it != list.end(); ++it)
+			{
+				if (seen[*it] == stamp)
+					continue;
+				seen[*it] = stamp;
+				if (items[*it]->rect().intersects(area))
+					indexes.push_back(*it);
+			}
+		}
+	}
+	qHeapSort(indexes);
+	for (QValueVector<int>::Iterator ii = indexes.begin(); ii != indexes.end(); ++ii)
+		found.append(items[*ii]);
+}
+
+
 class QCTImage : public QScrollView
 {
 	Q_OBJECT
@@ -57,19 +197,46 @@ public:
 public:
 	// Load and unload a QCT
 	void unload();
-	bool load(QString filename, int scalefactor = 1);
+	bool load(QString filename, double scalefactor = 1);
 	// Save QCT as a PNG
 	bool save(QString filename, const char *fmt);
 	// The actual QCT object so it can be queried for name etc.
+	// but note its coordinates are always at full size
 	QCT *getQct() { return qct; }
-	// Plotting (only to be called when printing)
+	// Zoom out by any factor from 0.5 (double size) to 8 (eighth size)
+	// either keeping the middle of the view still or the given point
+	void setZoom(double zoom);
+	void zoomAt(double zoom, int viewportx, int viewporty);
+	double getZoom() const { return zoom; }
+	// Coordinate conversion at the displayed zoom level
+	float getDegreesPerPixel();
+	void latLonToXY(double lat, double lon, int *x, int *y);
+	void xyToLatLon(int x, int y, double *lat, double *lon);
+	// Plotting at the zoom shown (eg. when saving the screen)
 	void render(QPainter *painter, int cx, int cy, int cw, int ch);
+	// Printing a section of the contents onto the view of the printer
+	// at the printer's resolution
+	void printSection(QPainter *painter, const QRect &section, const QRect &view);
 	// Plotting arrows onto the image
 	void unplotArrows();
 	void plotArrow(float lat, float lon, float bearing, float length);
 	// Plotting arrows onto the image
 	void unplotTides();
 	void plotTide(float lat, float lon, float min, float max, float currently);
+	// Plotting the stream field as a grid of columns x rows arrows spacing
+	// pixels apart from left,top, each cell (column + row * columns) having
+	// one or none
+	void unplotField();
+	void plotField(int left, int top, int spacing, int columns, int rows);
+	void plotFieldArrow(int cell, float bearing, float length);
+	// Plotting particle trails, the lines from x0,y0 to x1,y1 are added to
+	// those already drawn after they have faded to fade/256
+	void unplotTrails();
+	void plotTrails(int n, const float *x0, const float *y0, const float *x1, const float *y1, int fade);
+	// Collect the changes made by unplotting and plotting between these
+	// and redraw them all in one repaint (can be nested)
+	void beginPlot();
+	void commitPlot();
 	// Scrolling
 	bool scrollToLatLon(double lat, double lon);
 	bool latLonOfCenter(double *lat, double *lon);
@@ -85,21 +252,60 @@ protected:
 	void contentsMouseReleaseEvent(QMouseEvent *event);
 	void contentsWheelEvent(QWheelEvent *event);
 	void showEvent(QShowEvent*);
+	void customEvent(QCustomEvent *event);
 private slots:
 	void keepFloating();
+	void viewMoving(int x, int y);
+	void prefetchTiles();
+private:
+	void addJobs(QValueList<QCTTileJob> &jobs, int level, const QRect &area, const QPoint &mid);
+	QRect toLevel(const QRect &area) const;
+	QRect fromLevel(const QRect &rect) const;
+	bool resampleArea(QPainter *painter, const QRect &area, bool wait);
+	QPixmap *displayTile(int index);
+	void trimDisplayTiles();
+	void clearDisplayTiles();
+	void renderChart(QPainter *painter, const QRect &area, bool wait);
+	void drawChartLayer(QPainter *painter, const QRect &area);
+	void invalidateChartLayer(const QRect &rect);
+	void renderOverlays(QPainter *painter, const QRect &area, bool sprites);
+	void updateOverlay(const QRect &rect);
 private:
 	// To support panning:
 	bool dragging, floating;
 	QPoint dragStartMousePos, dragStartContentsPos, dragDelta;
-	QTime lastMoveTime;
-	// The image itself
-	QImage image;
+	QPoint motion;                 // expected movement of the view
+	QTime lastMoveTime, lastViewMoveTime;
+	// The image itself, decoded a tile at a time ahead of being visible
 	QCT *qct;
+	double zoom;                   // reduction factor, 1 is full size
+	int level;                     // level of the pyramid for this zoom
+	double scale;                  // size of the view relative to the level
+	int imagewidth, imageheight;   // at this zoom
+	int tilesx, tilesy;            // number of display tiles at this zoom
+	QCTTiles *tiles;               // the pyramid of tiles, from QCTTileCache
+	QCTTileDecoder *decoder;       // makes tiles in the background
+	QPtrVector<QPixmap> pixmaps;   // tiles at this level in the display format
+	int npixmaps;
+	QTimer *prefetchTimer;
+	// The chart under the visible area, so the overlays can be redrawn
+	// without drawing the chart again
+	QPixmap chartLayer;
+	QRect chartLayerRect;          // where it is in contents coordinates
+	QRegion chartLayerValid;       // the parts which are up to date
 	// Initialisation only
 	int startx, starty;
-	// List of arrows to be overlaid
-	QPtrList<ArrowPlot> arrowList;
-	QPtrList<TidePlot>  tideList;
+	// Arrows and tides to be overlaid
+	OverlayGrid<ArrowPlot> arrowGrid;
+	OverlayGrid<TidePlot>  tideGrid;
+	int fieldLeft, fieldTop, fieldSpacing, fieldColumns, fieldRows, fieldMaxLength;
+	QMemArray<short> fieldBearing, fieldLength;  // length 0 for none
+	QImage trailImage;             // trails over the visible area
+	QPoint trailOrigin;            // in contents coordinates
+	QPixmap trailPixmap;           // trailImage when last painted
+	bool trailsEmpty, trailsChanged;
+	int plotting;                  // depth of beginPlot
+	QRegion plotRegion;            // to be repainted by commitPlot
 };
 
 
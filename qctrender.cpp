@@ -0,0 +1,346 @@
+/* > qctrender.cpp
+ * 1.02 arb Mon Oct 19 23:59:39 BST 2026 - polygons and lines both through the middles of pixels
+ * 1.01 arb Mon Oct 19 23:59:14 BST 2026 - how the tiles are fetched
+ * 1.00 arb Mon Oct 19 23:58:21 BST 2026
+ */
+
+static const char SCCSid[] = "@(#)qctrender.cpp 1.02 (C) 2026 arb Offscreen chart rendering";
+
+/*
+ * QCTRenderer draws the chart and overlays into QImages rather than
+ * through a QPainter, as in Qt3 a QPainter can only draw on a QPixmap
+ * (which needs a connection to the display) and not on a QImage.
+ * The arrows are filled by scanning their outline (from ArrowPlot, so
+ * they are the same shape as on the screen) ARROW_SUPERSAMPLE times
+ * over in each direction, using the fraction of samples inside a pixel
+ * as its alpha, and their border and the tide gauges are drawn as lines
+ * whose alpha falls off with the distance from the line.  Both take the
+ * points to be at the middle of a pixel, as QPainter does, so the border
+ * lies on the edge of the fill.
+ * Each frame is drawn and saved by one thread so the frames need no
+ * locking, only taking the next frame from the list does.
+ */
+
+/*
+ * Configuration:
+ * Define RENDER_THREADS as the number of threads, or 0 to use one for
+ * each processor.
+ * The colours and sizes are those used on the screen (see qctimage.cpp).
+ */
+#define RENDER_THREADS 0
+#define MIN_ZOOM 0.5
+#define ARROW_SUPERSAMPLE   4
+#define ARROW_FILL_COLOUR   qRgb(0xff, 0, 0)
+#define ARROW_BORDER_COLOUR qRgb(0, 0, 0)
+#define ARROW_BORDER_WIDTH  1.0
+#define TIDE_COLOUR         qRgb(0, 0, 0)
+#define TIDE_WIDTH          2.0
+
+
+#include <math.h>
+#include <string.h>
+#include <qthread.h>
+#include <qptrlist.h>
+#include <qpointarray.h>
+
+#include "satlib/dundee.h"
+#include "trace.h"
+#include "qcttiles.h"
+#include "qctimage.h"     // for ArrowPlot and TidePlot
+#include "qctrender.h"
+
+#ifdef Q_OS_UNIX
+#include <unistd.h>
+#endif
+
+
+/* ---------------------------------------------------------------------------
+ * Drawing into a 32-bit image.  Alpha is in 1/256ths.
+ */
+static inline void
+blend(QRgb *pixel, QRgb colour, int alpha)
+{
+	QRgb old = *pixel;
+	unsigned int rb = (((colour & 0xff00ff) * alpha + (old & 0xff00ff) * (256-alpha)) >> 8) & 0xff00ff;
+	unsigned int g = (((colour & 0xff00) * alpha + (old & 0xff00) * (256-alpha)) >> 8) & 0xff00;
+	*pixel = 0xff000000 | rb | g;
+}
+
+
+// Round down, even for negative numbers
+static inline int
+floorDiv(int a, int b)
+{
+	return (a >= 0) ? a / b : -((-a + b - 1) / b);
+}
+
+
+/*
+ * Fill a polygon given in coordinates ss times those of the image,
+ * counting for each pixel how many of its ss x ss samples are inside
+ * (by the odd-even rule, as QPainter::drawPolygon).  A point ss*x,ss*y
+ * is at the middle of pixel x,y, the same as for drawLine, so the samples
+ * are offset by half a pixel from the polygon's coordinates.
+ */
+static void
+fillPolygon(QImage *image, const QPointArray &poly, int ss, QRgb colour)
+{
+	QRect bb = poly.boundingRect();
+	double half = ss / 2.0;
+	int left = QMAX(0, floorDiv(bb.left(), ss)), right = QMIN(image->width()-1, floorDiv(bb.right(), ss) + 1);
+	int top = QMAX(0, floorDiv(bb.top(), ss)), bottom = QMIN(image->height()-1, floorDiv(bb.bottom(), ss) + 1);
+	int npoints = poly.size();
+	int ii, jj, nx, sx, sy, xx, yy;
+
+	if (left > right || top > bottom || npoints < 3)
+		return;
+	QMemArray<int> cover(right - left + 1);
+	QMemArray<double> crossing(npoints);
+	for (yy=top; yy<=bottom; yy++)
+	{
+		cover.fill(0);
+		for (sy=0; sy<ss; sy++)
+		{
+			// Where the edges cross the middle of this row of samples
+			double fy = yy * ss + sy + 0.5 - half;
+			nx = 0;
+			for (ii=0; ii<npoints; ii++)
+			{
+				QPoint p0 = poly[ii], p1 = poly[(ii+1) % npoints];
+				if ((p0.y() <= fy) != (p1.y() <= fy))
+				{
+					double x = p0.x() + (fy - p0.y()) * (p1.x() - p0.x()) / (p1.y() - p0.y());
+					for (jj=nx++; jj>0 && crossing[jj-1] > x; jj--)
+						crossing[jj] = crossing[jj-1];
+					crossing[jj] = x;
+				}
+			}
+			// Count the samples whose middles are between pairs of crossings
+			for (ii=0; ii+1<nx; ii+=2)
+			{
+				int s0 = QMAX(left * ss, (int)ceil(crossing[ii] + half - 0.5));
+				int s1 = QMIN(right * ss + ss-1, (int)ceil(crossing[ii+1] + half - 0.5) - 1);
+				for (sx=s0; sx<=s1; sx++)
+					cover[sx / ss - left]++;
+			}
+		}
+		QRgb *row = (QRgb*)image->scanLine(yy);
+		for (xx=left; xx<=right; xx++)
+			if (cover[xx - left])
+				blend(&row[xx], colour, cover[xx - left] * 256 / (ss * ss));
+	}
+}
+
+
+/*
+ * Draw a line between the middles of two pixels, each pixel's alpha
+ * being how far it is inside the edge of the line (up to one pixel).
+ */
+static void
+drawLine(QImage *image, const QPoint &from, const QPoint &to, double width, QRgb colour)
+{
+	double x0 = from.x() + 0.5, y0 = from.y() + 0.5;
+	double dx = to.x() - from.x(), dy = to.y() - from.y();
+	double len2 = dx*dx + dy*dy, half = width / 2;
+	int reach = (int)ceil(half) + 1;
+	int left = QMAX(0, QMIN(from.x(), to.x()) - reach), right = QMIN(image->width()-1, QMAX(from.x(), to.x()) + reach);
+	int top = QMAX(0, QMIN(from.y(), to.y()) - reach), bottom = QMIN(image->height()-1, QMAX(from.y(), to.y()) + reach);
+	int xx, yy;
+
+	for (yy=top; yy<=bottom; yy++)
+	{
+		QRgb *row = (QRgb*)image->scanLine(yy);
+		for (xx=left; xx<=right; xx++)
+		{
+			// Distance from the middle of the pixel to the nearest point on the line
+			double px = xx + 0.5 - x0, py = yy + 0.5 - y0;
+			double t = (len2 > 0) ? QMAX(0.0, QMIN(1.0, (px*dx + py*dy) / len2)) : 0;
+			double ex = px - t * dx, ey = py - t * dy;
+			double alpha = half + 0.5 - sqrt(ex*ex + ey*ey);
+			if (alpha > 0)
+				blend(&row[xx], colour, (int)(QMIN(1.0, alpha) * 256));
+		}
+	}
+}
+
+
+static void
+drawPolyline(QImage *image, const QPointArray &points, double width, QRgb colour)
+{
+	for (int ii=0; ii+1<(int)points.size(); ii++)
+		drawLine(image, points[ii], points[ii+1], width, colour);
+}
+
+
+/* ---------------------------------------------------------------------------
+ * Each worker renders the next frame from the list until there are none.
+ */
+class QCTRenderWorker : public QThread
+{
+public:
+	QCTRenderWorker(QCTRenderer *r) : renderer(r) {}
+protected:
+	void run();
+private:
+	QCTRenderer *renderer;
+};
+
+
+void
+QCTRenderWorker::run()
+{
+	const QCTRenderFrame *frame;
+
+	while ((frame = renderer->nextFrame()) != 0)
+		renderer->frameDone(renderer->renderFrame(*frame));
+}
+
+
+/* ---------------------------------------------------------------------------
+ * The zoom is a reduction factor and chooses the level of the pyramid
+ * as QCTImage::setZoom does.
+ */
+QCTRenderer::QCTRenderer(QCTTiles *t, double zoom, const QRect &a)
+{
+	tiles = t;
+	area = a;
+	next = written = 0;
+
+	zoom = QMAX(MIN_ZOOM, QMIN(1 << (QCTTILES_LEVELS-1), zoom));
+	for (level=0; level<QCTTILES_LEVELS-1 && (2 << level) <= zoom * 1.001; level++)
+		;
+	if (fabs(zoom - (1 << level)) < zoom * 0.001)
+		zoom = 1 << level;
+	scale = (1 << level) / zoom;
+}
+
+
+QCTRenderer::~QCTRenderer()
+{
+}
+
+
+void
+QCTRenderer::addFrame(const QCTRenderFrame &frame)
+{
+	frames.push_back(frame);
+}
+
+
+/*
+ * The main thread only waits while the workers run, so the strings in the
+ * frames (whose reference counts are not thread-safe in Qt3) are only used
+ * by the worker rendering that frame.
+ */
+int
+QCTRenderer::render(int nthreads)
+{
+	QPtrList<QCTRenderWorker> workers;
+	QCTRenderWorker *worker;
+
+	if (nthreads <= 0)
+		nthreads = RENDER_THREADS;
+#ifdef Q_OS_UNIX
+	if (nthreads <= 0)
+		nthreads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+	if (nthreads <= 0)
+		nthreads = 2;
+	if (area.isEmpty() || frames.empty())
+		return 0;
+
+	// The image formats are registered the first time they're asked for,
+	// which must not happen in several threads at once
+	QImage::outputFormats();
+
+	// Make the tiles under the area in parallel then resample them once
+	TRACE("render chart", area.width(), area.height());
+	tiles->makeArea(level, QCTTiles::sourceRect(area, scale), nthreads);
+	chart.create(area.width(), area.height(), 32);
+	tiles->resample(level, scale, area, &chart, QCTTiles::MakeTiles);
+	debugf(1, "QCTRenderer %d x %d at level %d scale %f, %d frames in %d threads\n",
+		area.width(), area.height(), level, scale, (int)frames.size(), nthreads);
+
+	next = written = 0;
+	workers.setAutoDelete(true);
+	for (int ii=0; ii<QMIN(nthreads, (int)frames.size()); ii++)
+	{
+		workers.append(worker = new QCTRenderWorker(this));
+		worker->start();
+	}
+	for (worker = workers.first(); worker; worker = workers.next())
+		worker->wait();
+	return written;
+}
+
+
+/*
+ * Through a const reference so the vector isn't asked to detach.
+ */
+const QCTRenderFrame *
+QCTRenderer::nextFrame()
+{
+	QMutexLocker locker(&mutex);
+	const QValueVector<QCTRenderFrame> &list = frames;
+	return (next < (int)list.size()) ? &list[next++] : 0;
+}
+
+
+void
+QCTRenderer::frameDone(bool saved)
+{
+	QMutexLocker locker(&mutex);
+	if (saved)
+		written++;
+}
+
+
+/*
+ * The chart's pixels are copied by hand so the workers only ever read the
+ * chart, whereas QImage::copy would also go through its shared data.
+ * The tides are drawn over the arrows, as on the screen.
+ */
+bool
+QCTRenderer::renderFrame(const QCTRenderFrame &frame)
+{
+	QImage image(chart.width(), chart.height(), 32);
+
+	TRACE("render frame", frame.arrows.count(), frame.tides.count());
+	for (int yy=0; yy<chart.height(); yy++)
+		memcpy(image.scanLine(yy), chart.scanLine(yy), chart.width() * sizeof(QRgb));
+	for (QValueList<QCTRenderArrow>::ConstIterator ai = frame.arrows.begin(); ai != frame.arrows.end(); ++ai)
+		drawArrow(&image, *ai);
+	for (QValueList<QCTRenderTide>::ConstIterator ti = frame.tides.begin(); ti != frame.tides.end(); ++ti)
+		drawTide(&image, *ti);
+	if (!frame.description.isEmpty())
+		image.setText("Description", 0, frame.description);
+	if (!image.save(frame.filename, "PNG"))
+	{
+		log_error_message("cannot write %s", (const char*)frame.filename);
+		return false;
+	}
+	return true;
+}
+
+
+void
+QCTRenderer::drawArrow(QImage *image, const QCTRenderArrow &arrow)
+{
+	const int ss = ARROW_SUPERSAMPLE;
+	int x = arrow.x - area.x(), y = arrow.y - area.y();
+	int bearing = NINT(arrow.bearing), length = NINT(arrow.length), sw = ArrowPlot::stemWidth(false);
+
+	if (x < -length - sw*2 || y < -length - sw*2 || x > image->width() + length + sw*2 || y > image->height() + length + sw*2)
+		return;
+	fillPolygon(image, ArrowPlot::outline(x * ss, y * ss, bearing, length * ss, sw * ss), ss, ARROW_FILL_COLOUR);
+	drawPolyline(image, ArrowPlot::outline(x, y, bearing, length, sw), ARROW_BORDER_WIDTH, ARROW_BORDER_COLOUR);
+}
+
+
+void
+QCTRenderer::drawTide(QImage *image, const QCTRenderTide &tide)
+{
+	TidePlot plot(tide.x - area.x(), tide.y - area.y(), tide.min, tide.max, tide.currently);
+	if (plot.rect().intersects(QRect(0, 0, image->width(), image->height())))
+		drawPolyline(image, plot.getPoints(), TIDE_WIDTH, TIDE_COLOUR);
+}
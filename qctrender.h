@@ -0,0 +1,83 @@
+/* > qctrender.h
+ * 1.00 arb
+ */
+
+#ifndef QCTRENDER_H
+#define QCTRENDER_H
+
+#include <qstring.h>
+#include <qimage.h>
+#include <qrect.h>
+#include <qvaluelist.h>
+#include <qvaluevector.h>
+#include <qmutex.h>
+
+class QCTTiles;
+
+
+/*
+ * An arrow or tide gauge to be drawn on a frame, at a position in the
+ * pixels of the whole chart at the renderer's zoom, as on the screen.
+ */
+struct QCTRenderArrow
+{
+	QCTRenderArrow() : x(0), y(0), bearing(0), length(0) {}
+	QCTRenderArrow(int ax, int ay, float b, float l) : x(ax), y(ay), bearing(b), length(l) {}
+	int x, y;
+	float bearing, length;
+};
+
+struct QCTRenderTide
+{
+	QCTRenderTide() : x(0), y(0), min(0), max(1), currently(0) {}
+	QCTRenderTide(int ax, int ay, float lo, float hi, float c) : x(ax), y(ay), min(lo), max(hi), currently(c) {}
+	int x, y;
+	float min, max, currently;
+};
+
+struct QCTRenderFrame
+{
+	QString filename;
+	QString description;           // kept in the PNG as its Description
+	QValueList<QCTRenderArrow> arrows;
+	QValueList<QCTRenderTide> tides;
+};
+
+
+/*
+ * Renders an area of a chart with the arrows and tide gauges of each of a
+ * list of frames into PNG files, without a display, so it can be run from
+ * a script.  The chart is resampled from the pyramid once, its tiles made
+ * in parallel, then the frames are shared between threads which each copy
+ * the chart, draw the overlays into it and save it.
+ */
+class QCTRenderer
+{
+public:
+	QCTRenderer(QCTTiles *tiles, double zoom, const QRect &area);
+	~QCTRenderer();
+	void addFrame(const QCTRenderFrame &frame);
+	int frameCount() const { return frames.size(); }
+	// Render all the frames using nthreads (0 for one per processor),
+	// returning the number of files written
+	int render(int nthreads = 0);
+private:
+	friend class QCTRenderWorker;
+	const QCTRenderFrame *nextFrame();
+	void frameDone(bool saved);
+	bool renderFrame(const QCTRenderFrame &frame);
+	void drawArrow(QImage *image, const QCTRenderArrow &arrow);
+	void drawTide(QImage *image, const QCTRenderTide &tide);
+private:
+	QCTTiles *tiles;
+	int level;                     // level of the pyramid for the zoom
+	double scale;                  // size of the area relative to the level
+	QRect area;                    // in pixels of the chart at the zoom
+	QImage chart;                  // the area of the chart, under every frame
+	QValueVector<QCTRenderFrame> frames;
+	QMutex mutex;                  // guards next and written
+	int next, written;
+};
+
+
+#endif // !QCTRENDER_H
@@ -0,0 +1,1077 @@
+/* > qcttiles.cpp
+ * 1.09 arb Mon Oct 19 23:59:58 BST 2026 - keep the found tile before unlocking
+ * 1.08 arb Mon Oct 19 23:59:37 BST 2026 - tell the receivers about every tile made
+ * 1.07 arb Mon Oct 19 23:59:29 BST 2026 - choose the AVX2 colour lookup when running
+ * 1.06 arb Mon Oct 19 23:59:14 BST 2026 - resample decoding tiles without keeping them
+ * 1.05 arb Mon Oct 19 23:58:21 BST 2026 - resample areas, make areas in parallel
+ * 1.04 arb Mon Oct 19 20:41:07 BST 2026 - share a memory budget between charts
+ * 1.03 arb Mon Oct 19 19:12:40 BST 2026 - area-average the reduced levels
+ * 1.02 arb Mon Oct 19 18:30:05 BST 2026 - expand tiles to 32-bit colour
+ * 1.01 arb Mon Oct 19 17:48:26 BST 2026 - read and write the disk cache
+ * 1.00 arb Mon Oct 19 17:05:12 BST 2026
+ */
+
+static const char SCCSid[] = "@(#)qcttiles.cpp   1.09 (C) 2026 arb QCT display tiles";
+
+/*
+ * QCTTiles holds the pyramid of display tiles for a QCT file and
+ * QCTTileDecoder makes them in background threads, so that QCTImage can
+ * ask for the tiles it is about to need before it needs to draw them.
+ * The reduced levels are made by averaging the colour of each block of
+ * pixels and using the nearest colour in the chart's colour table, so
+ * that thin lines and text fade rather than break up or disappear.
+ * QCTTileCache keeps the pyramids of recently used charts within a
+ * memory budget.
+ */
+
+/*
+ * Configuration:
+ * Define DECODER_THREADS as the number of background threads, or 0 to
+ * use one for each processor.
+ */
+#define DECODER_THREADS 0
+/*
+ * Define MIN_MEMORY_MB as the smallest memory budget allowed, enough for
+ * the tiles of a large screen at two levels and those being prefetched.
+ * Define TRIM_TO_FRACTION as how full the budget is left after evicting
+ * so it isn't done again for every new tile.
+ * Define MAX_CLOSED_CHARTS as the number of closed charts to keep.
+ */
+#define MIN_MEMORY_MB 32
+#define TRIM_TO_FRACTION 0.9
+#define MAX_CLOSED_CHARTS 8
+
+
+#include <math.h>
+#include <stdlib.h>       // for qsort
+#include <string.h>
+#include <qapplication.h> // for postEvent
+#include <qfileinfo.h>
+#include <qdatetime.h>
+#include <qptrlist.h>
+#include <qvaluevector.h>
+#include "satlib/dundee.h" // for debugf
+#include "qctfile.h"
+#include "qctdiskcache.h"
+#include "qcttiles.h"
+
+#ifdef Q_OS_UNIX
+#include <unistd.h>
+#endif
+// The AVX2 code is compiled for that instruction set alone and only used
+// if the processor has it, so it isn't left out of an ordinary build
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define EXPAND_AVX2
+#include <immintrin.h>
+#endif
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+
+/* ---------------------------------------------------------------------------
+ */
+QCTTiles::QCTTiles(const QString &fn)
+{
+	int ii, lev;
+
+	filename = fn;
+	QFileInfo fi(filename);
+	filetime = fi.lastModified().toTime_t();
+	filesize = fi.size();
+	users = 0;
+	bytes = 0;
+	diskcache = 0;
+	for (lev=0; lev<QCTTILES_LEVELS; lev++)
+		tiles[lev].setAutoDelete(true);
+	qctfile = new QCTFile(filename);
+	ok = qctfile->isOk();
+	if (!ok)
+		return;
+
+	// Space for the tiles at every level of the pyramid
+	for (lev=0; lev<QCTTILES_LEVELS; lev++)
+	{
+		tiles[lev].resize(tilesAcross(lev) * tilesDown(lev));
+		used[lev].resize(tiles[lev].size());
+	}
+
+	// Keep a copy of the QCT colourmap for each tile
+	for (ii=0; ii<256; ii++)
+	{
+		int R, G, B;
+		qctfile->getColour(ii, &R, &G, &B);
+		colourTable[ii] = qRgb(R, G, B);
+	}
+}
+
+
+QCTTiles::~QCTTiles()
+{
+	for (int lev=0; lev<QCTTILES_LEVELS; lev++)
+		tiles[lev].clear();
+	delete diskcache;
+	delete qctfile;
+}
+
+
+bool
+QCTTiles::isChanged() const
+{
+	QFileInfo fi(filename);
+	return fi.lastModified().toTime_t() != filetime || fi.size() != filesize;
+}
+
+
+void
+QCTTiles::setDiskCache(QCTDiskCache *dc)
+{
+	delete diskcache;
+	diskcache = dc;
+	if (diskcache)
+		for (int lev=0; lev<QCTTILES_LEVELS; lev++)
+			diskcache->openLevel(lev, tilesAcross(lev) * tilesDown(lev));
+}
+
+
+/*
+ * The grid of tiles at each level of the pyramid.
+ * Tiles are smaller than QCTTILES_TILE_SIZE at the right and bottom edges.
+ */
+int
+QCTTiles::getLevelWidth(int lev) const
+{
+	return qctfile->getImageWidth() >> lev;
+}
+
+
+int
+QCTTiles::getLevelHeight(int lev) const
+{
+	return qctfile->getImageHeight() >> lev;
+}
+
+
+int
+QCTTiles::tilesAcross(int lev) const
+{
+	return (getLevelWidth(lev) + QCTTILES_TILE_SIZE-1) / QCTTILES_TILE_SIZE;
+}
+
+
+int
+QCTTiles::tilesDown(int lev) const
+{
+	return (getLevelHeight(lev) + QCTTILES_TILE_SIZE-1) / QCTTILES_TILE_SIZE;
+}
+
+
+QRect
+QCTTiles::tileRect(int lev, int index) const
+{
+	int across = tilesAcross(lev);
+	int x = (index % across) * QCTTILES_TILE_SIZE;
+	int y = (index / across) * QCTTILES_TILE_SIZE;
+	return QRect(x, y, QMIN(QCTTILES_TILE_SIZE, getLevelWidth(lev) - x),
+		QMIN(QCTTILES_TILE_SIZE, getLevelHeight(lev) - y));
+}
+
+
+/*
+ * Called with the lock held.
+ */
+void
+QCTTiles::touch(int lev, int index)
+{
+	used[lev][index] = QCTTileCache::instance()->tick();
+}
+
+
+QImage *
+QCTTiles::find(int lev, int index)
+{
+	QMutexLocker locker(&mutex);
+	if (tiles[lev][index])
+		touch(lev, index);
+	return tiles[lev][index];
+}
+
+
+/*
+ * If the four tiles which it covers at the level below have already been
+ * made the tile is reduced from those, otherwise it is read from the disk
+ * cache or decoded from the QCT file (and written to the cache).  Either
+ * way the tiles at the level below are not made just to make this one.
+ * Reducing is quick so it's done with the lock held, to stop the tiles
+ * below being evicted meanwhile.  The lock is not held while a tile is
+ * decoded so if two threads make the same tile at once the second one
+ * is discarded.
+ */
+QImage *
+QCTTiles::make(int lev, int index)
+{
+	QImage *below[4] = { 0, 0, 0, 0 };
+	int xx, yy, nbelow = 0, nwanted = 0;
+
+	QRect rect = tileRect(lev, index);
+	mutex.lock();
+	if (tiles[lev][index])
+	{
+		// Take the pointer before unlocking, the cache may evict the slot
+		QImage *tile = tiles[lev][index];
+		touch(lev, index);
+		mutex.unlock();
+		return tile;
+	}
+	// The tiles at the level below are twice the size
+	if (lev > 0)
+	{
+		int across = tilesAcross(lev-1), down = tilesDown(lev-1);
+		int tx = (index % tilesAcross(lev)) * 2, ty = (index / tilesAcross(lev)) * 2;
+		for (yy=ty; yy<ty+2; yy++)
+			for (xx=tx; xx<tx+2; xx++)
+				if (yy < down && xx < across)
+				{
+					nwanted++;
+					if ((below[(yy-ty)*2 + xx-tx] = tiles[lev-1][yy * across + xx]) != 0)
+						nbelow++;
+				}
+	}
+
+	QImage *tile = new QImage(rect.width(), rect.height(), 8, 256);
+	for (int ii=0; ii<256; ii++)
+		tile->setColor(ii, colourTable[ii]);
+
+	if (lev > 0 && nbelow == nwanted)
+	{
+		for (yy=0; yy<2; yy++)
+			for (xx=0; xx<2; xx++)
+				if (below[yy*2 + xx])
+					reduceTile(below[yy*2 + xx], tile, xx * QCTTILES_TILE_SIZE / 2, yy * QCTTILES_TILE_SIZE / 2);
+	}
+	else
+	{
+		mutex.unlock();
+		if (diskcache == 0 || !diskcache->readTile(lev, index, rect.width(), rect.height(), tile->bits(), tile->bytesPerLine()))
+		{
+			decodeArea(lev, rect, tile->bits(), tile->bytesPerLine());
+			if (diskcache)
+				diskcache->writeTile(lev, index, rect.width(), rect.height(), tile->bits(), tile->bytesPerLine());
+		}
+		mutex.lock();
+	}
+
+	if (tiles[lev][index])
+		delete tile;
+	else
+	{
+		tiles[lev].insert(index, tile);
+		bytes += tile->numBytes();
+		// With the lock held so a receiver can't be removed meanwhile
+		for (QObject *receiver = receivers.first(); receiver; receiver = receivers.next())
+			QApplication::postEvent(receiver, new QCTTileEvent(this, QCTTileJob(lev, index)));
+	}
+	touch(lev, index);
+	tile = tiles[lev][index];
+	mutex.unlock();
+	return tile;
+}
+
+
+/*
+ * The receivers are told about the tiles made by any thread, including
+ * those made while painting or saving, not just by the decoder.
+ */
+void
+QCTTiles::addReceiver(QObject *receiver)
+{
+	QMutexLocker locker(&mutex);
+	if (receivers.findRef(receiver) < 0)
+		receivers.append(receiver);
+}
+
+
+void
+QCTTiles::removeReceiver(QObject *receiver)
+{
+	QMutexLocker locker(&mutex);
+	receivers.removeRef(receiver);
+}
+
+
+unsigned int
+QCTTiles::getBytes()
+{
+	QMutexLocker locker(&mutex);
+	return bytes;
+}
+
+
+int
+QCTTiles::countTiles()
+{
+	QMutexLocker locker(&mutex);
+	int count = 0;
+	for (int lev=0; lev<QCTTILES_LEVELS; lev++)
+		count += tiles[lev].count();
+	return count;
+}
+
+
+/*
+ * Fill in when each tile was last used, up to max of them,
+ * returning the number filled in.
+ */
+int
+QCTTiles::listTiles(QCTTileUse *uses, int max)
+{
+	QMutexLocker locker(&mutex);
+	int lev, index, count = 0;
+
+	for (lev=0; lev<QCTTILES_LEVELS; lev++)
+		for (index=0; index<(int)tiles[lev].size() && count<max; index++)
+			if (tiles[lev][index])
+			{
+				uses[count].used = used[lev][index];
+				uses[count].tiles = this;
+				uses[count].level = lev;
+				uses[count].index = index;
+				count++;
+			}
+	return count;
+}
+
+
+/*
+ * Only to be called in the GUI thread, as other threads don't keep the
+ * tiles, and not while it's drawing with them.
+ */
+void
+QCTTiles::evict(int lev, int index)
+{
+	QMutexLocker locker(&mutex);
+	if (tiles[lev][index])
+	{
+		bytes -= tiles[lev][index]->numBytes();
+		tiles[lev].remove(index);
+	}
+}
+
+
+void
+QCTTiles::copyTile(int lev, int index, unsigned char *dst, int stride)
+{
+	QRect rect = tileRect(lev, index);
+	QImage *tile = find(lev, index);
+	if (tile)
+	{
+		for (int yy=0; yy<rect.height(); yy++)
+			memcpy(dst + yy * stride, tile->scanLine(yy), rect.width());
+	}
+	else
+		decodeArea(lev, rect, dst, stride);
+}
+
+
+#ifdef EXPAND_AVX2
+/*
+ * Eight pixels at a time are widened to 32-bit indexes and fetched with
+ * a single gather, returning how many were done.
+ */
+__attribute__((target("avx2"))) static int
+expandPixelsAVX2(const unsigned char *src, QRgb *dst, int n, const QRgb *table)
+{
+	int ii;
+	for (ii=0; ii+8 <= n; ii+=8)
+	{
+		__m256i index = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*)(src + ii)));
+		__m256i rgb = _mm256_i32gather_epi32((const int*)table, index, 4);
+		_mm256_storeu_si256((__m256i*)(dst + ii), rgb);
+	}
+	return ii;
+}
+#endif
+
+
+/*
+ * Look up n pixels in the colour table.  With AVX2, when the processor
+ * has it, eight pixels at a time are fetched with a gather, otherwise
+ * the loop is unrolled so the lookups can be overlapped.
+ */
+static void
+expandPixels(const unsigned char *src, QRgb *dst, int n, const QRgb *table)
+{
+	int ii = 0;
+#ifdef EXPAND_AVX2
+	static const bool avx2 = __builtin_cpu_supports("avx2");
+	if (avx2)
+		ii = expandPixelsAVX2(src, dst, n, table);
+#endif
+	for (; ii+4 <= n; ii+=4)
+	{
+		QRgb c0 = table[src[ii]], c1 = table[src[ii+1]];
+		QRgb c2 = table[src[ii+2]], c3 = table[src[ii+3]];
+		dst[ii] = c0; dst[ii+1] = c1; dst[ii+2] = c2; dst[ii+3] = c3;
+	}
+	for (; ii<n; ii++)
+		dst[ii] = table[src[ii]];
+}
+
+
+/*
+ * The 32-bit image must be the same size as the tile.
+ */
+void
+QCTTiles::expandTile(const QImage *tile, QImage *rgb) const
+{
+	for (int yy=0; yy<tile->height(); yy++)
+		expandPixels(tile->scanLine(yy), (QRgb*)rgb->scanLine(yy), tile->width(), colourTable);
+}
+
+
+/*
+ * Average each reduce x reduce block of 32-bit pixels (src has stride
+ * pixels per row) and find the nearest colour in the colour table using
+ * the inverse table.  The total of a block is divided by shifting right,
+ * reduce being a power of two up to 8 so the totals fit in 16 bits.
+ * With SSE2 two pixels are added at a time, four 16-bit channels each.
+ */
+static void
+averagePixels(const QRgb *src, int stride, int reduce, int outwidth, unsigned char *dst, const unsigned char *inverse)
+{
+	int shift = 0, xx, yy, kk;
+	unsigned int r, g, b;
+
+	while ((1 << shift) < reduce * reduce)
+		shift++;
+	for (xx=0; xx<outwidth; xx++)
+	{
+		const QRgb *block = src + xx * reduce;
+#ifdef __SSE2__
+		__m128i zero = _mm_setzero_si128(), sum = zero;
+		for (yy=0; yy<reduce; yy++)
+			for (kk=0; kk<reduce; kk+=2)
+				sum = _mm_add_epi16(sum, _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i*)(block + yy * stride + kk)), zero));
+		sum = _mm_add_epi16(sum, _mm_srli_si128(sum, 8));
+		// The channels are in memory order, blue first
+		b = _mm_extract_epi16(sum, 0);
+		g = _mm_extract_epi16(sum, 1);
+		r = _mm_extract_epi16(sum, 2);
+#else
+		r = g = b = 0;
+		for (yy=0; yy<reduce; yy++)
+			for (kk=0; kk<reduce; kk++)
+			{
+				QRgb c = block[yy * stride + kk];
+				r += qRed(c);
+				g += qGreen(c);
+				b += qBlue(c);
+			}
+#endif
+		r = (r + (1 << (shift-1))) >> shift;
+		g = (g + (1 << (shift-1))) >> shift;
+		b = (b + (1 << (shift-1))) >> shift;
+		dst[xx] = inverse[((r >> 3) << 10) | ((g >> 3) << 5) | (b >> 3)];
+	}
+}
+
+
+/*
+ * The nearest colour in the colour table to every 15-bit colour,
+ * made the first time a reduced tile is needed.
+ */
+const unsigned char *
+QCTTiles::inverseColours()
+{
+	QMutexLocker locker(&inverseMutex);
+	if (inverse.size())
+		return (const unsigned char*)inverse.data();
+
+	inverse.resize(32768);
+	for (int ii=0; ii<32768; ii++)
+	{
+		int r = ((ii >> 10) << 3) | 4, g = (((ii >> 5) & 31) << 3) | 4, b = ((ii & 31) << 3) | 4;
+		int best = 0, bestdist = 0x7fffffff;
+		for (int cc=0; cc<256; cc++)
+		{
+			int dr = qRed(colourTable[cc]) - r, dg = qGreen(colourTable[cc]) - g, db = qBlue(colourTable[cc]) - b;
+			int dist = dr*dr + dg*dg + db*db;
+			if (dist < bestdist)
+			{
+				best = cc;
+				bestdist = dist;
+			}
+		}
+		inverse[ii] = best;
+	}
+	return (const unsigned char*)inverse.data();
+}
+
+
+/*
+ * Reduce a tile to half size into one quarter of a tile at the next level.
+ * The sizes of all tiles at the lower levels are even.
+ */
+void
+QCTTiles::reduceTile(const QImage *src, QImage *dst, int dx, int dy)
+{
+	QRgb rgb[2 * QCTTILES_TILE_SIZE];
+	const unsigned char *inv = inverseColours();
+	for (int yy=0; yy<src->height()/2; yy++)
+	{
+		expandPixels(src->scanLine(yy * 2), rgb, src->width(), colourTable);
+		expandPixels(src->scanLine(yy * 2 + 1), rgb + QCTTILES_TILE_SIZE, src->width(), colourTable);
+		averagePixels(rgb, QCTTILES_TILE_SIZE, 2, src->width()/2, dst->scanLine(dy + yy) + dx, inv);
+	}
+}
+
+
+/*
+ * Decode all the QCT tiles in an area of the image at a level of the
+ * pyramid (which must start on a QCT tile boundary) into dst which is
+ * the top left of the area.
+ * At full size the QCT tiles are decoded directly into dst,
+ * at lower levels each QCT tile is reduced by averaging.
+ */
+void
+QCTTiles::decodeArea(int lev, const QRect &rect, unsigned char *dst, int stride)
+{
+	unsigned char buf[QCTFILE_TILE_SIZE * QCTFILE_TILE_SIZE];
+	QRgb rgb[QCTFILE_TILE_SIZE * QCTFILE_TILE_SIZE];
+	const unsigned char *inv = (lev > 0) ? inverseColours() : 0;
+	int reduce = 1 << lev;
+	int step = QCTFILE_TILE_SIZE / reduce; // size of a QCT tile at this level
+	int tx, ty, yy;
+
+	// The image is a whole number of QCT tiles so they fit exactly
+	for (ty = rect.top() / step; ty * step <= rect.bottom(); ty++)
+	{
+		for (tx = rect.left() / step; tx * step <= rect.right(); tx++)
+		{
+			unsigned char *tiledst = dst + (ty * step - rect.y()) * stride + tx * step - rect.x();
+			if (reduce == 1)
+			{
+				qctfile->decodeTile(tx, ty, tiledst, stride);
+				continue;
+			}
+			qctfile->decodeTile(tx, ty, buf, QCTFILE_TILE_SIZE);
+			expandPixels(buf, rgb, QCTFILE_TILE_SIZE * QCTFILE_TILE_SIZE, colourTable);
+			for (yy=0; yy<step; yy++)
+				averagePixels(rgb + yy * reduce * QCTFILE_TILE_SIZE, QCTFILE_TILE_SIZE, reduce, step, tiledst + yy * stride, inv);
+		}
+	}
+}
+
+
+/*
+ * Copy a whole level into an 8-bit image the size of the level, with the
+ * rows of tiles shared between threads.  Tiles which haven't been made are
+ * decoded but not kept.
+ */
+class QCTTileCopier : public QThread
+{
+public:
+	QCTTileCopier(QCTTiles *t, int l, QImage *i, int f, int s) : tiles(t), level(l), image(i), first(f), step(s) {}
+protected:
+	void run();
+private:
+	QCTTiles *tiles;
+	int level;
+	QImage *image;
+	int first, step;  // rows of tiles to copy
+};
+
+
+void
+QCTTileCopier::run()
+{
+	for (int ty=first; ty<tiles->tilesDown(level); ty+=step)
+	{
+		for (int tx=0; tx<tiles->tilesAcross(level); tx++)
+		{
+			int index = ty * tiles->tilesAcross(level) + tx;
+			QRect rect = tiles->tileRect(level, index);
+			tiles->copyTile(level, index, image->scanLine(rect.y()) + rect.x(), image->bytesPerLine());
+		}
+	}
+}
+
+
+void
+QCTTiles::copyLevel(int lev, QImage *image, int nthreads)
+{
+	QPtrList<QCTTileCopier> copiers;
+	QCTTileCopier *copier;
+
+	copiers.setAutoDelete(true);
+	if (nthreads < 1)
+		nthreads = 1;
+	for (int ii=0; ii<nthreads; ii++)
+	{
+		copiers.append(copier = new QCTTileCopier(this, lev, image, ii, nthreads));
+		copier->start();
+	}
+	for (copier = copiers.first(); copier; copier = copiers.next())
+		copier->wait();
+}
+
+
+/*
+ * Make the tiles in the list, each thread taking every step'th one.
+ */
+class QCTTileMaker : public QThread
+{
+public:
+	QCTTileMaker(QCTTiles *t, int l, const QValueVector<int> &i, int f, int s) : tiles(t), level(l), indexes(i), first(f), step(s) {}
+protected:
+	void run();
+private:
+	QCTTiles *tiles;
+	int level;
+	QValueVector<int> indexes;
+	int first, step;
+};
+
+
+void
+QCTTileMaker::run()
+{
+	for (int ii=first; ii<(int)indexes.size(); ii+=step)
+		tiles->make(level, indexes[ii]);
+}
+
+
+void
+QCTTiles::makeArea(int lev, const QRect &rect, int nthreads)
+{
+	QPtrList<QCTTileMaker> makers;
+	QCTTileMaker *maker;
+	QValueVector<int> indexes;
+	QRect area = rect & QRect(0, 0, getLevelWidth(lev), getLevelHeight(lev));
+
+	if (area.isEmpty())
+		return;
+	for (int ty = area.top() / QCTTILES_TILE_SIZE; ty <= area.bottom() / QCTTILES_TILE_SIZE; ty++)
+		for (int tx = area.left() / QCTTILES_TILE_SIZE; tx <= area.right() / QCTTILES_TILE_SIZE; tx++)
+			if (find(lev, ty * tilesAcross(lev) + tx) == 0)
+				indexes.push_back(ty * tilesAcross(lev) + tx);
+	makers.setAutoDelete(true);
+	nthreads = QMAX(1, QMIN(nthreads, (int)indexes.size()));
+	for (int ii=0; ii<nthreads && !indexes.empty(); ii++)
+	{
+		makers.append(maker = new QCTTileMaker(this, lev, indexes, ii, nthreads));
+		maker->start();
+	}
+	for (maker = makers.first(); maker; maker = makers.next())
+		maker->wait();
+}
+
+
+/*
+ * Convert an area of a view to the pixels of the level it's resampled
+ * from, including the neighbours needed for interpolation.
+ */
+QRect
+QCTTiles::sourceRect(const QRect &area, double scale)
+{
+	if (scale == 1)
+		return area;
+	int left = (int)floor(area.left() / scale) - 1;
+	int top = (int)floor(area.top() / scale) - 1;
+	int right = (int)ceil((area.right() + 1) / scale) + 1;
+	int bottom = (int)ceil((area.bottom() + 1) / scale) + 1;
+	return QRect(QPoint(left, top), QPoint(right, bottom));
+}
+
+
+/*
+ * Resample the pixels of the level into the image, using bilinear
+ * interpolation between the four nearest pixels.  Only the tiles under
+ * the area are looked at, so this is quick for an area of the screen.
+ * The red and blue channels are interpolated together in one word and
+ * the green in another, with the weights in 1/256ths.
+ * Tiles not made are resampled as colour 0, for the caller to cover.
+ * Decoding the tiles without keeping them (eg. for printing at full size)
+ * keeps the memory used down to that of the area, but a tile under two
+ * areas is decoded for each.
+ */
+void
+QCTTiles::resample(int lev, double scale, const QRect &area, QImage *image, Fetch fetch, QValueList<QRect> *missing)
+{
+	QRect src = sourceRect(area, scale) & QRect(0, 0, getLevelWidth(lev), getLevelHeight(lev));
+	QRgb table[256];
+	int ii, tx, ty, xx, yy;
+
+	if (src.isEmpty())
+	{
+		image->fill(colourTable[0]);
+		return;
+	}
+
+	// Gather the pixels of the level into one buffer
+	QByteArray buf(src.width() * src.height()), decoded;
+	memset(buf.data(), 0, buf.size());
+	for (ty = src.top() / QCTTILES_TILE_SIZE; ty <= src.bottom() / QCTTILES_TILE_SIZE; ty++)
+	{
+		for (tx = src.left() / QCTTILES_TILE_SIZE; tx <= src.right() / QCTTILES_TILE_SIZE; tx++)
+		{
+			int index = ty * tilesAcross(lev) + tx;
+			QRect tilerect = tileRect(lev, index);
+			QRect rect = tilerect & src;
+			QImage *tile = (fetch == MakeTiles) ? make(lev, index) : find(lev, index);
+			const unsigned char *pixels;
+			int stride;
+			if (tile)
+			{
+				pixels = tile->bits();
+				stride = tile->bytesPerLine();
+			}
+			else if (fetch == DecodeTiles)
+			{
+				decoded.resize(tilerect.width() * tilerect.height());
+				decodeArea(lev, tilerect, (unsigned char*)decoded.data(), tilerect.width());
+				pixels = (const unsigned char*)decoded.data();
+				stride = tilerect.width();
+			}
+			else
+			{
+				if (missing)
+					missing->append(tilerect);
+				continue;
+			}
+			for (yy=rect.top(); yy<=rect.bottom(); yy++)
+				memcpy(buf.data() + (yy - src.y()) * src.width() + rect.x() - src.x(),
+					pixels + (yy - tilerect.y()) * stride + rect.x() - tilerect.x(), rect.width());
+		}
+	}
+
+	// Where each column of the view comes from, and how much of the next
+	QMemArray<int> xoffset(area.width()), xweight(area.width());
+	for (xx=0; xx<area.width(); xx++)
+	{
+		double sx = (area.x() + xx + 0.5) / scale - 0.5 - src.x();
+		int x0 = QMAX(0, QMIN(src.width()-2, (int)floor(sx)));
+		xoffset[xx] = x0;
+		xweight[xx] = QMAX(0, QMIN(256, (int)((sx - x0) * 256)));
+	}
+	for (ii=0; ii<256; ii++)
+		table[ii] = colourTable[ii];
+
+	for (yy=0; yy<area.height(); yy++)
+	{
+		double sy = (area.y() + yy + 0.5) / scale - 0.5 - src.y();
+		int y0 = QMAX(0, QMIN(src.height()-2, (int)floor(sy)));
+		unsigned int wy = QMAX(0, QMIN(256, (int)((sy - y0) * 256)));
+		const unsigned char *row0 = (const unsigned char*)buf.data() + y0 * src.width();
+		const unsigned char *row1 = row0 + (src.height() > 1 ? src.width() : 0);
+		QRgb *out = (QRgb*)image->scanLine(yy);
+		for (xx=0; xx<area.width(); xx++)
+		{
+			int x0 = xoffset[xx], x1 = x0 + (src.width() > 1 ? 1 : 0);
+			unsigned int wx = xweight[xx];
+			QRgb c00 = table[row0[x0]], c01 = table[row0[x1]];
+			QRgb c10 = table[row1[x0]], c11 = table[row1[x1]];
+			unsigned int rb0 = (((c00 & 0xff00ff) * (256-wx) + (c01 & 0xff00ff) * wx) >> 8) & 0xff00ff;
+			unsigned int rb1 = (((c10 & 0xff00ff) * (256-wx) + (c11 & 0xff00ff) * wx) >> 8) & 0xff00ff;
+			unsigned int g0 = (((c00 & 0xff00) * (256-wx) + (c01 & 0xff00) * wx) >> 8) & 0xff00;
+			unsigned int g1 = (((c10 & 0xff00) * (256-wx) + (c11 & 0xff00) * wx) >> 8) & 0xff00;
+			unsigned int rb = ((rb0 * (256-wy) + rb1 * wy) >> 8) & 0xff00ff;
+			unsigned int g = ((g0 * (256-wy) + g1 * wy) >> 8) & 0xff00;
+			out[xx] = 0xff000000 | rb | g;
+		}
+	}
+}
+
+
+/* ---------------------------------------------------------------------------
+ * The cache is created by the GUI thread when the first chart is opened,
+ * before any worker can call tick.
+ */
+QCTTileCache *
+QCTTileCache::instance()
+{
+	static QCTTileCache *cache = 0;
+	if (cache == 0)
+		cache = new QCTTileCache();
+	return cache;
+}
+
+
+QCTTileCache::QCTTileCache()
+{
+	maxbytes = MIN_MEMORY_MB * 1048576.0;
+	diskCacheMegabytes = 0;
+	clock = 0;
+	charts.setAutoDelete(true);
+}
+
+
+void
+QCTTileCache::setBudget(int megabytes)
+{
+	maxbytes = QMAX(MIN_MEMORY_MB, megabytes) * 1048576.0;
+	trim();
+}
+
+
+void
+QCTTileCache::setDiskCache(const QString &dir, int megabytes)
+{
+	diskCacheDir = dir;
+	diskCacheMegabytes = megabytes;
+}
+
+
+unsigned int
+QCTTileCache::tick()
+{
+	QMutexLocker locker(&clockMutex);
+	return ++clock;
+}
+
+
+/*
+ * A chart which has changed since it was opened is opened again, unless
+ * it's still in use.
+ */
+QCTTiles *
+QCTTileCache::open(const QString &filename)
+{
+	QCTTiles *tiles;
+
+	for (tiles = charts.first(); tiles; tiles = charts.next())
+		if (tiles->getFilename() == filename)
+			break;
+	if (tiles && tiles->users == 0 && tiles->isChanged())
+	{
+		remove(tiles);
+		tiles = 0;
+	}
+	if (tiles)
+	{
+		charts.take();
+		debugf(1, "QCTTileCache reusing %d tiles of %s\n", tiles->countTiles(), (const char*)filename);
+	}
+	else
+	{
+		tiles = new QCTTiles(filename);
+		if (!tiles->isOk())
+		{
+			delete tiles;
+			return 0;
+		}
+		if (diskCacheMegabytes > 0)
+			tiles->setDiskCache(new QCTDiskCache(diskCacheDir, diskCacheMegabytes, filename));
+	}
+	charts.prepend(tiles);
+	tiles->users++;
+	return tiles;
+}
+
+
+/*
+ * The caller must have stopped any decoder using the tiles.
+ */
+void
+QCTTileCache::close(QCTTiles *tiles)
+{
+	if (charts.findRef(tiles) < 0)
+		return;
+	tiles->users--;
+	trim();
+}
+
+
+void
+QCTTileCache::remove(QCTTiles *tiles)
+{
+	debugf(1, "QCTTileCache closing %s\n", (const char*)tiles->getFilename());
+	if (charts.findRef(tiles) >= 0)
+		charts.remove();
+}
+
+
+static int
+compareUses(const void *a, const void *b)
+{
+	unsigned int ua = ((const QCTTileUse*)a)->used, ub = ((const QCTTileUse*)b)->used;
+	return (ua < ub) ? -1 : (ua > ub) ? 1 : 0;
+}
+
+
+/*
+ * Sort every tile by when it was last used and evict the oldest until
+ * comfortably within the budget.  Then delete the closed charts which
+ * have no tiles left and those beyond the number to keep.
+ */
+void
+QCTTileCache::trim()
+{
+	QCTTiles *tiles;
+	double total = 0;
+	int count = 0, nclosed = 0, ii;
+
+	for (tiles = charts.first(); tiles; tiles = charts.next())
+	{
+		total += tiles->getBytes();
+		count += tiles->countTiles();
+	}
+	if (total > maxbytes)
+	{
+		// Workers may add tiles meanwhile, which will be the newest anyway
+		QMemArray<QCTTileUse> uses(count);
+		int nuses = 0;
+		for (tiles = charts.first(); tiles; tiles = charts.next())
+			nuses += tiles->listTiles(uses.data() + nuses, count - nuses);
+		qsort(uses.data(), nuses, sizeof(QCTTileUse), compareUses);
+		for (ii=0; ii<nuses && total > maxbytes * TRIM_TO_FRACTION; ii++)
+		{
+			total -= uses[ii].tiles->getBytes();
+			uses[ii].tiles->evict(uses[ii].level, uses[ii].index);
+			total += uses[ii].tiles->getBytes();
+		}
+		debugf(1, "QCTTileCache evicted %d tiles, %.0f bytes left\n", ii, total);
+	}
+
+	QPtrList<QCTTiles> unwanted;
+	for (tiles = charts.first(); tiles; tiles = charts.next())
+		if (tiles->users == 0 && (tiles->getBytes() == 0 || ++nclosed > MAX_CLOSED_CHARTS))
+			unwanted.append(tiles);
+	for (tiles = unwanted.first(); tiles; tiles = unwanted.next())
+		remove(tiles);
+}
+
+
+/* ---------------------------------------------------------------------------
+ * Each worker thread takes the next job from the decoder until it's stopped.
+ */
+class QCTTileWorker : public QThread
+{
+public:
+	QCTTileWorker(QCTTileDecoder *d) : decoder(d) {}
+protected:
+	void run();
+private:
+	QCTTileDecoder *decoder;
+};
+
+
+void
+QCTTileWorker::run()
+{
+	QCTTiles *tiles;
+	QCTTileJob job;
+
+	// The pyramid tells the receivers when a tile is made
+	while (decoder->nextJob(&tiles, &job))
+	{
+		tiles->make(job.level, job.index);
+		decoder->jobDone();
+	}
+}
+
+
+/* ---------------------------------------------------------------------------
+ */
+QCTTileDecoder::QCTTileDecoder(int nthr)
+{
+	tiles = 0;
+	busy = 0;
+	stopping = false;
+
+	nthreads = nthr;
+	if (nthreads <= 0)
+		nthreads = DECODER_THREADS;
+#ifdef Q_OS_UNIX
+	if (nthreads <= 0)
+		nthreads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+	if (nthreads <= 0)
+		nthreads = 2;
+	debugf(1, "QCTTileDecoder using %d threads\n", nthreads);
+
+	workers = new QCTTileWorker*[nthreads];
+	for (int ii=0; ii<nthreads; ii++)
+	{
+		workers[ii] = new QCTTileWorker(this);
+		workers[ii]->start();
+	}
+}
+
+
+QCTTileDecoder::~QCTTileDecoder()
+{
+	int ii;
+
+	mutex.lock();
+	stopping = true;
+	jobs.clear();
+	jobsWaiting.wakeAll();
+	mutex.unlock();
+
+	for (ii=0; ii<nthreads; ii++)
+	{
+		workers[ii]->wait();
+		delete workers[ii];
+	}
+	delete [] workers;
+}
+
+
+/*
+ * The old pyramid can be deleted when this returns as no worker is
+ * using it any more.
+ */
+void
+QCTTileDecoder::setTiles(QCTTiles *newtiles)
+{
+	QMutexLocker locker(&mutex);
+	jobs.clear();
+	while (busy > 0)
+		allIdle.wait(&mutex);
+	tiles = newtiles;
+}
+
+
+void
+QCTTileDecoder::setJobs(const QValueList<QCTTileJob> &newjobs)
+{
+	QMutexLocker locker(&mutex);
+	if (tiles == 0)
+		return;
+	jobs = newjobs;
+	if (!jobs.isEmpty())
+		jobsWaiting.wakeAll();
+}
+
+
+/*
+ * Called by the workers to wait for a job, returns false when stopping.
+ */
+bool
+QCTTileDecoder::nextJob(QCTTiles **jobtiles, QCTTileJob *job)
+{
+	QMutexLocker locker(&mutex);
+	while (jobs.isEmpty() && !stopping)
+		jobsWaiting.wait(&mutex);
+	if (stopping)
+		return false;
+	*job = jobs.first();
+	jobs.remove(jobs.begin());
+	*jobtiles = tiles;
+	busy++;
+	return true;
+}
+
+
+/*
+ * Called by the workers after a job.
+ */
+void
+QCTTileDecoder::jobDone()
+{
+	QMutexLocker locker(&mutex);
+	busy--;
+	if (busy == 0)
+		allIdle.wakeAll();
+}
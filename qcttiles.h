@@ -0,0 +1,223 @@
+/* > qcttiles.h
+ * 1.07 arb Mon Oct 19 23:59:37 BST 2026 - tell the receivers about every tile made
+ * 1.06 arb Mon Oct 19 23:59:14 BST 2026 - resample without keeping the tiles
+ * 1.05 arb Mon Oct 19 23:58:21 BST 2026 - resample and make areas
+ * 1.04 arb Mon Oct 19 20:41:07 BST 2026 - shared memory cache
+ * 1.03 arb Mon Oct 19 19:12:40 BST 2026 - area averaging
+ * 1.02 arb Mon Oct 19 18:30:05 BST 2026 - expand to 32-bit
+ * 1.01 arb Mon Oct 19 17:48:26 BST 2026 - disk cache
+ * 1.00 arb
+ */
+
+#ifndef QCTTILES_H
+#define QCTTILES_H
+
+#include <qstring.h>
+#include <qimage.h>
+#include <qptrvector.h>
+#include <qptrlist.h>
+#include <qmemarray.h>
+#include <qvaluelist.h>
+#include <qthread.h>
+#include <qmutex.h>
+#include <qwaitcondition.h>
+#include <qevent.h>
+#include <qcstring.h>   // for QByteArray
+
+class QObject;
+class QCTFile;
+class QCTDiskCache;
+struct QCTTileUse;
+
+
+#define QCTTILES_TILE_SIZE 256  // display tiles are this many pixels square
+#define QCTTILES_LEVELS      4  // full size, 1/2, 1/4 and 1/8
+#define QCTTILES_EVENT (QEvent::User + 1)
+
+
+/*
+ * The pyramid of display tiles for one QCT file.  Level 0 is full size
+ * and each level is half the size of the one before.  Tiles are made
+ * when first needed and kept, either reduced from the four tiles at the
+ * level above if they have been made, or read from the disk cache, or
+ * decoded from the QCT file.
+ * All methods can be called from any thread except evict.  A tile is
+ * never changed once made but it can be evicted by QCTTileCache, which
+ * is only done in the GUI thread, so a tile returned by find or make
+ * must not be kept by other threads.
+ * Each receiver is posted a QCTTileEvent whenever a tile is made, by
+ * whichever thread made it.
+ */
+class QCTTiles
+{
+public:
+	QCTTiles(const QString &filename);
+	~QCTTiles();
+	bool isOk() const { return ok; }
+	// Whether the file has changed since it was opened
+	bool isChanged() const;
+	const QString &getFilename() const { return filename; }
+	// Keep decoded tiles on disk too (the cache is deleted with the tiles)
+	void setDiskCache(QCTDiskCache *diskcache);
+	int getLevelWidth(int level) const;
+	int getLevelHeight(int level) const;
+	int tilesAcross(int level) const;
+	int tilesDown(int level) const;
+	QRect tileRect(int level, int index) const;
+	QRgb getColour(int index) const { return colourTable[index]; }
+	// Return the tile if it has been made, otherwise 0
+	QImage *find(int level, int index);
+	// Return the tile, making it if necessary
+	QImage *make(int level, int index);
+	// Be given a QCTTileEvent for every tile made from now on
+	void addReceiver(QObject *receiver);
+	void removeReceiver(QObject *receiver);
+	// Copy or decode a tile into dst without keeping it
+	void copyTile(int level, int index, unsigned char *dst, int stride);
+	// Copy a whole level into an image, using several threads
+	void copyLevel(int level, QImage *image, int nthreads);
+	// Convert a tile to 32-bit colour through the colour table
+	void expandTile(const QImage *tile, QImage *rgb) const;
+	// The pixels of a level needed to resample an area of a view scale
+	// times the size of the level, with the neighbours for interpolation
+	static QRect sourceRect(const QRect &area, double scale);
+	// Resample into a 32-bit image the size of area (in the view's
+	// coordinates) using only the tiles already made, listing the others
+	// in missing (in the level's coordinates), or making the tiles, or
+	// decoding those not made without keeping them
+	enum Fetch { FindTiles, MakeTiles, DecodeTiles };
+	void resample(int level, double scale, const QRect &area, QImage *image, Fetch fetch, QValueList<QRect> *missing = 0);
+	// Make all the tiles of a level which touch rect, using several threads
+	void makeArea(int level, const QRect &rect, int nthreads);
+	// Memory used by the tiles, and when each was last used
+	unsigned int getBytes();
+	int countTiles();
+	int listTiles(QCTTileUse *uses, int max);
+	void evict(int level, int index);
+private:
+	void touch(int level, int index);
+	const unsigned char *inverseColours();
+	void reduceTile(const QImage *src, QImage *dst, int dx, int dy);
+	void decodeArea(int level, const QRect &rect, unsigned char *dst, int stride);
+private:
+	friend class QCTTileCache;
+	bool ok;
+	QString filename;
+	unsigned int filetime, filesize;           // to tell if it has changed
+	int users;                                 // number of views open on it
+	QCTFile *qctfile;
+	QCTDiskCache *diskcache;
+	QRgb colourTable[256];
+	QByteArray inverse;                        // 15-bit colour to index
+	QMutex inverseMutex;
+	QPtrVector<QImage> tiles[QCTTILES_LEVELS]; // null until made
+	QMemArray<unsigned int> used[QCTTILES_LEVELS]; // QCTTileCache::tick
+	unsigned int bytes;                        // total size of the tiles
+	QPtrList<QObject> receivers;               // of a QCTTileEvent for each tile made
+	QMutex mutex;                              // guards tiles, used, bytes and receivers
+};
+
+
+/*
+ * When a tile was last used, for QCTTileCache to evict the oldest.
+ */
+struct QCTTileUse
+{
+	unsigned int used;
+	QCTTiles *tiles;
+	int level, index;
+};
+
+
+/*
+ * The pyramids of the charts opened recently, kept after a chart is
+ * closed so that going back to it is instant.  The tiles of all the
+ * pyramids share one memory budget and when it's exceeded those least
+ * recently used are evicted, from any chart and any level.  A closed
+ * chart is deleted when all its tiles have been evicted, or when too
+ * many closed charts are being kept.
+ * Only to be used from the GUI thread, except for tick.
+ */
+class QCTTileCache
+{
+public:
+	static QCTTileCache *instance();
+	void setBudget(int megabytes);
+	// Keep decoded tiles on disk for charts opened from now on
+	void setDiskCache(const QString &dir, int megabytes);
+	// Open a chart, reusing its pyramid if still kept, or 0 on failure
+	QCTTiles *open(const QString &filename);
+	// Finished with a chart, but its tiles are kept for now
+	void close(QCTTiles *tiles);
+	// Evict the least recently used tiles if over the budget
+	void trim();
+	// A clock which advances each time a tile is used
+	unsigned int tick();
+private:
+	QCTTileCache();
+	void remove(QCTTiles *tiles);
+private:
+	QPtrList<QCTTiles> charts;       // most recently opened first
+	double maxbytes;
+	QString diskCacheDir;
+	int diskCacheMegabytes;          // or 0 for no disk cache
+	unsigned int clock;
+	QMutex clockMutex;               // guards clock
+};
+
+
+/*
+ * A tile which the decoder should make, and the event posted to the
+ * receivers of the pyramid when any tile has been made.
+ */
+struct QCTTileJob
+{
+	QCTTileJob() : level(0), index(0) {}
+	QCTTileJob(int l, int i) : level(l), index(i) {}
+	bool operator==(const QCTTileJob &o) const { return level == o.level && index == o.index; }
+	int level, index;
+};
+
+class QCTTileEvent : public QCustomEvent
+{
+public:
+	QCTTileEvent(QCTTiles *t, const QCTTileJob &j) : QCustomEvent(QCTTILES_EVENT), tiles(t), job(j) {}
+	QCTTiles *tiles;
+	QCTTileJob job;
+};
+
+
+/*
+ * A pool of background threads making tiles from a list of jobs.
+ * The list is replaced whenever the view moves so the most useful tiles
+ * are always made first and those no longer wanted are forgotten.
+ */
+class QCTTileWorker;
+
+class QCTTileDecoder
+{
+public:
+	QCTTileDecoder(int nthreads = 0);
+	~QCTTileDecoder();
+	// Change to another pyramid (or none), waiting for tiles in progress
+	void setTiles(QCTTiles *tiles);
+	// Replace the list of jobs still waiting
+	void setJobs(const QValueList<QCTTileJob> &jobs);
+	int getThreadCount() const { return nthreads; }
+private:
+	friend class QCTTileWorker;
+	bool nextJob(QCTTiles **tiles, QCTTileJob *job);
+	void jobDone();
+private:
+	int nthreads;
+	QCTTileWorker **workers;
+	QMutex mutex;                // guards everything below
+	QWaitCondition jobsWaiting, allIdle;
+	QCTTiles *tiles;
+	QValueList<QCTTileJob> jobs;
+	int busy;                    // number of workers making a tile
+	bool stopping;
+};
+
+
+#endif // !QCTTILES_H
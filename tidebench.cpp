@@ -0,0 +1,188 @@
+/* > tidebench.cpp
+ * 1.03 arb Mon Oct 19 23:59:49 BST 2026 - streams make their polynomials when queried
+ * 1.02 arb Mon Oct 19 23:59:33 BST 2026 - compare bearings too
+ * 1.01 arb Mon Oct 19 13:31:08 BST 2026 - names are interned
+ * 1.00 arb Mon Oct 19 11:40:05 BST 2026
+ */
+
+static const char SCCSid[] = "@(#)tidebench.cpp 1.03 (C) 2026 arb Tidal stream evaluation benchmark";
+
+/*
+ * Compares the time taken to evaluate tidal streams using the original
+ * method (four calls to splint, each of which searches for the interval)
+ * with TidalStream::getStreamMinsFromRef (one polynomial per hour, but
+ * worked out from the tables on every call as the streams don't keep them)
+ * and with TidalStreamSet (polynomials worked out once, all streams at once).
+ * Also reports the largest difference in rate and bearing between the two
+ * methods, the bearing only where the stream isn't slack.
+ * Reads lines from C1 files on stdin, eg.
+ *   cat tidedata/NN10.C1 | ./tidebench 1000
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <qdatetime.h>
+#include <qstringlist.h>
+#include <qptrlist.h>
+#include "satlib/dundee.h" // for cspline and splint
+#include "tidedata.h"
+
+
+#define BENCH_STEP_MINS 1.0  // query every minute from -6 to +6 hours
+#define BENCH_SLACK 0.01     // knots below which the bearing is meaningless
+
+
+/*
+ * The original implementation, kept here only for comparison
+ */
+class SplintStream
+{
+public:
+	SplintStream(const QString &line);
+	void getStreamMinsFromRef(double mins, float *pbearing, float *pspringRate, float *pneapRate);
+private:
+	float xspring[TIDALSTREAM_NUMRATES], xspring_coeff[TIDALSTREAM_NUMRATES];
+	float yspring[TIDALSTREAM_NUMRATES], yspring_coeff[TIDALSTREAM_NUMRATES];
+	float xneap[TIDALSTREAM_NUMRATES],   xneap_coeff[TIDALSTREAM_NUMRATES];
+	float yneap[TIDALSTREAM_NUMRATES],   yneap_coeff[TIDALSTREAM_NUMRATES];
+	static float hour[TIDALSTREAM_NUMRATES];
+};
+
+float SplintStream::hour[] = {0,1,2,3,4,5,6,7,8,9,10,11,12};
+
+
+SplintStream::SplintStream(const QString &line)
+{
+	QStringList fields = QStringList::split('\t', line, true);
+	for (int ii=0; ii<TIDALSTREAM_NUMRATES; ii++)
+	{
+		float bearing    = fields[9 + ii*6 + 0].toDouble();
+		float springRate = fields[9 + ii*6 + 1].toDouble();
+		float neapRate   = fields[9 + ii*6 + 2].toDouble();
+		xspring[ii] = sin(RAD(bearing)) * springRate;
+		xneap[ii]   = sin(RAD(bearing)) * neapRate;
+		yspring[ii] = cos(RAD(bearing)) * springRate;
+		yneap[ii]   = cos(RAD(bearing)) * neapRate;
+	}
+	cspline(hour, xspring, TIDALSTREAM_NUMRATES, 1.0e30, 1.0e30, xspring_coeff);
+	cspline(hour, yspring, TIDALSTREAM_NUMRATES, 1.0e30, 1.0e30, yspring_coeff);
+	cspline(hour, xneap,   TIDALSTREAM_NUMRATES, 1.0e30, 1.0e30, xneap_coeff);
+	cspline(hour, yneap,   TIDALSTREAM_NUMRATES, 1.0e30, 1.0e30, yneap_coeff);
+}
+
+
+void
+SplintStream::getStreamMinsFromRef(double mins, float *pbearing, float *pspringRate, float *pneapRate)
+{
+	mins += 6 * 60;
+	float xspringval = splint(hour, xspring, xspring_coeff, TIDALSTREAM_NUMRATES, 0, mins/60.0);
+	float yspringval = splint(hour, yspring, yspring_coeff, TIDALSTREAM_NUMRATES, 0, mins/60.0);
+	float xneapval   = splint(hour, xneap,   xneap_coeff,   TIDALSTREAM_NUMRATES, 0, mins/60.0);
+	float yneapval   = splint(hour, yneap,   yneap_coeff,   TIDALSTREAM_NUMRATES, 0, mins/60.0);
+	*pbearing = DEG(atan2(xspringval, yspringval));
+	*pspringRate = sqrt(xspringval*xspringval + yspringval*yspringval);
+	*pneapRate   = sqrt(xneapval*xneapval + yneapval*yneapval);
+}
+
+
+int
+main(int argc, char *argv[])
+{
+	char line[2048];
+	TidalNames names;
+	QPtrList<TidalStream> streams;
+	QValueVector<TidalStream*> streamvec;
+	QPtrList<SplintStream> splints;
+	int repeat = (argc > 1) ? atoi(argv[1]) : 100;
+	int rr, queries = 0;
+	double mins;
+	float bearing, springRate, neapRate;
+	float bearing0, springRate0, neapRate0;
+	float maxdiff = 0, maxbearingdiff = 0, bearingdiff;
+	volatile float sink = 0;
+	QTime timer;
+
+	streams.setAutoDelete(true);
+	splints.setAutoDelete(true);
+	while (fgets(line, 2048, stdin))
+	{
+		TidalStream *tsp = new TidalStream(line, &names);
+		if (!tsp->isOk()) { delete tsp; continue; }
+		streams.append(tsp);
+		streamvec.push_back(tsp);
+		splints.append(new SplintStream(line));
+	}
+	if (streams.isEmpty()) { fprintf(stderr, "usage: tidebench [repeat] < file.C1\n"); exit(1); }
+
+	// Check that both give the same answer
+	SplintStream *ssp = splints.first();
+	for (TidalStream *tsp = streams.first(); tsp; tsp = streams.next(), ssp = splints.next())
+	{
+		for (mins = -6*60+0.5; mins < 6*60; mins += BENCH_STEP_MINS)
+		{
+			tsp->getStreamMinsFromRef(mins, &bearing, &springRate, &neapRate);
+			ssp->getStreamMinsFromRef(mins, &bearing0, &springRate0, &neapRate0);
+			maxdiff = QMAX(maxdiff, (float)fabs(springRate - springRate0));
+			maxdiff = QMAX(maxdiff, (float)fabs(neapRate - neapRate0));
+			if (springRate0 < BENCH_SLACK)
+				continue;
+			bearingdiff = fmod(fabs(bearing - bearing0), 360.0);
+			maxbearingdiff = QMAX(maxbearingdiff, QMIN(bearingdiff, 360 - bearingdiff));
+		}
+	}
+
+	timer.start();
+	for (rr=0; rr<repeat; rr++)
+	{
+		for (SplintStream *ssp = splints.first(); ssp; ssp = splints.next())
+			for (mins = -6*60+0.5; mins < 6*60; mins += BENCH_STEP_MINS)
+			{
+				ssp->getStreamMinsFromRef(mins, &bearing, &springRate, &neapRate);
+				sink += springRate;
+				queries++;
+			}
+	}
+	int splint_ms = timer.restart();
+	for (rr=0; rr<repeat; rr++)
+	{
+		for (TidalStream *tsp = streams.first(); tsp; tsp = streams.next())
+			for (mins = -6*60+0.5; mins < 6*60; mins += BENCH_STEP_MINS)
+			{
+				tsp->getStreamMinsFromRef(mins, &bearing, &springRate, &neapRate);
+				sink += springRate;
+			}
+	}
+	int poly_ms = timer.restart();
+	for (rr=0; rr<repeat; rr++)
+	{
+		for (TidalStream *tsp = streams.first(); tsp; tsp = streams.next())
+			for (mins = -6*60+0.5; mins < 6*60; mins += BENCH_STEP_MINS)
+			{
+				tsp->getStreamMinsFromRef(mins, 0, &springRate, 0);
+				sink += springRate;
+			}
+	}
+	int rate_ms = timer.restart();
+	TidalStreamSet streamset;
+	streamset.build(streamvec);
+	for (rr=0; rr<repeat; rr++)
+	{
+		for (mins = -6*60+0.5; mins < 6*60; mins += BENCH_STEP_MINS)
+		{
+			for (int ii=0; ii<streamset.count(); ii++)
+				streamset.setMinsFromRef(ii, mins);
+			streamset.evaluate(0.5);
+			sink += streamset.getRate(0);
+		}
+	}
+	int set_ms = timer.elapsed();
+
+	printf("%d streams, %d queries, max rate difference %g knots, max bearing difference %g degrees\n",
+		streams.count(), queries, maxdiff, maxbearingdiff);
+	printf("splint      %6d ms  %8.1f ns/query\n", splint_ms, splint_ms * 1.0e6 / queries);
+	printf("polynomial  %6d ms  %8.1f ns/query\n", poly_ms,   poly_ms * 1.0e6 / queries);
+	printf("rate only   %6d ms  %8.1f ns/query\n", rate_ms,   rate_ms * 1.0e6 / queries);
+	printf("stream set  %6d ms  %8.1f ns/query\n", set_ms,    set_ms * 1.0e6 / queries);
+	return(0);
+}
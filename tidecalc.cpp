@@ -1,10 +1,13 @@
 /* > tidecalc.cpp
+ * 1.05 arb Mon Oct 19 23:59:41 BST 2026 - an ID for each name, compared by TCD station.
+ * 1.04 arb Mon Oct 19 22:38:15 BST 2026 - trace instead of debugf when finding tides.
+ * 1.03 arb Mon Oct 19 14:12:37 BST 2026 - lookup stations by integer ID.
  * 1.02 arb Sat Jul 10 17:11:42 BST 2010 - added TCD class.
  * 1.01 arb Sat Jul 10 16:45:23 BST 2010 - fix a bug in the Moon.
  * 1.00 arb Sun Jun 27 23:55:32 BST 2010
  */
 
-static const char SCCSid[] = "@(#)tidecalc.cpp  1.02 (C) 2010 arb Tide Calculation via xtide";
+static const char SCCSid[] = "@(#)tidecalc.cpp  1.05 (C) 2010 arb Tide Calculation via xtide";
 
 /*
  * Calls the "tide" program (distributed by xtide) for the given station
@@ -19,6 +22,9 @@ static const char SCCSid[] = "@(#)tidecalc.cpp  1.02 (C) 2010 arb Tide Calculati
  * results for faster queries.  It also has a method to query the tide
  * database for a station location.  That's not cached but the most recent
  * location is remembered for faster repetetive queries.
+ * Stations can be resolved once by name into an integer ID which is the
+ * same for all names which match the same station in the tide database,
+ * and queries by ID are just an array lookup.
  *
  * MoonCalc calculates the moon phase and caches the result for faster queries.
  */
@@ -35,6 +41,7 @@ static const char SCCSid[] = "@(#)tidecalc.cpp  1.02 (C) 2010 arb Tide Calculati
 #include <qapplication.h>
 #include <qdir.h>
 #include "satlib/dundee.h" // for jtime stuff
+#include "trace.h"
 #include "libtcd/tcd.h"    // for TCD
 #include "tidecalc.h"
 
@@ -302,7 +309,7 @@ TideCalcStation::findTide(double jtime, float *tideheight)
 		fprintf(stderr, "ERROR *** findTide called with out of range time ***\n");
 		return(-1);
 	}
-	debugf(1,"findTide at %s is index %d height %f\n",jctime(jtime),ii,height[ii]);
+	TRACE("findTide", jtime, height[ii]);
 	*tideheight = height[ii];
 	return(0);
 }
@@ -311,7 +318,7 @@ TideCalcStation::findTide(double jtime, float *tideheight)
 int
 TideCalcStation::findNearestHighWater(double jtime, float *tideheight, double *jtimeHW)
 {
-	debugf(1,"findNearestHighWater(%s)\n",jctime(jtime));
+	TRACE("findNearestHighWater", jtime, 0);
 	if (jtime < starttime+SIXHOURS || jtime > endtime-SIXHOURS)
 	{
 		initialiseTideTimes(jtime-SIXHOURS);
@@ -333,7 +340,7 @@ TideCalcStation::findNearestHighWater(double jtime, float *tideheight, double *j
 	}
 	*tideheight = 0.0; // this version doesn't store height
 	*jtimeHW = jtime_hw[ii];
-	debugf(1, "  HW [%d] at %s is closest to %s (%f,%f-%f)\n", ii, jctime(*jtimeHW), jctime(jtime), *jtimeHW, jtime, fabs(*jtimeHW-jtime)/60.0);
+	TRACE("findNearestHighWater HW", *jtimeHW, ii);
 
 	return(0);
 }
@@ -366,6 +373,8 @@ TideCalc::TideCalc(const QString &harmonics)
 
 TideCalc::~TideCalc()
 {
+	for (unsigned int ii=0; ii<stations.count(); ii++)
+		delete stations[ii].calc;
 }
 
 
@@ -392,11 +401,67 @@ TideCalc::loadTideDatabase(const QString &filename)
 	/*
 	 * Load the tide database now so we can check station names later
 	 * XXX look in different directories if the load fails?
+	 * Station IDs already given out are forgotten, as the stations they
+	 * matched and their tides may be different in the new database,
+	 * so names must be resolved to IDs again.
 	 */
+	for (unsigned int ii=0; ii<stations.count(); ii++)
+		delete stations[ii].calc;
+	stations.clear();
+	nameids.clear();
+	tcdids.clear();
 	return tidedatabase.load(harmonicsFilename);
 }
 
 
+/*
+ * Return the ID of a station, allocating a new one if this name has
+ * not been seen before.  Each name has its own ID, and the "tide" program
+ * is run with that name, even when several names match the same station
+ * in the tide database; isSameStation tells whether they do, and the
+ * location is only read once for each station in the database.
+ * Names not in the tide database are given an ID too, as the "tide"
+ * program may still know them, but isStationKnown will return false.
+ */
+int
+TideCalc::getStationId(const QString &station)
+{
+	QMap<QString,int>::Iterator it = nameids.find(station);
+	if (it != nameids.end())
+		return it.data();
+
+	Station sta;
+	sta.name = station;
+	sta.known = false;
+	sta.tcd = -1;
+	sta.lat = sta.lon = 0.0;
+	sta.calc = 0;
+	int id = stations.count();
+	if (tidedatabase.setStation(station))
+	{
+		int num = tidedatabase.getStationNum();
+		QMap<int,int>::Iterator tcdit = tcdids.find(num);
+		if (tcdit != tcdids.end())
+		{
+			sta.lat = stations[tcdit.data()].lat;
+			sta.lon = stations[tcdit.data()].lon;
+			sta.known = true;
+		}
+		else if (tidedatabase.getStationLocation(&sta.lat, &sta.lon))
+		{
+			sta.known = true;
+			tcdids[num] = id;
+		}
+		if (sta.known)
+			sta.tcd = num;
+	}
+	stations.push_back(sta);
+	nameids[station] = id;
+	debugf(1, "TideCalc station %s has ID %d (TCD %d)\n", (const char*)station, id, sta.tcd);
+	return id;
+}
+
+
 /*
  * NOTE: returned location is +/-180 positive East.
  */
@@ -410,41 +475,55 @@ TideCalc::getStationLocation(const QString &station, double *lat, double *lon)
 }
 
 
-int
-TideCalc::findTide(const QString &station, double jtime, float *tideheight)
+/*
+ * The location was read when the ID was allocated.
+ */
+bool
+TideCalc::getStationLocation(int id, double *lat, double *lon)
 {
-	TideCalcStation *tcsp;
+	*lat = stations[id].lat;
+	*lon = stations[id].lon;
+	return stations[id].known;
+}
 
-	// Find station in dictionary if present
-	tcsp = stationdict.find(station);
 
-	// If not present then create one and add it to the dictionary
-	if (tcsp == 0)
-	{
-		tcsp = new TideCalcStation(station, jtime);
-		stationdict.insert(station, tcsp);
-	}
+int
+TideCalc::findTide(int id, double jtime, float *tideheight)
+{
+	Station &sta = stations[id];
+
+	// If not calculated before then create one
+	if (sta.calc == 0)
+		sta.calc = new TideCalcStation(sta.name, jtime);
 
-	return tcsp->findTide(jtime, tideheight);
+	return sta.calc->findTide(jtime, tideheight);
 }
 
 
 int
-TideCalc::findNearestHighWater(const QString &station, double jtime, float *tideheight, double *jtimeHW)
+TideCalc::findNearestHighWater(int id, double jtime, float *tideheight, double *jtimeHW)
 {
-	TideCalcStation *tcsp;
+	Station &sta = stations[id];
 
-	// Find station in dictionary if present
-	tcsp = stationdict.find(station);
+	// If not calculated before then create one
+	if (sta.calc == 0)
+		sta.calc = new TideCalcStation(sta.name, jtime);
+
+	return sta.calc->findNearestHighWater(jtime, tideheight, jtimeHW);
+}
 
-	// If not present then create one and add it to the dictionary
-	if (tcsp == 0)
-	{
-		tcsp = new TideCalcStation(station, jtime);
-		stationdict.insert(station, tcsp);
-	}
 
-	return tcsp->findNearestHighWater(jtime, tideheight, jtimeHW);
+int
+TideCalc::findTide(const QString &station, double jtime, float *tideheight)
+{
+	return findTide(getStationId(station), jtime, tideheight);
+}
+
+
+int
+TideCalc::findNearestHighWater(const QString &station, double jtime, float *tideheight, double *jtimeHW)
+{
+	return findNearestHighWater(getStationId(station), jtime, tideheight, jtimeHW);
 }
 
 
@@ -474,14 +553,14 @@ MoonCalc::daysSinceNew(double jtime)
 	// changing by less than a minute each time our cache is fine.
 	if (fabs(jtime - lastjtime) < 1.0)
 	{
-		debugf(1, "MoonCalc::daysSinceNew(%s) %f (fast)\n", jctime(jtime), lastage);
+		TRACE("MoonCalc::daysSinceNew fast", jtime, lastage);
 		return lastage;
 	}
 
 	JD = jtime_to_JD(jtime);
 	lastage = moon_days_since_new(JD, &lunation_number);
 	lastjtime = jtime;
-		debugf(1, "MoonCalc::daysSinceNew(%s) %f (slow)\n", jctime(jtime), lastage);
+	TRACE("MoonCalc::daysSinceNew slow", jtime, lastage);
 	return lastage;
 }
 
@@ -1,4 +1,6 @@
 /* > tidecalc.h
+ * 1.02 arb Mon Oct 19 23:59:41 BST 2026 - an ID for each name, isSameStation
+ * 1.01 arb Mon Oct 19 14:12:37 BST 2026 - station IDs
  * 1.00 arb 
  */
 
@@ -7,7 +9,8 @@
 
 
 #include <qstring.h>
-#include <qdict.h>
+#include <qmap.h>
+#include <qvaluevector.h>
 
 
 #define TIDECALC_DAYS           8  // for 8 days:
@@ -25,6 +28,7 @@ public:
 	bool load(const QString &harmonicsFilename);
 	bool setStation(const QString &station); // can be called multiple times to get next matching station
 	bool getStationLocation(double *lat, double *lon);
+	int getStationNum() const { return stationOk ? currentStationNum : -1; }
 private:
 	int currentStationNum;
 	QString currentStationGivenName;
@@ -61,14 +65,33 @@ public:
 	~TideCalc();
 public:
 	bool loadTideDatabase(const QString &filename);
+	// Station IDs are resolved once from the name, then used for fast queries
+	int getStationId(const QString &station);
+	const QString &getStationName(int id) const { return stations[id].name; }
+	bool isStationKnown(int id) const { return stations[id].known; }
+	// Whether two IDs are the same station in the tide database
+	bool isSameStation(int id0, int id1) const { return id0 == id1 || (stations[id0].tcd >= 0 && stations[id0].tcd == stations[id1].tcd); }
+	bool getStationLocation(int id, double *lat, double *lon);
+	int findTide(int id, double jtime, float *tideheight);
+	int findNearestHighWater(int id, double jtime, float *tideheight, double *jtimeHW);
+	// Convenience versions which lookup the ID every time
 	bool getStationLocation(const QString &station, double *lat, double *lon);
 	int findTide(const QString &station, double jtime, float *tideheight);
 	int findNearestHighWater(const QString &station, double jtime, float *tideheight, double *jtimeHW);
 private:
+	struct Station
+	{
+		QString name;           // as given to getStationId
+		bool known;             // found in the tide database
+		int tcd;                // station number in the database, or -1
+		double lat, lon;
+		TideCalcStation *calc;  // created when first needed
+	};
 	QString harmonicsFilename;
 	TCD tidedatabase;
-	typedef QDict<TideCalcStation> TideCalcStationDict;
-	TideCalcStationDict stationdict;
+	QValueVector<Station> stations; // indexed by station ID
+	QMap<QString,int> nameids;      // each name to its station ID
+	QMap<int,int> tcdids;           // TCD station number to the first ID found there
 };
 
 
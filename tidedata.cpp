@@ -1,4 +1,18 @@
 /* > tidedata.cpp
+ * 1.18 arb Mon Oct 19 23:59:57 BST 2026 - stream set warns once per build of times out of range
+ * 1.17 arb Mon Oct 19 23:59:55 BST 2026 - particles kept in an area
+ * 1.16 arb Mon Oct 19 23:59:53 BST 2026 - stream field over an area, edge streams, one search per cell
+ * 1.15 arb Mon Oct 19 23:59:49 BST 2026 - streams keep only the tables, polynomials made when needed
+ * 1.14 arb Mon Oct 19 23:59:31 BST 2026 - table values exactly on the hour again
+ * 1.13 arb Mon Oct 19 23:59:23 BST 2026 - scalar stream field evaluates every point
+ * 1.12 arb Mon Oct 19 23:59:21 BST 2026 - scalar stream set evaluates every stream
+ * 1.11 arb Mon Oct 19 23:57:48 BST 2026 - particles carried by the stream field
+ * 1.10 arb Mon Oct 19 23:56:12 BST 2026 - stream field between the diamonds
+ * 1.09 arb Mon Oct 19 22:38:15 BST 2026 - trace instead of debugf when querying
+ * 1.08 arb Mon Oct 19 14:12:37 BST 2026 - streams grouped by reference station ID
+ * 1.07 arb Mon Oct 19 13:31:08 BST 2026 - records kept in TidalDataset with interned names
+ * 1.06 arb Mon Oct 19 12:20:51 BST 2026 - evaluate all streams together in TidalStreamSet
+ * 1.05 arb Mon Oct 19 11:02:16 BST 2026 - evaluate splines as hourly polynomials
  * 1.04 arb Sun Jul 11 13:45:25 BST 2010 - Rewrite parser
  * 1.03 arb Fri Jun 18 04:54:17 BST 2010 - interpolate between neap and spring
  * 1.02 arb Thu Jun 17 00:23:17 BST 2010 - interpolate via x,y
@@ -6,17 +20,44 @@
  * 1.00 arb Thu May 27 16:38:49 BST 2010
  */
 
-static const char SCCSid[] = "@(#)tidedata.cpp  1.04 (C) 2010 arb Load tidal data";
+static const char SCCSid[] = "@(#)tidedata.cpp  1.18 (C) 2010 arb Load tidal data";
 
 
 #include <stdio.h>
+#include <string.h>
 #include <math.h>
 #include <qstringlist.h>
+#include <qmap.h>
 #include "satlib/dundee.h" // for cspline and splint
+#include "trace.h"
 #include "tidedata.h"
 
+#ifdef __SSE2__
+#include <emmintrin.h>
+#define TIDALSTREAMSET_VECTOR 4  // floats per SSE register
+#else
+#define TIDALSTREAMSET_VECTOR 1
+#endif
+
 
 #define ISIGN(v) ((v) >= 0 ? 1 : -1)
+#define TIDE_MAX_LINE_LEN    512 // typically 450 bytes max
+
+
+/* ----------------------------------------------------------------------------
+ * TidalNames
+ */
+int
+TidalNames::intern(const QString &str)
+{
+	QMap<QString,int>::Iterator it = ids.find(str);
+	if (it != ids.end())
+		return it.data();
+	int id = names.count();
+	names.push_back(str);
+	ids[str] = id;
+	return id;
+}
 
 
 /* ----------------------------------------------------------------------------
@@ -26,12 +67,15 @@ static const char SCCSid[] = "@(#)tidedata.cpp  1.04 (C) 2010 arb Load tidal dat
  * BA1481 236 DUNDEE  56 27  -2 58   5.4  4.3  1.9  0.7  2.9   BELOW ORDNANCE DATUM    NEWLYN  DUSTIN       KT
  * sometimes you get datum and remarks being three 9999 then two DUSTIN
  */
-TidalLevel::TidalLevel(const QString &line)
+TidalLevel::TidalLevel(const QString &line, TidalNames *namelist)
 {
 	int num;
 	int adeg, amin, odeg, omin;
 
 	ok = false;
+	names = namelist;
+	chartId = nameId = 0;
+	station = -1;
 	lat = lon = 0;
 	mhws = mhwn = mlwn = mlws = 0;
 	current_level = 0;
@@ -39,9 +83,9 @@ TidalLevel::TidalLevel(const QString &line)
 	QStringList fields = QStringList::split('\t', line, true);
 	if (fields.count() < 11)
 		return;
-	chart = fields[0];
+	chartId = namelist->intern(fields[0]);
 	num = fields[1].toInt();
-	name = fields[2];
+	nameId = namelist->intern(fields[2]);
 	adeg = fields[3].toInt();
 	amin = fields[4].toInt();
 	odeg = fields[5].toInt();
@@ -66,7 +110,7 @@ TidalLevel::TidalLevel(const QString &line)
 const float TidalStream::hour[] = {0,1,2,3,4,5,6,7,8,9,10,11,12};
 const float TidalStream::cspline_natural = 1.0e30;
 
-TidalStream::TidalStream(const QString &line)
+TidalStream::TidalStream(const QString &line, TidalNames *namelist)
 {
 	int ii;
 	int num;
@@ -74,12 +118,14 @@ TidalStream::TidalStream(const QString &line)
 	float amin, omin;
 
 	ok = false;
+	names = namelist;
+	chartId = nameId = refId = 0;
+	refStation = -1;
+	refHW = true;
 	lat = lon = 0;
-	for (ii=0; ii<TIDALSTREAM_NUMRATES; ii++)
-	{
-		bearing[ii] = 0;
-		springRate[ii] = neapRate[ii] = 0;
-	}
+	memset(bearing, 0, sizeof(bearing));
+	memset(springRate, 0, sizeof(springRate));
+	memset(neapRate, 0, sizeof(neapRate));
 	current_bearing = 0;
 	current_rate = 0;
 
@@ -87,11 +133,11 @@ TidalStream::TidalStream(const QString &line)
 	if (fields.count() < 9 + 3*TIDALSTREAM_NUMRATES)
 		return;
 
-	chart = fields[0];
+	chartId = namelist->intern(fields[0]);
 	refHW = (fields[1].left(1) == 'H'); // "HW", or "LW" for LE HAVRE
-	ref   = fields[2];
+	refId = namelist->intern(fields[2]);
 	num   = fields[3].toInt();
-	name  = fields[4];
+	nameId = namelist->intern(fields[4]);
 	adeg  = fields[5].toInt();
 	amin  = fields[6].toDouble();
 	odeg  = fields[7].toInt();
@@ -105,40 +151,64 @@ TidalStream::TidalStream(const QString &line)
 		neapRate[ii]   = fields[9 + ii*6 + 2].toDouble();
 	}
 
-	// Calculate interpolation coefficients
-	cspline(hour, bearing,    TIDALSTREAM_NUMRATES, cspline_natural, cspline_natural, bearing_coeff);
-	cspline(hour, springRate, TIDALSTREAM_NUMRATES, cspline_natural, cspline_natural, spring_coeff);
-	cspline(hour, neapRate,   TIDALSTREAM_NUMRATES, cspline_natural, cspline_natural, neap_coeff);
+	ok = true;
+}
+
+
+/*
+ * Calculate interpolation coefficients for one of the x,y components.
+ * The knots are every hour so the spline between hour j and j+1 is
+ *   y = A*y[j] + B*y[j+1] + ((A^3-A)*y2[j] + (B^3-B)*y2[j+1])/6
+ * where B=t, A=1-t, which is rearranged into a cubic polynomial
+ * c0+c1*t+c2*t*t+c3*t*t*t for each hour, t=0..1 within the hour,
+ * so it can be evaluated without searching for the interval.
+ */
+void
+TidalStream::makePolynomials(int component, float poly[TIDALSTREAM_NUMINTERVALS][4]) const
+{
+	float yy[TIDALSTREAM_NUMRATES];
+	float coeff[TIDALSTREAM_NUMRATES];
+	int ii;
+
 	for (ii=0; ii<TIDALSTREAM_NUMRATES; ii++)
 	{
-		xspring[ii] = sin(RAD(bearing[ii])) * springRate[ii];
-		xneap[ii]   = sin(RAD(bearing[ii])) * neapRate[ii];
-		yspring[ii] = cos(RAD(bearing[ii])) * springRate[ii];
-		yneap[ii]   = cos(RAD(bearing[ii])) * neapRate[ii];
+		float rate = (component == XSPRING || component == YSPRING) ? springRate[ii] : neapRate[ii];
+		if (component == XSPRING || component == XNEAP)
+			yy[ii] = sin(RAD(bearing[ii])) * rate;
+		else
+			yy[ii] = cos(RAD(bearing[ii])) * rate;
+	}
+	cspline(hour, yy, TIDALSTREAM_NUMRATES, cspline_natural, cspline_natural, coeff);
+	for (ii=0; ii<TIDALSTREAM_NUMINTERVALS; ii++)
+	{
+		poly[ii][0] = yy[ii];
+		poly[ii][1] = (yy[ii+1] - yy[ii]) - (2.0 * coeff[ii] + coeff[ii+1]) / 6.0;
+		poly[ii][2] = coeff[ii] / 2.0;
+		poly[ii][3] = (coeff[ii+1] - coeff[ii]) / 6.0;
 	}
-	cspline(hour, xspring, TIDALSTREAM_NUMRATES, cspline_natural, cspline_natural, xspring_coeff);
-	cspline(hour, yspring, TIDALSTREAM_NUMRATES, cspline_natural, cspline_natural, yspring_coeff);
-	cspline(hour, xneap,   TIDALSTREAM_NUMRATES, cspline_natural, cspline_natural, xneap_coeff);
-	cspline(hour, yneap,   TIDALSTREAM_NUMRATES, cspline_natural, cspline_natural, yneap_coeff);
-
-	ok = true;
 }
 
 
 /*
  * Given a time difference from HW at the reference station
  * return the bearing of the stream and its rate at spring/neap tide.
- * The value is interpolated from the table unless the time is exactly
- * on the hour. Range of mins is -6 hours to +6 hours.
+ * Exactly on the hour the table values are returned, bearing 0..360 and
+ * the tabulated bearing at slack water, otherwise the value is interpolated
+ * using the polynomial for that hour, the bearing being -180..180.
+ * The polynomials are worked out on every call as the stream doesn't keep
+ * them, so use TidalStreamSet to evaluate many streams or times.
+ * Range of mins is -6 hours to +6 hours.
+ * Any of the return pointers can be null if that value is not wanted,
+ * which saves the cost of the atan2 or sqrt.
  */
 bool
 TidalStream::getStreamMinsFromRef(double mins, float *pbearing, float *pspringRate, float *pneapRate)
 {
-	debugf(1, "TidalStream %s query %f hours from HW\n", (const char*)name, mins/60.0);
+	TRACE("TidalStream query mins", mins, 0);
 	if (mins < -6 * 60 || mins > 6 * 60)
 	{
 		// XXX
-		if (mins < -7 * 60 || mins > 7 * 60) { fprintf(stderr, "WARNING asking for tide at offset %f hrs\n",mins/60.0); *pbearing=0; *pspringRate=0; *pneapRate=0; return false; }
+		if (mins < -7 * 60 || mins > 7 * 60) { fprintf(stderr, "WARNING asking for tide at offset %f hrs\n",mins/60.0); if (pbearing) *pbearing=0; if (pspringRate) *pspringRate=0; if (pneapRate) *pneapRate=0; return false; }
 		if (mins < -6 * 60) mins = -6*60;
 		if (mins >  6 * 60) mins =  6*60; // XXX extrapolate don't clip
 	}
@@ -148,28 +218,46 @@ TidalStream::getStreamMinsFromRef(double mins, float *pbearing, float *pspringRa
 	// See if we can return without interpolation
 	if (fmod(mins, 60) == 0)
 	{
-		*pbearing = bearing[index];
-		*pspringRate = springRate[index];
-		*pneapRate = neapRate[index];
+		if (pbearing)
+			*pbearing = bearing[index];
+		if (pspringRate)
+			*pspringRate = springRate[index];
+		if (pneapRate)
+			*pneapRate = neapRate[index];
+		TRACE("TidalStream query index", index, 0);
 		return true;
 	}
 	// Interpolate between this one and the next one
-#if 0
-	*pbearing    = splint(hour, bearing,    bearing_coeff, TIDALSTREAM_NUMRATES, 0, mins/60.0);
-	*pspringRate = splint(hour, springRate, spring_coeff,  TIDALSTREAM_NUMRATES, 0, mins/60.0);
-	*pneapRate   = splint(hour, neapRate,   neap_coeff,    TIDALSTREAM_NUMRATES, 0, mins/60.0);
-#endif
+	// using the polynomial for this hour (+6 hours is the end of the last one)
+	if (index >= TIDALSTREAM_NUMINTERVALS)
+		index = TIDALSTREAM_NUMINTERVALS-1;
+	float t = mins / 60.0 - index;
+#define HORNER(p) (((p[3] * t + p[2]) * t + p[1]) * t + p[0])
 	float xspringval, xneapval, yspringval, yneapval;
-	xspringval = splint(hour, xspring,  xspring_coeff, TIDALSTREAM_NUMRATES, 0, mins/60.0);
-	yspringval = splint(hour, yspring,  yspring_coeff, TIDALSTREAM_NUMRATES, 0, mins/60.0);
-	xneapval   = splint(hour, xneap,    xneap_coeff,   TIDALSTREAM_NUMRATES, 0, mins/60.0);
-	yneapval   = splint(hour, yneap,    yneap_coeff,   TIDALSTREAM_NUMRATES, 0, mins/60.0);
-	// XXX calculate bearing using xspring/yspring OR xneap/yneap ???
-	// XXX need to interpolate as the given time will be between spring and neap tide!!!
-	*pbearing = DEG(atan2(xspringval, yspringval));
-	*pspringRate = sqrt(xspringval*xspringval + yspringval*yspringval);
-	*pneapRate   = sqrt(xneapval*xneapval + yneapval*yneapval);
-	debugf(1, "  mins %f index %d bearing %f rate %f/%f\n", mins, index, *pbearing, *pspringRate, *pneapRate);
+	float xpoly[TIDALSTREAM_NUMINTERVALS][4], ypoly[TIDALSTREAM_NUMINTERVALS][4];
+	if (pbearing || pspringRate)
+	{
+		makePolynomials(XSPRING, xpoly);
+		makePolynomials(YSPRING, ypoly);
+		xspringval = HORNER(xpoly[index]);
+		yspringval = HORNER(ypoly[index]);
+		// XXX calculate bearing using xspring/yspring OR xneap/yneap ???
+		// XXX need to interpolate as the given time will be between spring and neap tide!!!
+		if (pbearing)
+			*pbearing = DEG(atan2(xspringval, yspringval));
+		if (pspringRate)
+			*pspringRate = sqrt(xspringval*xspringval + yspringval*yspringval);
+	}
+	if (pneapRate)
+	{
+		makePolynomials(XNEAP, xpoly);
+		makePolynomials(YNEAP, ypoly);
+		xneapval = HORNER(xpoly[index]);
+		yneapval = HORNER(ypoly[index]);
+		*pneapRate = sqrt(xneapval*xneapval + yneapval*yneapval);
+	}
+#undef HORNER
+	TRACE("TidalStream query index", index, t);
 	return true;
 }
 
@@ -191,12 +279,770 @@ TidalStream::getStreamMinsFromRefAndMoon(double minsfromref, double fractionFrom
 		*bearing = current_bearing;
 	if (rate)
 		*rate = current_rate;
-	debugf(1, "  rate %f at phase fraction %f\n", current_rate, fractionFromSpring);
+	TRACE("TidalStream rate", current_rate, fractionFromSpring);
 
 	return rc;
 }
 
 
+/* ----------------------------------------------------------------------------
+ * TidalStreamSet
+ */
+TidalStreamSet::TidalStreamSet()
+{
+	num = capacity = 0;
+	streams = 0;
+	memory = 0;
+	coeffs = hours = bearing = rate = 0;
+	interval = valid = 0;
+	warned = false;
+}
+
+
+TidalStreamSet::~TidalStreamSet()
+{
+	delete [] streams;
+	delete [] memory;
+}
+
+
+/*
+ * Allocate all the arrays in one block aligned for SIMD loads,
+ * only if the previous allocation is too small.
+ */
+void
+TidalStreamSet::allocate(int n)
+{
+	int cap = (n + TIDALSTREAMSET_VECTOR-1) / TIDALSTREAMSET_VECTOR * TIDALSTREAMSET_VECTOR;
+	if (cap > capacity || memory == 0)
+	{
+		delete [] streams;
+		delete [] memory;
+		capacity = QMAX(cap, TIDALSTREAMSET_VECTOR);
+		int ncoeffs = TIDALSTREAM_NUMCOMPONENTS * TIDALSTREAM_NUMINTERVALS * 4;
+		streams = new TidalStream*[capacity];
+		memory = new char[(ncoeffs + 5) * capacity * sizeof(float) + 16];
+		float *p = (float*)(((unsigned long)memory + 15) & ~15UL);
+		coeffs   = p; p += ncoeffs * capacity;
+		hours    = p; p += capacity;
+		interval = (int*)p; p += capacity;
+		valid    = (int*)p; p += capacity;
+		bearing  = p; p += capacity;
+		rate     = p; p += capacity;
+	}
+	// Unused lanes at the end evaluate harmlessly to zero
+	memset(coeffs, 0, TIDALSTREAM_NUMCOMPONENTS * TIDALSTREAM_NUMINTERVALS * 4 * capacity * sizeof(float));
+	for (int ii=0; ii<capacity; ii++)
+	{
+		streams[ii] = 0;
+		hours[ii] = 0;
+		interval[ii] = valid[ii] = 0;
+		bearing[ii] = rate[ii] = 0;
+	}
+}
+
+
+float *
+TidalStreamSet::coeff(int component, int ii, int power) const
+{
+	return coeffs + ((component * TIDALSTREAM_NUMINTERVALS + ii) * 4 + power) * capacity;
+}
+
+
+/*
+ * Work out the polynomial coefficients of all the streams in the list,
+ * which are only kept here, grouping together the streams which share
+ * a reference station.
+ */
+void
+TidalStreamSet::build(const QValueVector<TidalStream*> &list)
+{
+	QMap<int,int> group;
+	TidalStream *tsp;
+	float poly[TIDALSTREAM_NUMINTERVALS][4];
+	int gg, cc, ii, pp, nn;
+
+	allocate(list.count());
+	for (nn=0; nn<(int)list.count(); nn++)
+	{
+		if (!group.contains(list[nn]->refStation))
+			group[list[nn]->refStation] = group.count();
+	}
+	num = 0;
+	for (gg=0; gg<(int)group.count(); gg++)
+	{
+		for (nn=0; nn<(int)list.count(); nn++)
+		{
+			tsp = list[nn];
+			if (group[tsp->refStation] != gg)
+				continue;
+			for (cc=0; cc<TIDALSTREAM_NUMCOMPONENTS; cc++)
+			{
+				tsp->makePolynomials(cc, poly);
+				for (ii=0; ii<TIDALSTREAM_NUMINTERVALS; ii++)
+					for (pp=0; pp<4; pp++)
+						coeff(cc, ii, pp)[num] = poly[ii][pp];
+			}
+			streams[num++] = tsp;
+		}
+	}
+	warned = false;
+	debugf(1, "TidalStreamSet %d streams in %d groups\n", num, (int)group.count());
+}
+
+
+/*
+ * Set the time of one stream relative to HW at its reference port,
+ * with the same range checks as TidalStream::getStreamMinsFromRef.
+ * A stream out of range gives nothing; as this is called for every stream
+ * for every frame the warning is only given once until the next build.
+ */
+void
+TidalStreamSet::setMinsFromRef(int ii, double mins)
+{
+	valid[ii] = ~0;
+	if (mins < -6 * 60 || mins > 6 * 60)
+	{
+		if (mins < -7 * 60 || mins > 7 * 60)
+		{
+			if (!warned)
+				fprintf(stderr, "WARNING asking for tide at offset %f hrs (stream %d)\n", mins/60.0, ii);
+			warned = true;
+			valid[ii] = 0;
+		}
+		if (mins < -6 * 60) mins = -6*60;
+		if (mins >  6 * 60) mins =  6*60; // XXX extrapolate don't clip
+	}
+	mins += 6 * 60;
+	int index = (int)(mins / 60.0);
+	if (index >= TIDALSTREAM_NUMINTERVALS)
+		index = TIDALSTREAM_NUMINTERVALS-1;
+	interval[ii] = index;
+	hours[ii] = mins / 60.0 - index;
+}
+
+
+/*
+ * Calculate the bearing and rate of every stream for the times given
+ * by setMinsFromRef, interpolating between spring and neap rates in the
+ * same way as TidalStream::getStreamMinsFromRefAndMoon, including using
+ * the table values when exactly on the hour.
+ */
+void
+TidalStreamSet::evaluate(double fractionFromSpring)
+{
+	float blend = cos(PI/2.0 * (fractionFromSpring));
+	int ii;
+
+	// The arrays are padded so the last vector can be partly empty
+#ifdef __SSE2__
+	for (ii=0; ii<num; ii+=TIDALSTREAMSET_VECTOR)
+		evaluateVector(ii, blend);
+#else
+	for (ii=0; ii<num; ii++)
+		evaluateScalar(ii, blend);
+#endif
+	for (ii=0; ii<num; ii++)
+	{
+		if (!valid[ii] || (hours[ii] != 0 && hours[ii] != 1))
+			continue;
+		const TidalStream *tsp = streams[ii];
+		int index = interval[ii] + (int)hours[ii];
+		bearing[ii] = tsp->bearing[index];
+		rate[ii] = tsp->neapRate[index] + (tsp->springRate[index] - tsp->neapRate[index]) * blend;
+	}
+}
+
+
+void
+TidalStreamSet::evaluateScalar(int ii, float blend)
+{
+	float t = hours[ii];
+	float val[TIDALSTREAM_NUMCOMPONENTS];
+	for (int cc=0; cc<TIDALSTREAM_NUMCOMPONENTS; cc++)
+	{
+		int jj = interval[ii];
+		val[cc] = ((coeff(cc,jj,3)[ii] * t + coeff(cc,jj,2)[ii]) * t + coeff(cc,jj,1)[ii]) * t + coeff(cc,jj,0)[ii];
+	}
+	float springRate = sqrt(val[TidalStream::XSPRING]*val[TidalStream::XSPRING] + val[TidalStream::YSPRING]*val[TidalStream::YSPRING]);
+	float neapRate   = sqrt(val[TidalStream::XNEAP]*val[TidalStream::XNEAP] + val[TidalStream::YNEAP]*val[TidalStream::YNEAP]);
+	bearing[ii] = valid[ii] ? DEG(atan2(val[TidalStream::XSPRING], val[TidalStream::YSPRING])) : 0;
+	rate[ii]    = valid[ii] ? neapRate + (springRate - neapRate) * blend : 0;
+}
+
+
+#ifdef __SSE2__
+/*
+ * atan2(y,x) for four values, accurate to about 0.01 degrees which is
+ * far better than the tidal stream tables.
+ */
+static inline __m128
+atan2_ps(__m128 y, __m128 x)
+{
+	const __m128 signbit = _mm_set1_ps(-0.0f);
+	__m128 ax = _mm_andnot_ps(signbit, x);
+	__m128 ay = _mm_andnot_ps(signbit, y);
+	__m128 mx = _mm_max_ps(ax, ay);
+	__m128 mn = _mm_min_ps(ax, ay);
+	// Avoid 0/0 when both are zero
+	__m128 a = _mm_div_ps(mn, _mm_max_ps(mx, _mm_set1_ps(1.0e-30f)));
+	__m128 s = _mm_mul_ps(a, a);
+	__m128 r = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(-0.0464964749f), s), _mm_set1_ps(0.15931422f));
+	r = _mm_sub_ps(_mm_mul_ps(r, s), _mm_set1_ps(0.327622764f));
+	r = _mm_add_ps(_mm_mul_ps(_mm_mul_ps(r, s), a), a);
+	// Undo the reductions to the first octant
+	__m128 swap = _mm_cmpgt_ps(ay, ax);
+	r = _mm_or_ps(_mm_and_ps(swap, _mm_sub_ps(_mm_set1_ps((float)(PI/2.0)), r)), _mm_andnot_ps(swap, r));
+	__m128 xneg = _mm_cmplt_ps(x, _mm_setzero_ps());
+	r = _mm_or_ps(_mm_and_ps(xneg, _mm_sub_ps(_mm_set1_ps((float)PI), r)), _mm_andnot_ps(xneg, r));
+	return _mm_or_ps(r, _mm_and_ps(signbit, y));
+}
+
+
+void
+TidalStreamSet::evaluateVector(int ii, float blend)
+{
+	__m128 t = _mm_load_ps(hours + ii);
+	__m128 val[TIDALSTREAM_NUMCOMPONENTS];
+	int j0 = interval[ii], j1 = interval[ii+1], j2 = interval[ii+2], j3 = interval[ii+3];
+	bool same = (j0 == j1 && j0 == j2 && j0 == j3);
+	for (int cc=0; cc<TIDALSTREAM_NUMCOMPONENTS; cc++)
+	{
+		__m128 cp[4];
+		for (int pp=0; pp<4; pp++)
+		{
+			// Streams with the same reference port share an interval so
+			// usually it's a straight load otherwise gather each lane
+			if (same)
+				cp[pp] = _mm_load_ps(coeff(cc,j0,pp) + ii);
+			else
+				cp[pp] = _mm_setr_ps(coeff(cc,j0,pp)[ii], coeff(cc,j1,pp)[ii+1],
+					coeff(cc,j2,pp)[ii+2], coeff(cc,j3,pp)[ii+3]);
+		}
+		val[cc] = _mm_add_ps(_mm_mul_ps(_mm_add_ps(_mm_mul_ps(_mm_add_ps(_mm_mul_ps(cp[3], t), cp[2]), t), cp[1]), t), cp[0]);
+	}
+	__m128 xs = val[TidalStream::XSPRING], ys = val[TidalStream::YSPRING];
+	__m128 xn = val[TidalStream::XNEAP],   yn = val[TidalStream::YNEAP];
+	__m128 springRate = _mm_sqrt_ps(_mm_add_ps(_mm_mul_ps(xs, xs), _mm_mul_ps(ys, ys)));
+	__m128 neapRate   = _mm_sqrt_ps(_mm_add_ps(_mm_mul_ps(xn, xn), _mm_mul_ps(yn, yn)));
+	__m128 r = _mm_add_ps(neapRate, _mm_mul_ps(_mm_sub_ps(springRate, neapRate), _mm_set1_ps(blend)));
+	__m128 b = _mm_mul_ps(atan2_ps(xs, ys), _mm_set1_ps((float)(180.0/PI)));
+	__m128 ok = _mm_castsi128_ps(_mm_load_si128((const __m128i*)(valid + ii)));
+	_mm_store_ps(rate + ii,    _mm_and_ps(ok, r));
+	_mm_store_ps(bearing + ii, _mm_and_ps(ok, b));
+}
+#endif
+
+
+/* ----------------------------------------------------------------------------
+ * TidalStreamField
+ */
+TidalStreamField::TidalStreamField()
+{
+	left = top = spacing = columns = rows = 0;
+	num = capacity = 0;
+	radius = 0;
+	nstreams = bucketColumns = bucketRows = 0;
+	streamX = streamY = 0;
+	memory = 0;
+	cell = neighbour = 0;
+	weight = east = north = bearing = rate = 0;
+}
+
+
+TidalStreamField::~TidalStreamField()
+{
+	delete [] memory;
+}
+
+
+/*
+ * As TidalStreamSet::allocate, only reallocates if too small
+ */
+void
+TidalStreamField::allocate(int n)
+{
+	int cap = (n + TIDALSTREAMSET_VECTOR-1) / TIDALSTREAMSET_VECTOR * TIDALSTREAMSET_VECTOR;
+	if (cap > capacity || memory == 0)
+	{
+		delete [] memory;
+		capacity = QMAX(cap, TIDALSTREAMSET_VECTOR);
+		memory = new char[(TIDALFIELD_NEIGHBOURS * 2 + 5) * capacity * sizeof(float) + 16];
+		float *p = (float*)(((unsigned long)memory + 15) & ~15UL);
+		cell      = (int*)p; p += capacity;
+		neighbour = (int*)p; p += TIDALFIELD_NEIGHBOURS * capacity;
+		weight    = p; p += TIDALFIELD_NEIGHBOURS * capacity;
+		east      = p; p += capacity;
+		north     = p; p += capacity;
+		bearing   = p; p += capacity;
+		rate      = p; p += capacity;
+	}
+	// Unused neighbours and lanes at the end evaluate harmlessly to zero
+	memset(neighbour, 0, TIDALFIELD_NEIGHBOURS * capacity * sizeof(int));
+	memset(weight, 0, TIDALFIELD_NEIGHBOURS * capacity * sizeof(float));
+	for (int ii=0; ii<capacity; ii++)
+	{
+		cell[ii] = -1;
+		east[ii] = north[ii] = bearing[ii] = rate[ii] = 0;
+	}
+}
+
+
+/*
+ * Find up to TIDALFIELD_NEIGHBOURS of the streams nearest to px,py within
+ * the radius, nearest first, by looking in the buckets around it.
+ * px,py are relative to the top left of the area.
+ */
+int
+TidalStreamField::nearest(float px, float py, int *found, float *dist) const
+{
+	int bx = (int)(px / radius), by = (int)(py / radius);
+	int nfound = 0, xx, yy, kk, ss;
+
+	for (yy=QMAX(0, by-1); yy<=QMIN(bucketRows-1, by+1); yy++)
+	{
+		for (xx=QMAX(0, bx-1); xx<=QMIN(bucketColumns-1, bx+1); xx++)
+		{
+			for (ss=bucketFirst[yy * bucketColumns + xx]; ss>=0; ss=bucketNext[ss])
+			{
+				float dx = streamX[ss] - left - px, dy = streamY[ss] - top - py;
+				float d = sqrt(dx*dx + dy*dy);
+				if (d >= radius)
+					continue;
+				// Insert in order, dropping the furthest when full
+				for (kk=nfound; kk>0 && dist[kk-1] > d; kk--)
+				{
+					if (kk < TIDALFIELD_NEIGHBOURS)
+					{
+						dist[kk] = dist[kk-1];
+						found[kk] = found[kk-1];
+					}
+				}
+				if (kk < TIDALFIELD_NEIGHBOURS)
+				{
+					dist[kk] = d;
+					found[kk] = ss;
+					if (nfound < TIDALFIELD_NEIGHBOURS)
+						nfound++;
+				}
+			}
+		}
+	}
+	return nfound;
+}
+
+
+/*
+ * The streams are at x,y in the image, the area being width by height
+ * pixels from left,top.  The points are at the middle of cells spacing
+ * pixels square from the top left of the area.
+ */
+void
+TidalStreamField::build(int ns, const float *x, const float *y, int l, int t, int width, int height, int sp, float rad)
+{
+	int found[TIDALFIELD_NEIGHBOURS];
+	float dist[TIDALFIELD_NEIGHBOURS];
+	int nfound, col, row, kk, ii;
+
+	left = l;
+	top = t;
+	spacing = QMAX(1, sp);
+	columns = (width + spacing-1) / spacing;
+	rows = (height + spacing-1) / spacing;
+	radius = QMAX(1.0f, rad);
+	nstreams = ns;
+	streamX = x;
+	streamY = y;
+
+	// Put each stream in its bucket, the buckets are as large as the
+	// radius so only the neighbouring buckets need to be searched.
+	// Streams off the area but within the radius of it go in the bucket
+	// at the edge, which is still within a bucket of the points they reach.
+	bucketColumns = (int)(columns * spacing / radius) + 1;
+	bucketRows = (int)(rows * spacing / radius) + 1;
+	bucketFirst.resize(bucketColumns * bucketRows);
+	for (ii=0; ii<bucketColumns * bucketRows; ii++)
+		bucketFirst[ii] = -1;
+	bucketNext.resize(nstreams);
+	for (ii=0; ii<nstreams; ii++)
+	{
+		bucketNext[ii] = -1;
+		float sx = x[ii] - left, sy = y[ii] - top;
+		if (sx <= -radius || sy <= -radius || sx >= columns * spacing + radius || sy >= rows * spacing + radius)
+			continue;
+		int bx = QMAX(0, QMIN(bucketColumns-1, (int)floor(sx / radius)));
+		int by = QMAX(0, QMIN(bucketRows-1, (int)floor(sy / radius)));
+		bucketNext[ii] = bucketFirst[by * bucketColumns + bx];
+		bucketFirst[by * bucketColumns + bx] = ii;
+	}
+
+	// The arrays are allocated once for a point in every cell (the area is
+	// only about the size of the view), with one more which stays empty
+	// for sampling where there are none
+	allocate(columns * rows + 1);
+	cellPoint.resize(columns * rows);
+	for (ii=0; ii<columns * rows; ii++)
+		cellPoint[ii] = columns * rows;
+
+	num = 0;
+	for (row=0; row<rows; row++)
+	{
+		for (col=0; col<columns; col++)
+		{
+			nfound = nearest((col + 0.5f) * spacing, (row + 0.5f) * spacing, found, dist);
+			if (nfound == 0)
+				continue;
+			float total = 0;
+			for (kk=0; kk<nfound; kk++)
+			{
+				float d = QMAX(dist[kk], 1.0f);
+				float w = (radius - d) / (radius * d);
+				dist[kk] = w * w;
+				total += dist[kk];
+			}
+			for (kk=0; kk<nfound; kk++)
+			{
+				neighbour[kk * capacity + num] = found[kk];
+				weight[kk * capacity + num] = dist[kk] / total;
+			}
+			cell[num] = row * columns + col;
+			cellPoint[row * columns + col] = num++;
+		}
+	}
+	// The empty point follows the last one
+	for (ii=0; ii<columns * rows; ii++)
+		if (cellPoint[ii] == columns * rows)
+			cellPoint[ii] = num;
+	streamX = streamY = 0;
+	debugf(1, "TidalStreamField %d x %d has %d points from %d streams\n", columns, rows, num, nstreams);
+}
+
+
+/*
+ * Find the stream at every point from the east and north components of
+ * the streams.
+ */
+void
+TidalStreamField::evaluate(const float *streamEast, const float *streamNorth)
+{
+	int ii;
+
+	TRACE("TidalStreamField::evaluate", num, 0);
+#ifdef __SSE2__
+	for (ii=0; ii<num; ii+=TIDALSTREAMSET_VECTOR)
+		evaluateVector(ii, streamEast, streamNorth);
+#else
+	for (ii=0; ii<num; ii++)
+		evaluateScalar(ii, streamEast, streamNorth);
+#endif
+}
+
+
+void
+TidalStreamField::evaluateScalar(int ii, const float *streamEast, const float *streamNorth)
+{
+	float e = 0, n = 0;
+	for (int kk=0; kk<TIDALFIELD_NEIGHBOURS; kk++)
+	{
+		float w = weight[kk * capacity + ii];
+		int ss = neighbour[kk * capacity + ii];
+		e += w * streamEast[ss];
+		n += w * streamNorth[ss];
+	}
+	east[ii] = e;
+	north[ii] = n;
+	rate[ii] = sqrt(e*e + n*n);
+	bearing[ii] = DEG(atan2(e, n));
+}
+
+
+#ifdef __SSE2__
+void
+TidalStreamField::evaluateVector(int ii, const float *streamEast, const float *streamNorth)
+{
+	__m128 e = _mm_setzero_ps(), n = _mm_setzero_ps();
+	for (int kk=0; kk<TIDALFIELD_NEIGHBOURS; kk++)
+	{
+		// The streams are gathered, the weights are a straight load
+		__m128 w = _mm_load_ps(weight + kk * capacity + ii);
+		const int *ss = neighbour + kk * capacity + ii;
+		e = _mm_add_ps(e, _mm_mul_ps(w, _mm_setr_ps(streamEast[ss[0]], streamEast[ss[1]], streamEast[ss[2]], streamEast[ss[3]])));
+		n = _mm_add_ps(n, _mm_mul_ps(w, _mm_setr_ps(streamNorth[ss[0]], streamNorth[ss[1]], streamNorth[ss[2]], streamNorth[ss[3]])));
+	}
+	_mm_store_ps(east + ii, e);
+	_mm_store_ps(north + ii, n);
+	_mm_store_ps(rate + ii, _mm_sqrt_ps(_mm_add_ps(_mm_mul_ps(e, e), _mm_mul_ps(n, n))));
+	_mm_store_ps(bearing + ii, _mm_mul_ps(atan2_ps(e, n), _mm_set1_ps((float)(180.0/PI))));
+}
+#endif
+
+
+inline int
+TidalStreamField::pointAt(int col, int row) const
+{
+	if (col < 0 || row < 0 || col >= columns || row >= rows)
+		return num;
+	return cellPoint[row * columns + col];
+}
+
+
+/*
+ * Bilinear interpolation between the four points around each position.
+ * The weights are found four positions at a time, the points gathered.
+ */
+void
+TidalStreamField::sample(int n, const float *x, const float *y, float *sampleEast, float *sampleNorth) const
+{
+	int ii = 0, kk;
+
+	if (num == 0)
+	{
+		for (ii=0; ii<n; ii++)
+			sampleEast[ii] = sampleNorth[ii] = 0;
+		return;
+	}
+#ifdef __SSE2__
+	const __m128 inv = _mm_set1_ps(1.0f / spacing), half = _mm_set1_ps(0.5f), one = _mm_set1_ps(1.0f);
+	const __m128 ox = _mm_set1_ps((float)left), oy = _mm_set1_ps((float)top);
+	for (; ii+4<=n; ii+=4)
+	{
+		// Conversion rounds towards zero so it only floors positive numbers,
+		// everything more than a cell off the top or left is empty anyway
+		__m128 gx = _mm_max_ps(_mm_sub_ps(_mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(x + ii), ox), inv), half), _mm_sub_ps(_mm_setzero_ps(), one));
+		__m128 gy = _mm_max_ps(_mm_sub_ps(_mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(y + ii), oy), inv), half), _mm_sub_ps(_mm_setzero_ps(), one));
+		__m128i cx = _mm_cvttps_epi32(_mm_add_ps(gx, one));
+		__m128i cy = _mm_cvttps_epi32(_mm_add_ps(gy, one));
+		__m128 fx = _mm_sub_ps(_mm_add_ps(gx, one), _mm_cvtepi32_ps(cx));
+		__m128 fy = _mm_sub_ps(_mm_add_ps(gy, one), _mm_cvtepi32_ps(cy));
+		int col[4], row[4];
+		_mm_storeu_si128((__m128i*)col, cx);
+		_mm_storeu_si128((__m128i*)row, cy);
+		float e[4][4], nn[4][4];  // [corner][lane]
+		for (kk=0; kk<4; kk++)
+		{
+			int p00 = pointAt(col[kk]-1, row[kk]-1), p10 = pointAt(col[kk], row[kk]-1);
+			int p01 = pointAt(col[kk]-1, row[kk]),   p11 = pointAt(col[kk], row[kk]);
+			e[0][kk] = east[p00];  e[1][kk] = east[p10];  e[2][kk] = east[p01];  e[3][kk] = east[p11];
+			nn[0][kk] = north[p00]; nn[1][kk] = north[p10]; nn[2][kk] = north[p01]; nn[3][kk] = north[p11];
+		}
+		__m128 e0 = _mm_add_ps(_mm_loadu_ps(e[0]), _mm_mul_ps(fx, _mm_sub_ps(_mm_loadu_ps(e[1]), _mm_loadu_ps(e[0]))));
+		__m128 e1 = _mm_add_ps(_mm_loadu_ps(e[2]), _mm_mul_ps(fx, _mm_sub_ps(_mm_loadu_ps(e[3]), _mm_loadu_ps(e[2]))));
+		__m128 n0 = _mm_add_ps(_mm_loadu_ps(nn[0]), _mm_mul_ps(fx, _mm_sub_ps(_mm_loadu_ps(nn[1]), _mm_loadu_ps(nn[0]))));
+		__m128 n1 = _mm_add_ps(_mm_loadu_ps(nn[2]), _mm_mul_ps(fx, _mm_sub_ps(_mm_loadu_ps(nn[3]), _mm_loadu_ps(nn[2]))));
+		_mm_storeu_ps(sampleEast + ii,  _mm_add_ps(e0, _mm_mul_ps(fy, _mm_sub_ps(e1, e0))));
+		_mm_storeu_ps(sampleNorth + ii, _mm_add_ps(n0, _mm_mul_ps(fy, _mm_sub_ps(n1, n0))));
+	}
+#endif
+	for (; ii<n; ii++)
+	{
+		float gx = (x[ii] - left) / spacing - 0.5f, gy = (y[ii] - top) / spacing - 0.5f;
+		int col = (int)floor(gx), row = (int)floor(gy);
+		float fx = gx - col, fy = gy - row;
+		int p00 = pointAt(col, row),   p10 = pointAt(col+1, row);
+		int p01 = pointAt(col, row+1), p11 = pointAt(col+1, row+1);
+		float e0 = east[p00] + fx * (east[p10] - east[p00]);
+		float e1 = east[p01] + fx * (east[p11] - east[p01]);
+		float n0 = north[p00] + fx * (north[p10] - north[p00]);
+		float n1 = north[p01] + fx * (north[p11] - north[p01]);
+		sampleEast[ii] = e0 + fy * (e1 - e0);
+		sampleNorth[ii] = n0 + fy * (n1 - n0);
+	}
+}
+
+
+/* ----------------------------------------------------------------------------
+ * TidalParticles
+ */
+TidalParticles::TidalParticles()
+{
+	num = 0;
+	randomState = 1;
+	areaLeft = areaTop = areaRight = areaBottom = 0;
+	memory = 0;
+	x = y = prevx = prevy = east = north = 0;
+	age = 0;
+}
+
+
+TidalParticles::~TidalParticles()
+{
+	delete [] memory;
+}
+
+
+// A simple generator is enough and gives the same particles every time
+unsigned int
+TidalParticles::random()
+{
+	randomState = randomState * 1103515245 + 12345;
+	return (randomState >> 8) & 0xffffff;
+}
+
+
+/*
+ * Start a particle somewhere random near a point of the field in the area
+ */
+void
+TidalParticles::restart(int ii, const TidalStreamField &field)
+{
+	int spacing = field.getSpacing();
+	int point = points[random() % points.count()];
+	x[ii] = prevx[ii] = field.getX(point) + ((random() % 1024) / 1024.0f - 0.5f) * spacing;
+	y[ii] = prevy[ii] = field.getY(point) + ((random() % 1024) / 1024.0f - 0.5f) * spacing;
+	age[ii] = 0;
+}
+
+
+/*
+ * The area in the same coordinates as the field
+ */
+void
+TidalParticles::setArea(const TidalStreamField &field, int left, int top, int width, int height)
+{
+	areaLeft = left;
+	areaTop = top;
+	areaRight = left + width;
+	areaBottom = top + height;
+	points.resize(0);
+	for (int ii=0; ii<field.count(); ii++)
+	{
+		if (field.getX(ii) >= areaLeft && field.getX(ii) < areaRight && field.getY(ii) >= areaTop && field.getY(ii) < areaBottom)
+			points.push_back(ii);
+	}
+}
+
+
+void
+TidalParticles::seed(int n, const TidalStreamField &field, int left, int top, int width, int height)
+{
+	if (n != num)
+	{
+		delete [] memory;
+		memory = new char[n * 6 * sizeof(float) + n * sizeof(int)];
+		float *p = (float*)memory;
+		x = p;     p += n;
+		y = p;     p += n;
+		prevx = p; p += n;
+		prevy = p; p += n;
+		east = p;  p += n;
+		north = p; p += n;
+		age = (int*)p;
+	}
+	setArea(field, left, top, width, height);
+	num = points.count() > 0 ? n : 0;
+	randomState = 1;
+	for (int ii=0; ii<num; ii++)
+	{
+		restart(ii, field);
+		// of random ages so they don't all start again together
+		age[ii] = random() % TIDALPARTICLES_LIFE;
+	}
+}
+
+
+/*
+ * The field's north is up the screen
+ */
+void
+TidalParticles::advect(const TidalStreamField &field, float scale)
+{
+	int ii;
+
+	TRACE("TidalParticles::advect", num, scale);
+	if (num == 0 || points.count() == 0)
+		return;
+	field.sample(num, x, y, east, north);
+	for (ii=0; ii<num; ii++)
+	{
+		prevx[ii] = x[ii];
+		prevy[ii] = y[ii];
+		x[ii] += east[ii] * scale;
+		y[ii] -= north[ii] * scale;
+	}
+	// Where the stream is almost nothing there's probably no field
+	for (ii=0; ii<num; ii++)
+	{
+		if (++age[ii] >= TIDALPARTICLES_LIFE || fabs(east[ii]) + fabs(north[ii]) < 0.001
+			|| x[ii] < areaLeft || x[ii] >= areaRight || y[ii] < areaTop || y[ii] >= areaBottom)
+			restart(ii, field);
+	}
+}
+
+
+/* ----------------------------------------------------------------------------
+ * TidalDataset
+ * The arenas keep their blocks when cleared so reading the files again
+ * only allocates the QStrings used while parsing.
+ */
+void
+TidalDataset::clear()
+{
+	levels.clear();
+	streams.clear();
+}
+
+
+/*
+ * Copy the next line from the extracted file into the string.
+ * Returns a pointer to the start of the following line (*len is reduced
+ * accordingly) or null at the end of the data.
+ * Like readLine the newline is kept and lines are limited in length.
+ */
+static const char *
+readTideLine(const char *data, unsigned int *len, QString &line)
+{
+	if (*len == 0)
+		return 0;
+	const char *eol = (const char*)memchr(data, '\n', *len);
+	unsigned int linelen = eol ? (eol - data) + 1 : *len;
+	line = QString::fromLatin1(data, QMIN(linelen, TIDE_MAX_LINE_LEN-1));
+	*len -= linelen;
+	return data + linelen;
+}
+
+
+/*
+ * Add all the valid records from the contents of a *.T1 file.
+ * Returns the number of records added.
+ */
+int
+TidalDataset::addLevels(const char *data, unsigned int len)
+{
+	QString line;
+	int added = 0;
+	while ((data = readTideLine(data, &len, line)) != 0)
+	{
+		TidalLevel tl(line, &names);
+		if (!tl.isOk())
+			continue;
+		levels.append(tl);
+		added++;
+	}
+	return added;
+}
+
+
+/*
+ * Add all the valid records from the contents of a *.C1 file.
+ * Returns the number of records added.
+ */
+int
+TidalDataset::addStreams(const char *data, unsigned int len)
+{
+	QString line;
+	int added = 0;
+	while ((data = readTideLine(data, &len, line)) != 0)
+	{
+		TidalStream ts(line, &names);
+		if (!ts.isOk())
+			continue;
+		streams.append(ts);
+		added++;
+	}
+	return added;
+}
+
+
 /* ----------------------------------------------------------------------------
  * eg.
 grep -h '	D	56	2' tidedata/*10.C1 | sort -u | ./td
@@ -205,13 +1051,14 @@ grep -h '	D	56	2' tidedata/*10.C1 | sort -u | ./td
 int main(int argc, char *argv[])
 {
 	char line[2048];
+	TidalNames names;
 	double jtime_wanted = 58034364.0;
 	double jtime_ref_hw = 58034623.0;
 	float bearing, rate;
 
 	while (fgets(line, 2048, stdin))
 	{
-		TidalStream ts(line);
+		TidalStream ts(line, &names);
 		if (!ts.isOk()) { printf("ERROR %s",line); continue; }
 		ts.getStreamMinsFromRefAndMoon(jtime_wanted - jtime_ref_hw,
 			0.860775, &bearing, &rate);
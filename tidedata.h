@@ -2,29 +2,83 @@
 #define TIDEDATA_H
 
 
+#include <new>       // for placement new
 #include <qstring.h>
+#include <qmap.h>
+#include <qvaluevector.h>
+
+class QCT;
+class TideCalc;
+
+
+/*
+ * Every distinct chart, place and reference port name is stored once
+ * and the records refer to it by number.
+ */
+class TidalNames
+{
+public:
+	int intern(const QString &str);
+	const QString &name(int id) const { return names[id]; }
+	int count() const { return names.count(); }
+private:
+	QMap<QString,int> ids;
+	QValueVector<QString> names;
+};
+
+
+/*
+ * Records are allocated in blocks which are kept for the life of the
+ * arena so that reloading the records does not go back to the heap.
+ * Only suitable for records which do not need their destructor called.
+ */
+#define TIDALARENA_BLOCK 256  // records per block
+
+template<class T> class TidalArena
+{
+public:
+	TidalArena() { num = 0; }
+	~TidalArena() { for (unsigned int ii=0; ii<blocks.count(); ii++) delete [] blocks[ii]; }
+	int count() const { return num; }
+	T *at(int ii) const { return (T*)blocks[ii / TIDALARENA_BLOCK] + ii % TIDALARENA_BLOCK; }
+	T *append(const T &rec)
+	{
+		if (num == (int)blocks.count() * TIDALARENA_BLOCK)
+			blocks.push_back(new char[sizeof(T) * TIDALARENA_BLOCK]);
+		return new (at(num++)) T(rec);
+	}
+	void clear() { num = 0; }
+private:
+	int num;
+	QValueVector<char*> blocks;
+};
 
 
 class TidalLevel
 {
 public:
-	TidalLevel(const QString &line);
+	TidalLevel(const QString &line, TidalNames *names);
 	bool    isOk()     const { return ok; }
 	double  getLat()   const { return lat; }
 	double  getLon()   const { return lon; }
-	QString getChart() const { return chart; }
-	QString getName()  const { return name; }
+	QString getChart() const { return names->name(chartId); }
+	QString getName()  const { return names->name(nameId); }
 	float  getMHWS()   const { return mhws; }
 	float  getMHWN()   const { return mhwn; }
 	float  getMLWN()   const { return mlwn; }
 	float  getMLWS()   const { return mlws; }
+	// The station ID is resolved by TideCalc from the name when loaded
+	int    getStation() const        { return station; }
+	void   setStation(int id)        { station = id; }
 	// The current level is calculated externally by TideCalc
 	// but this is a convenient place to store the result
 	void   setCurrentLevel(float lv) { current_level = lv; }
 	float  getCurrentLevel() const   { return current_level; }
 private:
 	bool ok;
-	QString chart, name;
+	const TidalNames *names;
+	int chartId, nameId;
+	int station;
 	double lat, lon;
 	float mhws, mhwn, mlwn, mlws;
 	float current_level;
@@ -32,41 +86,44 @@ private:
 
 
 #define TIDALSTREAM_NUMRATES 13   // 6 before HW, one at HW, 6 after HW
+#define TIDALSTREAM_NUMINTERVALS (TIDALSTREAM_NUMRATES-1) // hourly intervals
+#define TIDALSTREAM_NUMCOMPONENTS 4  // x,y components at spring and neap
 
 class TidalStream
 {
 public:
-	TidalStream(const QString &line);
+	TidalStream(const QString &line, TidalNames *names);
 	bool isOk()        const { return ok; }
 	double  getLat()   const { return lat; }
 	double  getLon()   const { return lon; }
-	QString getChart() const { return chart; }
-	QString getName()  const { return name; }
-	QString getRef()   const { return ref; }   // times are referenced to this place
+	QString getChart() const { return names->name(chartId); }
+	QString getName()  const { return names->name(nameId); }
+	QString getRef()   const { return names->name(refId); }   // times are referenced to this place
 	bool refAtHW()     const { return refHW; } // when the location is at High Water
+	// The station ID is resolved by TideCalc from getRef() when loaded
+	int  getRefStation() const   { return refStation; }
+	void setRefStation(int id)   { refStation = id; }
 	bool getStreamMinsFromRef(double minutes, float *bearing, float *springRate, float *neapRate);
 	bool getStreamMinsFromRefAndMoon(double minsfromref, double fractionFromSpring, float *bearing, float *rate);
 	float getCurrentBearing() const { return current_bearing; }
 	float getCurrentRate()    const { return current_rate; }
+	// When calculated externally by TidalStreamSet
+	void  setCurrent(float bearing, float rate) { current_bearing = bearing; current_rate = rate; }
 private:
+	friend class TidalStreamSet;
+	enum { XSPRING, YSPRING, XNEAP, YNEAP };
+	void makePolynomials(int component, float poly[TIDALSTREAM_NUMINTERVALS][4]) const;
 	bool ok;
-	QString chart, name, ref;
+	const TidalNames *names;
+	int chartId, nameId, refId;
+	int refStation;
 	bool refHW;
 	double lat, lon;
+	// Only the table values are kept, the polynomials are worked out
+	// from them when needed (once per stream by TidalStreamSet::build)
 	float bearing[TIDALSTREAM_NUMRATES];
 	float springRate[TIDALSTREAM_NUMRATES];
 	float neapRate[TIDALSTREAM_NUMRATES];
-	float bearing_coeff[TIDALSTREAM_NUMRATES];
-	float spring_coeff[TIDALSTREAM_NUMRATES];
-	float neap_coeff[TIDALSTREAM_NUMRATES];
-	float xspring[TIDALSTREAM_NUMRATES];
-	float xneap[TIDALSTREAM_NUMRATES];
-	float yspring[TIDALSTREAM_NUMRATES];
-	float yneap[TIDALSTREAM_NUMRATES];
-	float xspring_coeff[TIDALSTREAM_NUMRATES];
-	float xneap_coeff[TIDALSTREAM_NUMRATES];
-	float yspring_coeff[TIDALSTREAM_NUMRATES];
-	float yneap_coeff[TIDALSTREAM_NUMRATES];
 	static const float hour[TIDALSTREAM_NUMRATES];
 	static const float cspline_natural;
 	float current_bearing;
@@ -74,4 +131,186 @@ private:
 };
 
 
+/*
+ * All the tidal streams on a chart with their polynomial coefficients held
+ * as structure-of-arrays so they can all be evaluated at once, several
+ * streams at a time using SIMD instructions.
+ * Call build() when the list of streams changes, then for each time
+ * setMinsFromRef() for every stream, then evaluate().
+ * Streams are reordered so that those with the same reference station
+ * (hence the same time from HW and usually the same hourly interval)
+ * are adjacent; use getStream() to find which stream is at each index.
+ */
+class TidalStreamSet
+{
+public:
+	TidalStreamSet();
+	~TidalStreamSet();
+	void build(const QValueVector<TidalStream*> &list);
+	int count() const { return num; }
+	TidalStream *getStream(int ii) const { return streams[ii]; }
+	void setMinsFromRef(int ii, double mins);
+	void evaluate(double fractionFromSpring);
+	float getBearing(int ii) const { return bearing[ii]; }
+	float getRate(int ii)    const { return rate[ii]; }
+private:
+	void allocate(int n);
+	float *coeff(int component, int interval, int power) const;
+	void evaluateScalar(int start, float blend);
+	void evaluateVector(int start, float blend);
+private:
+	int num, capacity;          // capacity is a multiple of the vector size
+	TidalStream **streams;
+	char *memory;               // everything below is allocated from here
+	float *coeffs;              // [component][interval][power][capacity]
+	float *hours;               // fractional hour within the interval
+	int *interval;              // hourly interval to use
+	int *valid;                 // all bits set if the time is within range
+	float *bearing, *rate;      // results
+	bool warned;                // of a time out of range since build
+};
+
+
+/*
+ * The tidal streams interpolated onto a regular grid of points, spacing
+ * pixels apart over an area (usually what is visible), so the flow can be
+ * seen between the diamonds.  Each point
+ * takes the east and north components of up to TIDALFIELD_NEIGHBOURS of
+ * the nearest streams within the radius, weighted by inverse distance
+ * such that a stream's weight falls to zero at the radius (the modified
+ * Shepard method).  Points with no stream within the radius are left out.
+ * Call build() with the position of each stream whenever they or the area
+ * move, which finds the neighbours and weights of every point once using a
+ * grid of buckets, then evaluate() with the components of each stream (in
+ * the same order) every time they change.  Streams outside the area still
+ * count for the points within the radius of them.
+ * sample() interpolates between the points at any positions, zero where
+ * there is no stream.
+ */
+#define TIDALFIELD_NEIGHBOURS 6
+
+class TidalStreamField
+{
+public:
+	TidalStreamField();
+	~TidalStreamField();
+	void build(int nstreams, const float *x, const float *y, int left, int top, int width, int height, int spacing, float radius);
+	void evaluate(const float *streamEast, const float *streamNorth);
+	void sample(int n, const float *x, const float *y, float *sampleEast, float *sampleNorth) const;
+	int getLeft() const    { return left; }
+	int getTop() const     { return top; }
+	int getSpacing() const { return spacing; }
+	int getColumns() const { return columns; }
+	int getRows() const    { return rows; }
+	int count() const      { return num; }
+	int getCell(int ii) const       { return cell[ii]; } // column + row * columns
+	float getX(int ii) const { return left + (cell[ii] % columns + 0.5f) * spacing; }
+	float getY(int ii) const { return top + (cell[ii] / columns + 0.5f) * spacing; }
+	float getEast(int ii) const     { return east[ii]; }
+	float getNorth(int ii) const    { return north[ii]; }
+	float getBearing(int ii) const  { return bearing[ii]; }
+	float getRate(int ii) const     { return rate[ii]; }
+private:
+	void allocate(int n);
+	int nearest(float px, float py, int *found, float *dist) const;
+	void evaluateScalar(int start, const float *streamEast, const float *streamNorth);
+	void evaluateVector(int start, const float *streamEast, const float *streamNorth);
+	int pointAt(int col, int row) const;
+private:
+	int left, top, spacing, columns, rows;
+	int num, capacity;          // capacity is a multiple of the vector size
+	float radius;
+	// Buckets radius pixels square listing the streams in each
+	int nstreams, bucketColumns, bucketRows;
+	const float *streamX, *streamY;  // only used while building
+	QValueVector<int> bucketFirst, bucketNext;
+	QValueVector<int> cellPoint;     // point in each cell, num if none
+	char *memory;               // everything below is allocated from here
+	int *cell;
+	int *neighbour;             // [TIDALFIELD_NEIGHBOURS][capacity] stream index
+	float *weight;              // [TIDALFIELD_NEIGHBOURS][capacity] summing to 1
+	float *east, *north;        // results
+	float *bearing, *rate;
+};
+
+
+/*
+ * Particles carried along by a TidalStreamField, in structure-of-arrays
+ * form so they can be moved together.  Each lives for a number of steps
+ * or until it reaches somewhere with no stream or leaves the area, then
+ * starts again near a random point of the field inside the area (which
+ * is the part being shown, so none are wasted off it).  The previous
+ * positions are kept so the trails can be drawn from them, the same as
+ * the current position for particles which have just started again.
+ * Call setArea when the area moves without starting them all again.
+ */
+#define TIDALPARTICLES_LIFE 100  // steps
+
+class TidalParticles
+{
+public:
+	TidalParticles();
+	~TidalParticles();
+	void seed(int n, const TidalStreamField &field, int left, int top, int width, int height);
+	void setArea(const TidalStreamField &field, int left, int top, int width, int height);
+	// Move by the stream, scale being the pixels moved for one knot
+	void advect(const TidalStreamField &field, float scale);
+	int count() const { return num; }
+	const float *getX() const { return x; }
+	const float *getY() const { return y; }
+	const float *getPrevX() const { return prevx; }
+	const float *getPrevY() const { return prevy; }
+private:
+	void restart(int ii, const TidalStreamField &field);
+	unsigned int random();
+private:
+	int num;
+	unsigned int randomState;
+	int areaLeft, areaTop, areaRight, areaBottom;
+	QValueVector<int> points;   // of the field inside the area
+	char *memory;
+	float *x, *y, *prevx, *prevy;
+	float *east, *north;        // sampled from the field
+	int *age;
+};
+
+
+/*
+ * All the tidal levels and streams read from the tide data files.
+ * The files are read once and each chart selects the records it needs,
+ * so the records and their names are only ever allocated once.
+ * load, select and closeTogether are in tidedataset.cpp.
+ */
+class TidalDataset
+{
+public:
+	// What select requires of the levels and streams it chooses
+	enum { LevelOnChart = 1, LevelUnique = 2, StreamOnChart = 4, StreamUnique = 8, StreamKnownRef = 16 };
+	// Read the archives of *.C1 and *.T1 files in dir
+	bool load(const QString &dir, const QString &password, TideCalc *tideCalc);
+	// Choose the levels and streams to show on a chart
+	void select(QCT *qct, double degreesPerPixel, TideCalc *tideCalc, int require,
+		QValueVector<TidalLevel*> *levels, QValueVector<TidalStream*> *streams) const;
+	// Whether two places would be drawn on top of each other
+	static bool closeTogether(double lat0, double lon0, double lat1, double lon1, double degreesPerPixel);
+	void clear();
+	bool isEmpty() const { return levels.count() == 0 && streams.count() == 0; }
+	int addLevels(const char *data, unsigned int len);
+	int addStreams(const char *data, unsigned int len);
+	int levelCount() const  { return levels.count(); }
+	int streamCount() const { return streams.count(); }
+	TidalLevel  *getLevel(int ii) const  { return levels.at(ii); }
+	TidalStream *getStream(int ii) const { return streams.at(ii); }
+private:
+	static bool selectLevel(TidalLevel *tlp, QCT *qct, double degreesPerPixel, int require,
+		QValueVector<TidalLevel*> *levels);
+	static bool selectStream(TidalStream *tsp, QCT *qct, double degreesPerPixel, TideCalc *tideCalc, int require,
+		QValueVector<TidalStream*> *streams);
+private:
+	TidalNames names;
+	TidalArena<TidalLevel>  levels;
+	TidalArena<TidalStream> streams;
+};
+
+
 #endif // TIDEDATA_H
@@ -0,0 +1,274 @@
+/* > tidedataset.cpp
+ * 1.01 arb Mon Oct 19 23:59:43 BST 2026 - loose files again without USE_UNZIP
+ * 1.00 arb Mon Oct 19 23:59:39 BST 2026
+ */
+
+static const char SCCSid[] = "@(#)tidedataset.cpp 1.01 (C) 2026 arb Load and select tidal data";
+
+/*
+ * The methods of TidalDataset which read the tide archives and choose the
+ * levels and streams to show on a chart, shared by xqct and xqctrender so
+ * they show the same ones.  Kept apart from tidedata.cpp as they need
+ * TideZip, TideCalc and QCT, which the tide benchmark and test don't.
+ */
+
+/*
+ * Configuration:
+ * Define USE_UNZIP to read the tide files from the archives (as the .pro
+ * files do), otherwise they are read as separate files from the directory.
+ * Define TIDEDATASET_C1_ZIP and TIDEDATASET_T1_ZIP as the names of the
+ * archives of tidal stream (*.C1) and tidal level (*.T1) files.
+ * Define CLOSE_PIXELS as how near two levels or streams must be to be
+ * counted as the same place, as they would be drawn on top of each other.
+ */
+#define TIDEDATASET_C1_ZIP "tidec1.zip"
+#define TIDEDATASET_T1_ZIP "tidet1.zip"
+#define CLOSE_PIXELS       20.0
+
+
+#include <math.h>
+#ifndef USE_UNZIP
+#include <qdir.h>
+#include <qfile.h>
+#endif
+#include "satlib/dundee.h"
+#include "osmap/qct.h"
+#include "tidedata.h"
+#include "tidecalc.h"
+#include "tidezip.h"
+
+
+/* ----------------------------------------------------------------------------
+ * For checking whether two tidal locations are close enough that they would
+ * overlap or in fact are identical duplicates and so only one is necessary.
+ */
+static double
+distanceBetween(double lat0, double lon0, double lat1, double lon1)
+{
+	// Should calculate Great Circle distance, but OK for close points
+	// Don't bother to take the square root for speed.
+	return ((lat1-lat0)*(lat1-lat0) + (lon1-lon0)*(lon1-lon0));
+}
+
+
+bool
+TidalDataset::closeTogether(double lat0, double lon0, double lat1, double lon1, double degreesPerPixel)
+{
+	return (sqrt(distanceBetween(lat0, lon0, lat1, lon1)) / degreesPerPixel < CLOSE_PIXELS);
+}
+
+
+/* ----------------------------------------------------------------------------
+ * Read all the *.C1 and *.T1 files in the archives in dir (or in dir itself
+ * without USE_UNZIP, when the password is not needed), replacing any read
+ * before, then resolve the station names once so they're not looked up
+ * every time.  Returns false if there are none.
+ */
+bool
+TidalDataset::load(const QString &dir, const QString &password, TideCalc *tideCalc)
+{
+	int ii;
+
+	clear();
+
+#ifdef USE_UNZIP
+	// Find all the files for year 2010 (have last two digits 10)
+	// Names BAnnTyy.T1 and BAnnCyy.C1
+	// Each archive is opened and its directory read only once
+	TideZip c1zip(dir+DIRSEPSTR+TIDEDATASET_C1_ZIP, password);
+	TideZip t1zip(dir+DIRSEPSTR+TIDEDATASET_T1_ZIP, password);
+	QValueVector<int> c1list = c1zip.entryList("*C10.C1");
+	QValueVector<int> t1list = t1zip.entryList("*T10.T1");
+	QValueVector<int>::iterator diriter;
+	unsigned int len;
+	const char *data;
+
+	// Read the Tide Levels files (*.T1) containing mean high/low water
+	for (diriter = t1list.begin(); diriter != t1list.end(); ++diriter)
+	{
+		if ((data = t1zip.data(*diriter, &len)) == 0)
+			continue;
+		debugf(1, "load %s\n", (const char*)t1zip.name(*diriter));
+		addLevels(data, len);
+	}
+
+	// Read the Tidal Streams files (*.C1) containing tidal diamonds
+	for (diriter = c1list.begin(); diriter != c1list.end(); ++diriter)
+	{
+		if ((data = c1zip.data(*diriter, &len)) == 0)
+			continue;
+		debugf(1, "load %s\n", (const char*)c1zip.name(*diriter));
+		addStreams(data, len);
+	}
+#else
+	// The same files unpacked into the directory
+	QDir qdir(dir);
+	QStringList c1list = qdir.entryList("*C10.C1");
+	QStringList t1list = qdir.entryList("*T10.T1");
+	QStringList::Iterator diriter;
+	QByteArray contents;
+	(void)password;
+
+	// Read the Tide Levels files (*.T1) containing mean high/low water
+	for (diriter = t1list.begin(); diriter != t1list.end(); ++diriter)
+	{
+		QFile file(dir+DIRSEPSTR+(*diriter));
+		debugf(1, "load %s\n", (const char*)file.name());
+		if (!file.open(IO_ReadOnly))
+			continue;
+		contents = file.readAll();
+		addLevels(contents.data(), contents.size());
+	}
+
+	// Read the Tidal Streams files (*.C1) containing tidal diamonds
+	for (diriter = c1list.begin(); diriter != c1list.end(); ++diriter)
+	{
+		QFile file(dir+DIRSEPSTR+(*diriter));
+		debugf(1, "load %s\n", (const char*)file.name());
+		if (!file.open(IO_ReadOnly))
+			continue;
+		contents = file.readAll();
+		addStreams(contents.data(), contents.size());
+	}
+#endif
+
+	for (ii=0; ii<levelCount(); ii++)
+	{
+		TidalLevel *tlp = getLevel(ii);
+		tlp->setStation(tideCalc->getStationId(tlp->getName()));
+	}
+	for (ii=0; ii<streamCount(); ii++)
+	{
+		TidalStream *tsp = getStream(ii);
+		tsp->setRefStation(tideCalc->getStationId(tsp->getRef()));
+	}
+	debugf(1, "Tidal dataset has %d levels and %d streams\n", levelCount(), streamCount());
+	return !isEmpty();
+}
+
+
+/* ----------------------------------------------------------------------------
+ * Sift out the records for the chart into the lists (which are emptied
+ * first but keep their capacity), leaving out the duplicates according to
+ * the flags in require.  degreesPerPixel is for the zoom being shown.
+ */
+void
+TidalDataset::select(QCT *qct, double degreesPerPixel, TideCalc *tideCalc, int require,
+	QValueVector<TidalLevel*> *levelList, QValueVector<TidalStream*> *streamList) const
+{
+	int ii;
+
+	// erase rather than clear so the capacity is kept for the next chart
+	levelList->erase(levelList->begin(), levelList->end());
+	for (ii=0; ii<levelCount(); ii++)
+		selectLevel(getLevel(ii), qct, degreesPerPixel, require, levelList);
+
+	streamList->erase(streamList->begin(), streamList->end());
+	for (ii=0; ii<streamCount(); ii++)
+		selectStream(getStream(ii), qct, degreesPerPixel, tideCalc, require, streamList);
+}
+
+
+/*
+ * Add a tidal level to the list if it is wanted on this chart.
+ */
+bool
+TidalDataset::selectLevel(TidalLevel *tlp, QCT *qct, double degreesPerPixel, int require,
+	QValueVector<TidalLevel*> *levelList)
+{
+	int nn;
+
+	// Ignore tide levels not on this chart
+	if ((require & LevelOnChart) && (qct->getIdentifier() != tlp->getChart()))
+		return false;
+	// Ignore tide levels with coords outside boundary of this chart
+	if (!qct->coordInsideMap(tlp->getLat(), tlp->getLon()))
+		return false;
+	// Check for duplicates, just ignore the new one
+	// assuming they actually are identical and first is ok
+	if (require & LevelUnique)
+		for (nn=0; nn<(int)levelList->count(); nn++)
+	{
+		TidalLevel *tlpiter = (*levelList)[nn];
+		if (closeTogether(tlpiter->getLat(), tlpiter->getLon(), tlp->getLat(), tlp->getLon(), degreesPerPixel))
+		{
+			debugf(2,"  IGNORE %s - same location as %s\n", (const char*)tlp->getName(), (const char*)tlpiter->getName());
+			return false;
+		}
+	}
+	debugf(1, "Tide Level: Spring Tide range %.1f to %.1f at %s\n", tlp->getMLWS(), tlp->getMHWS(), (const char*)tlp->getName());
+	debugf(1, "Tide Level: Neap Tide   range %.1f to %.1f at %s\n", tlp->getMLWN(), tlp->getMHWN(), (const char*)tlp->getName());
+	levelList->push_back(tlp);
+	return true;
+}
+
+
+/*
+ * Add a tidal stream to the list if it is wanted on this chart,
+ * possibly replacing one at the same location.
+ */
+bool
+TidalDataset::selectStream(TidalStream *tsp, QCT *qct, double degreesPerPixel, TideCalc *tideCalc, int require,
+	QValueVector<TidalStream*> *streamList)
+{
+	int nn;
+
+	// Ignore tide streams not on this chart
+	// Can be useful to see all diamonds from other charts though
+	// (assuming they are within the chart boundary checked below)
+	if ((require & StreamOnChart) && (qct->getIdentifier() != tsp->getChart()))
+		return false;
+	// Ignore tide streams off this chart
+	if (!qct->coordInsideMap(tsp->getLat(), tsp->getLon()))
+		return false;
+	debugf(1, "Tidal Stream %s referenced to %s at %sW (%f, %f)\n", (const char*)tsp->getName(), (const char*)tsp->getRef(), tsp->refAtHW()? "H":"L", tsp->getLat(), tsp->getLon());
+	// Ignore tide streams if ref station is not in tide database
+	if ((require & StreamKnownRef) && !tideCalc->isStationKnown(tsp->getRefStation()))
+	{
+		debugf(1, "TidalStream ignored because %s is not a recognised location\n", (const char*)tsp->getRef());
+		return false;
+	}
+	// See if there's already one at the location
+	if (require & StreamUnique)
+		for (nn=0; nn<(int)streamList->count(); nn++)
+	{
+		TidalStream *tspiter = (*streamList)[nn];
+		if (closeTogether(tspiter->getLat(), tspiter->getLon(), tsp->getLat(), tsp->getLon(), degreesPerPixel))
+		{
+			// If both have the same reference station and location then they are
+			// hopefully identical (or we can't tell which is best) so ignore new one
+			if (tideCalc->isSameStation(tspiter->getRefStation(), tsp->getRefStation()))
+			{
+				debugf(2, "  IGNORED - same location AND ref station, so identical\n");
+				return false;
+			}
+			// Find out which one has the closest reference station
+			double reflat0, reflon0, reflat1, reflon1;
+			double refdist1, refdist2;
+			tideCalc->getStationLocation(tsp->getRefStation(), &reflat0, &reflon0);
+			tideCalc->getStationLocation(tspiter->getRefStation(), &reflat1, &reflon1);
+			refdist1 = distanceBetween(reflat0, reflon0, tsp->getLat(), tsp->getLon()); // new
+			refdist2 = distanceBetween(reflat1, reflon1, tsp->getLat(), tsp->getLon()); // old
+			debugf(2, "  REJECT - already in the list %f vs %f\n", refdist1, refdist2);
+			// Remove the one which is furthest away
+			// Could also deliberately choose the one with the same reference station
+			// ref station used by the nearest suborbinate station
+			// (eg. if this tidal diamond is close to Dundee and Dundee is referenced to Aberdeen)
+			if (refdist2 > refdist1)
+			{
+				// Remove the old one, it is further away, and append the new one
+				debugf(2, "    remove old one\n");
+				streamList->erase(streamList->begin() + nn);
+			}
+			else
+			{
+				// Ignore the new one it is further away
+				debugf(2, "    ignore new one\n");
+				return false;
+			}
+			break;
+		}
+	}
+	streamList->push_back(tsp);
+	return true;
+}
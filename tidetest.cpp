@@ -0,0 +1,245 @@
+/* > tidetest.cpp
+ * 1.02 arb Mon Oct 19 23:59:53 BST 2026 - stream field over part of the area, streams off it
+ * 1.01 arb Mon Oct 19 23:59:23 BST 2026 - stream field against inverse distance weighting
+ * 1.00 arb Mon Oct 19 23:59:21 BST 2026
+ */
+
+static const char SCCSid[] = "@(#)tidetest.cpp 1.02 (C) 2026 arb Tidal stream tests";
+
+/*
+ * Checks that TidalStreamSet gives the same bearing and rate for every
+ * stream as TidalStream::getStreamMinsFromRefAndMoon, for a set of made
+ * up streams (not a multiple of the vector size, with several reference
+ * stations at different times so the hourly intervals differ).
+ * Checks that TidalStreamField gives the same stream at every point as
+ * the modified Shepard inverse distance weighting worked out directly
+ * from all the streams, and leaves out only the points out of reach, for
+ * a field over part of the area so some streams are off it.
+ * Exits with a non-zero status if any check fails, eg.
+ *   ./tidetest && echo ok
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <qstring.h>
+#include <qptrlist.h>
+#include <qvaluevector.h>
+#include "satlib/dundee.h"
+#include "tidedata.h"
+
+
+/*
+ * Configuration:
+ * Define TEST_STREAMS as the number of streams to make up.
+ * Define TEST_REFS as the number of reference stations they share.
+ * Define TEST_BEARING and TEST_RATE as the largest difference allowed
+ * in degrees and knots (the SSE atan2 is good to about 0.01 degrees).
+ * Define TEST_SLACK as the rate below which the bearing is not checked.
+ * Define TEST_WIDTH, TEST_HEIGHT, TEST_SPACING and TEST_RADIUS as the size
+ * of the area the streams are spread over in pixels, and TEST_LEFT,
+ * TEST_TOP, TEST_FIELD_WIDTH and TEST_FIELD_HEIGHT as the part of it
+ * the stream field covers.
+ */
+#define TEST_STREAMS 23
+#define TEST_REFS    3
+#define TEST_BEARING 0.05
+#define TEST_RATE    0.001
+#define TEST_SLACK   0.01
+#define TEST_WIDTH   2000
+#define TEST_HEIGHT  1500
+#define TEST_SPACING 24
+#define TEST_RADIUS  240.0
+#define TEST_LEFT    312
+#define TEST_TOP     168
+#define TEST_FIELD_WIDTH  1100
+#define TEST_FIELD_HEIGHT 900
+
+
+static int failures = 0;
+
+static void
+check(bool ok, const char *what, int ii, double mins, double got, double want)
+{
+	if (ok)
+		return;
+	printf("FAIL %s stream %d at %+.1f mins got %f want %f\n", what, ii, mins, got, want);
+	failures++;
+}
+
+
+/*
+ * Difference between two bearings allowing for the wrap at 360
+ */
+static double
+bearingDiff(double b0, double b1)
+{
+	double dd = fmod(fabs(b0 - b1), 360.0);
+	return (dd > 180.0) ? 360.0 - dd : dd;
+}
+
+
+/*
+ * A made up line in the format of a C1 file, the stream turning through
+ * the tide with a different size and direction for each stream
+ */
+static QString
+makeStreamLine(int nn)
+{
+	QString line, field;
+	line.sprintf("TEST\tHW\tREF%d\t%d\tTEST%d\t56\t%d.5\t-2\t%d.5", nn % TEST_REFS, nn, nn, nn % 60, (nn * 7) % 60);
+	for (int hh=0; hh<TIDALSTREAM_NUMRATES; hh++)
+	{
+		double bearing = fmod(nn * 37.0 + hh * 30.0 + 15.0 * sin(hh + nn), 360.0);
+		double spring = (hh == 6 && nn % 5 == 0) ? 0.0 : 0.2 + 2.0 * fabs(sin(0.5 * hh + 0.3 * nn));
+		field.sprintf("\t%.0f\t%.1f\t%.1f\t9999\t9999\t9999", bearing, spring, spring / 2);
+		line += field;
+	}
+	return line;
+}
+
+
+/*
+ * Each reference station is at a different time from HW
+ */
+static double
+minsFromRef(const TidalStream *tsp, double mins)
+{
+	double offset = (tsp->getRef() == "REF1") ? -37 : (tsp->getRef() == "REF2") ? 61 : 0;
+	return QMAX(-6*60, QMIN(6*60, mins + offset));
+}
+
+
+static void
+testStreamSet()
+{
+	TidalNames names;
+	QPtrList<TidalStream> list;
+	QValueVector<TidalStream*> streams;
+	TidalStreamSet set;
+	double fractions[] = { 0.0, 0.3, 1.0 };
+	float bearing, rate, springRate;
+	int nn, ii, ff;
+
+	list.setAutoDelete(true);
+	for (nn=0; nn<TEST_STREAMS; nn++)
+	{
+		TidalStream *tsp = new TidalStream(makeStreamLine(nn), &names);
+		if (!tsp->isOk()) { printf("FAIL cannot parse stream %d\n", nn); failures++; delete tsp; continue; }
+		list.append(tsp);
+		streams.push_back(tsp);
+	}
+	set.build(streams);
+	check(set.count() == (int)streams.count(), "count", 0, 0, set.count(), streams.count());
+
+	for (double mins = -6*60; mins <= 6*60; mins += 7.5)
+	{
+		for (ff=0; ff<(int)(sizeof(fractions)/sizeof(fractions[0])); ff++)
+		{
+			for (ii=0; ii<set.count(); ii++)
+				set.setMinsFromRef(ii, minsFromRef(set.getStream(ii), mins));
+			set.evaluate(fractions[ff]);
+			for (ii=0; ii<set.count(); ii++)
+			{
+				TidalStream *tsp = set.getStream(ii);
+				double when = minsFromRef(tsp, mins);
+				tsp->getStreamMinsFromRefAndMoon(when, fractions[ff], &bearing, &rate);
+				tsp->getStreamMinsFromRef(when, 0, &springRate, 0);
+				check(fabs(set.getRate(ii) - rate) <= TEST_RATE, "rate", ii, when, set.getRate(ii), rate);
+				if (springRate >= TEST_SLACK)
+					check(bearingDiff(set.getBearing(ii), bearing) <= TEST_BEARING, "bearing", ii, when, set.getBearing(ii), bearing);
+			}
+		}
+	}
+}
+
+
+static void
+testStreamField()
+{
+	float x[TEST_STREAMS], y[TEST_STREAMS], east[TEST_STREAMS], north[TEST_STREAMS];
+	int found[TIDALFIELD_NEIGHBOURS];
+	float dist[TIDALFIELD_NEIGHBOURS];
+	TidalStreamField field;
+	int nn, ii, kk, col, row, points = 0;
+
+	// Spread out irregularly so no two streams are the same distance away
+	for (nn=0; nn<TEST_STREAMS; nn++)
+	{
+		x[nn] = fmod(nn * 373.71, TEST_WIDTH);
+		y[nn] = fmod(nn * 251.37 + 40, TEST_HEIGHT);
+		east[nn] = 2.0 * sin(nn * 0.9);
+		north[nn] = 2.0 * cos(nn * 1.3);
+	}
+	field.build(TEST_STREAMS, x, y, TEST_LEFT, TEST_TOP, TEST_FIELD_WIDTH, TEST_FIELD_HEIGHT, TEST_SPACING, TEST_RADIUS);
+	field.evaluate(east, north);
+
+	for (ii=0; ii<field.count(); ii++)
+	{
+		float px = field.getX(ii), py = field.getY(ii);
+
+		// The nearest streams within the radius by looking at them all
+		int nfound = 0;
+		for (nn=0; nn<TEST_STREAMS; nn++)
+		{
+			float d = sqrt((x[nn]-px)*(x[nn]-px) + (y[nn]-py)*(y[nn]-py));
+			if (d >= TEST_RADIUS)
+				continue;
+			if (nfound == TIDALFIELD_NEIGHBOURS && d >= dist[nfound-1])
+				continue;
+			if (nfound < TIDALFIELD_NEIGHBOURS)
+				nfound++;
+			for (kk=nfound-1; kk>0 && dist[kk-1] > d; kk--)
+			{
+				dist[kk] = dist[kk-1];
+				found[kk] = found[kk-1];
+			}
+			dist[kk] = d;
+			found[kk] = nn;
+		}
+		double total = 0, e = 0, n = 0;
+		for (kk=0; kk<nfound; kk++)
+		{
+			double d = QMAX(dist[kk], 1.0f);
+			double w = (TEST_RADIUS - d) / (TEST_RADIUS * d);
+			total += w * w;
+			e += w * w * east[found[kk]];
+			n += w * w * north[found[kk]];
+		}
+		check(nfound > 0, "field point with no stream", ii, 0, 0, 0);
+		if (nfound == 0)
+			continue;
+		e /= total;
+		n /= total;
+		check(fabs(field.getEast(ii) - e) <= TEST_RATE, "field east", ii, 0, field.getEast(ii), e);
+		check(fabs(field.getNorth(ii) - n) <= TEST_RATE, "field north", ii, 0, field.getNorth(ii), n);
+		check(fabs(field.getRate(ii) - sqrt(e*e + n*n)) <= TEST_RATE, "field rate", ii, 0, field.getRate(ii), sqrt(e*e + n*n));
+		if (sqrt(e*e + n*n) >= TEST_SLACK)
+			check(bearingDiff(field.getBearing(ii), DEG(atan2(e, n))) <= TEST_BEARING, "field bearing", ii, 0, field.getBearing(ii), DEG(atan2(e, n)));
+	}
+
+	// Every point with a stream in reach is in the field
+	for (row=0; row<field.getRows(); row++)
+	{
+		for (col=0; col<field.getColumns(); col++)
+		{
+			float px = TEST_LEFT + (col + 0.5f) * TEST_SPACING, py = TEST_TOP + (row + 0.5f) * TEST_SPACING;
+			for (nn=0; nn<TEST_STREAMS; nn++)
+				if (sqrt((x[nn]-px)*(x[nn]-px) + (y[nn]-py)*(y[nn]-py)) < TEST_RADIUS)
+					break;
+			if (nn < TEST_STREAMS)
+				points++;
+		}
+	}
+	check(points == field.count(), "field count", 0, 0, field.count(), points);
+}
+
+
+int
+main()
+{
+	testStreamSet();
+	testStreamField();
+	printf("%s\n", failures ? "FAILED" : "passed");
+	return(failures ? 1 : 0);
+}
@@ -0,0 +1,8 @@
+TEMPLATE    = app
+CONFIG      += qt warn_on release thread
+DEFINES     += 
+INCLUDEPATH += $(SWDEV)
+LIBS        += -lsatqt -lsat -lutils -lgif -larb
+HEADERS     = tidedata.h
+SOURCES     = tidedata.cpp tidetest.cpp
+TARGET      = tidetest
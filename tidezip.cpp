@@ -0,0 +1,347 @@
+/* > tidezip.cpp
+ * 1.01 arb Mon Oct 19 23:59:43 BST 2026 - search for the end record by index
+ * 1.00 arb Mon Oct 19 10:12:40 BST 2026
+ */
+
+static const char SCCSid[] = "@(#)tidezip.cpp   1.01 (C) 2026 arb Tide data zip archive reader";
+
+/*
+ * TideZip replaces the use of ZipDir and ZipFile for reading the tide data.
+ * They reparse the central directory of the archive every time an entry is
+ * opened, which for hundreds of small *.C1 and *.T1 files was most of the
+ * time taken to load the tide data when a chart is opened.
+ *
+ * Only "stored" and "deflated" entries are supported, optionally with the
+ * traditional PKWARE encryption (which is what ZipFile supported).
+ * Multi-disk archives and Zip64 are not supported.
+ */
+
+
+#include <stdio.h>
+#include <string.h>
+#include <qfile.h>
+#include <qregexp.h>
+#include <zlib.h>
+#include "satlib/dundee.h" // for debugf
+#include "tidezip.h"
+
+#ifdef Q_OS_UNIX
+#include <sys/types.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+
+#define ZIP_LOCAL_SIG   0x04034b50
+#define ZIP_CENTRAL_SIG 0x02014b50
+#define ZIP_END_SIG     0x06054b50
+#define ZIP_LOCAL_LEN   30
+#define ZIP_CENTRAL_LEN 46
+#define ZIP_END_LEN     22
+#define ZIP_METHOD_STORED   0
+#define ZIP_METHOD_DEFLATED 8
+#define ZIP_FLAG_ENCRYPTED  1
+#define ZIP_CRYPT_HEADER_LEN 12
+
+// Zip files are always little-endian
+#define GET16(p) ((unsigned int)(p)[0] | ((unsigned int)(p)[1]<<8))
+#define GET32(p) (GET16(p) | (GET16((p)+2)<<16))
+
+
+/* ----------------------------------------------------------------------------
+ * Open the archive and read the list of entries.
+ * If a password is given it is used for all encrypted entries.
+ */
+TideZip::TideZip(const QString &zipname, const QString &pass)
+{
+	ok = false;
+	base = 0;
+	size = 0;
+	mapped = false;
+	password = pass.latin1();
+
+	inflater = new z_stream;
+	memset(inflater, 0, sizeof(z_stream));
+	// Negative window bits means raw deflate data without a zlib header
+	if (inflateInit2(inflater, -MAX_WBITS) != Z_OK)
+	{
+		delete inflater;
+		inflater = 0;
+		return;
+	}
+
+	if (!mapFile(zipname))
+	{
+		log_error_message("cannot read %s", (const char*)zipname);
+		return;
+	}
+	ok = readCentralDirectory();
+	debugf(1, "TideZip %s has %d entries\n", (const char*)zipname, (int)entries.count());
+}
+
+
+TideZip::~TideZip()
+{
+	if (inflater)
+	{
+		inflateEnd(inflater);
+		delete inflater;
+	}
+	unmapFile();
+}
+
+
+/*
+ * Map the whole file into memory.  The tide archives are only a few MB
+ * so if mapping is not available just read the whole thing.
+ */
+bool
+TideZip::mapFile(const QString &zipname)
+{
+#ifdef Q_OS_UNIX
+	int fd = ::open(QFile::encodeName(zipname), O_RDONLY);
+	if (fd >= 0)
+	{
+		struct stat st;
+		if (fstat(fd, &st) == 0 && st.st_size > 0)
+		{
+			void *addr = mmap(0, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+			if (addr != MAP_FAILED)
+			{
+				base = (const unsigned char*)addr;
+				size = st.st_size;
+				mapped = true;
+			}
+		}
+		::close(fd);
+		if (mapped)
+			return true;
+	}
+#endif
+	QFile file(zipname);
+	if (!file.open(IO_ReadOnly))
+		return false;
+	filedata = file.readAll();
+	file.close();
+	base = (const unsigned char*)filedata.data();
+	size = filedata.size();
+	return (size > 0);
+}
+
+
+void
+TideZip::unmapFile()
+{
+#ifdef Q_OS_UNIX
+	if (mapped)
+		munmap((void*)base, size);
+#endif
+	mapped = false;
+	filedata.resize(0);
+	base = 0;
+	size = 0;
+}
+
+
+/*
+ * Find the end-of-central-directory record, which is at the end of the file
+ * followed only by an optional comment, then walk the central directory.
+ */
+bool
+TideZip::readCentralDirectory()
+{
+	const unsigned char *end = 0, *p;
+	unsigned int ii, num, cdsize, cdoffset, pos, first;
+
+	if (size < ZIP_END_LEN)
+		return false;
+	// Work backwards by offset as a pointer before base would be undefined
+	first = (size > 65535 + ZIP_END_LEN) ? size - (65535 + ZIP_END_LEN) : 0;
+	for (pos = size - ZIP_END_LEN + 1; pos > first; pos--)
+	{
+		if (GET32(base + pos - 1) == ZIP_END_SIG)
+		{
+			end = base + pos - 1;
+			break;
+		}
+	}
+	if (end == 0)
+		return false;
+
+	num      = GET16(end + 10);
+	cdsize   = GET32(end + 12);
+	cdoffset = GET32(end + 16);
+	if (cdoffset > size || cdsize > size - cdoffset)
+		return false;
+
+	entries.reserve(num);
+	p = base + cdoffset;
+	for (ii=0; ii<num; ii++)
+	{
+		if (p + ZIP_CENTRAL_LEN > base + size || GET32(p) != ZIP_CENTRAL_SIG)
+			return false;
+		unsigned int namelen = GET16(p + 28);
+		unsigned int extralen = GET16(p + 30);
+		unsigned int commentlen = GET16(p + 32);
+		if (p + ZIP_CENTRAL_LEN + namelen > base + size)
+			return false;
+		Entry entry;
+		entry.flags  = GET16(p + 8);
+		entry.method = GET16(p + 10);
+		entry.crc    = GET32(p + 16);
+		entry.csize  = GET32(p + 20);
+		entry.usize  = GET32(p + 24);
+		entry.offset = GET32(p + 42);
+		entry.name   = QString::fromLatin1((const char*)p + ZIP_CENTRAL_LEN, namelen);
+		entries.push_back(entry);
+		p += ZIP_CENTRAL_LEN + namelen + extralen + commentlen;
+	}
+	return true;
+}
+
+
+QString
+TideZip::name(int index) const
+{
+	return entries[index].name;
+}
+
+
+/*
+ * Return the indices of the entries whose names match the wildcard,
+ * eg. "*C10.C1", in the same order as they are stored in the archive.
+ */
+QValueVector<int>
+TideZip::entryList(const QString &wildcard) const
+{
+	QValueVector<int> list;
+	QRegExp rx(wildcard, true, true);
+	for (unsigned int ii=0; ii<entries.count(); ii++)
+	{
+		if (rx.exactMatch(entries[ii].name))
+			list.push_back(ii);
+	}
+	return list;
+}
+
+
+/*
+ * Traditional PKWARE decryption into the reusable buffer.
+ * Returns a pointer to the data following the 12-byte encryption header.
+ * A wrong password is detected by the CRC check after extraction.
+ */
+const unsigned char *
+TideZip::decrypt(const unsigned char *src, unsigned int len)
+{
+	static unsigned long crctab[256];
+	unsigned long key0 = 305419896UL, key1 = 591751049UL, key2 = 878082192UL;
+	unsigned int ii;
+
+	// The same table as zlib but its type differs between zlib versions
+	if (crctab[1] == 0)
+	{
+		for (ii=0; ii<256; ii++)
+		{
+			unsigned long c = ii;
+			for (int bit=0; bit<8; bit++)
+				c = (c & 1) ? (0xedb88320UL ^ (c >> 1)) : (c >> 1);
+			crctab[ii] = c;
+		}
+	}
+
+#define CRC32(c, b) (crctab[((c) ^ (b)) & 0xff] ^ ((c) >> 8))
+#define UPDATE_KEYS(c) { \
+		key0 = CRC32(key0, c); \
+		key1 = ((key1 + (key0 & 0xff)) * 134775813UL + 1) & 0xffffffffUL; \
+		key2 = CRC32(key2, key1 >> 24); }
+
+	for (ii=0; ii<password.length(); ii++)
+		UPDATE_KEYS((unsigned char)password[ii]);
+
+	if (cryptbuf.size() < len)
+		cryptbuf.resize(len);
+	for (ii=0; ii<len; ii++)
+	{
+		unsigned int temp = (key2 | 2) & 0xffff;
+		unsigned char c = src[ii] ^ ((temp * (temp ^ 1)) >> 8);
+		UPDATE_KEYS(c);
+		cryptbuf[ii] = c;
+	}
+#undef UPDATE_KEYS
+#undef CRC32
+	return cryptbuf.data() + ZIP_CRYPT_HEADER_LEN;
+}
+
+
+/*
+ * Extract an entry and return a pointer to its contents, which remain valid
+ * until the next call.  Returns null if the entry cannot be extracted.
+ */
+const char *
+TideZip::data(int index, unsigned int *len)
+{
+	*len = 0;
+	if (!ok || index < 0 || index >= (int)entries.count())
+		return 0;
+
+	const Entry &entry = entries[index];
+	const unsigned char *p = base + entry.offset;
+	if (entry.offset > size - ZIP_LOCAL_LEN || GET32(p) != ZIP_LOCAL_SIG)
+		return 0;
+	// The local extra field can differ from the one in the central directory
+	unsigned int skip = ZIP_LOCAL_LEN + GET16(p + 26) + GET16(p + 28);
+	if (skip > size - entry.offset || entry.csize > size - entry.offset - skip)
+		return 0;
+	const unsigned char *src = p + skip;
+	unsigned int srclen = entry.csize;
+
+	if (entry.flags & ZIP_FLAG_ENCRYPTED)
+	{
+		if (srclen < ZIP_CRYPT_HEADER_LEN)
+			return 0;
+		src = decrypt(src, srclen);
+		srclen -= ZIP_CRYPT_HEADER_LEN;
+	}
+
+	// Keep one extra byte so callers can treat the data as a string
+	if (outbuf.size() < entry.usize + 1)
+		outbuf.resize(entry.usize + 1);
+
+	if (entry.method == ZIP_METHOD_STORED)
+	{
+		if (srclen != entry.usize)
+			return 0;
+		memcpy(outbuf.data(), src, srclen);
+	}
+	else if (entry.method == ZIP_METHOD_DEFLATED)
+	{
+		inflateReset(inflater);
+		inflater->next_in   = (Bytef*)src;
+		inflater->avail_in  = srclen;
+		inflater->next_out  = (Bytef*)outbuf.data();
+		inflater->avail_out = entry.usize;
+		int rc = inflate(inflater, Z_FINISH);
+		if (rc != Z_STREAM_END || inflater->total_out != entry.usize)
+		{
+			log_error_message("cannot inflate %s (%d)", (const char*)entry.name, rc);
+			return 0;
+		}
+	}
+	else
+	{
+		log_error_message("cannot extract %s (method %d)", (const char*)entry.name, entry.method);
+		return 0;
+	}
+
+	if (crc32(0L, (const Bytef*)outbuf.data(), entry.usize) != entry.crc)
+	{
+		log_error_message("CRC error in %s", (const char*)entry.name);
+		return 0;
+	}
+
+	outbuf[entry.usize] = '\0';
+	*len = entry.usize;
+	return outbuf.data();
+}
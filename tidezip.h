@@ -0,0 +1,61 @@
+/* > tidezip.h
+ * 1.00 arb
+ */
+
+#ifndef TIDEZIP_H
+#define TIDEZIP_H
+
+#include <qstring.h>
+#include <qstringlist.h>
+#include <qmemarray.h>
+#include <qvaluevector.h>
+struct z_stream_s; //#include <zlib.h>
+
+
+/*
+ * Read-only access to the tidec1.zip and tidet1.zip archives.
+ * The archive is opened (memory-mapped where possible) once and its
+ * central directory is walked once in the constructor, so the contents
+ * of every entry can then be extracted without any further searching.
+ * All entries are inflated by the same zlib stream into the same buffer
+ * so the pointer returned by data() is only valid until the next call.
+ */
+class TideZip
+{
+public:
+	TideZip(const QString &zipname, const QString &password = QString::null);
+	~TideZip();
+	bool isOk() const { return ok; }
+	int count() const { return entries.count(); }
+	QString name(int index) const;
+	QValueVector<int> entryList(const QString &wildcard) const;
+	const char *data(int index, unsigned int *len);
+private:
+	bool mapFile(const QString &zipname);
+	void unmapFile();
+	bool readCentralDirectory();
+	const unsigned char *decrypt(const unsigned char *src, unsigned int len);
+private:
+	struct Entry
+	{
+		QString name;
+		unsigned short flags, method;
+		unsigned int crc, csize, usize, offset;
+	};
+	bool ok;
+	QCString password;
+	// The whole archive, either mapped or read into memory
+	const unsigned char *base;
+	unsigned int size;
+	bool mapped;
+	QByteArray filedata;
+	// Contents of the central directory
+	QValueVector<Entry> entries;
+	// Reused for every entry
+	struct z_stream_s *inflater;
+	QMemArray<unsigned char> cryptbuf;   // decrypted compressed data
+	QMemArray<char> outbuf;              // inflated data
+};
+
+
+#endif // !TIDEZIP_H
@@ -0,0 +1,159 @@
+/* > trace.cpp
+ * 1.01 arb Mon Oct 19 23:59:45 BST 2026 - new thread number for a reused ring
+ * 1.00 arb Mon Oct 19 22:38:15 BST 2026
+ */
+
+static const char SCCSid[] = "@(#)trace.cpp     1.01 (C) 2026 arb Event tracing";
+
+/*
+ * Each thread gets its own ring buffer the first time it records an
+ * event, so recording only has to write the event and advance the head
+ * of its ring.  The rings are never freed, a thread which has finished
+ * hands its ring on to the next new thread, which is given a new number;
+ * each event keeps the number of the thread which recorded it, so the
+ * older events left in the ring are still told apart.  traceDump reads
+ * the rings while they may still be written so an event being recorded
+ * at that moment can be garbled, which is acceptable for tracing.
+ */
+
+/*
+ * Configuration:
+ * Define TRACE_RING_SIZE as the number of events kept for each thread,
+ * a power of two, and TRACE_MAX_THREADS as the most threads traced.
+ */
+#define TRACE_RING_SIZE   8192
+#define TRACE_MAX_THREADS 64
+
+
+#include <qmutex.h>
+#include "trace.h"
+
+#ifdef Q_OS_UNIX
+#include <pthread.h>
+#include <time.h>
+#endif
+
+
+struct TraceRecord
+{
+	double time;             // seconds
+	int thread;
+	const char *name;
+	double a, b;
+};
+
+struct TraceRing
+{
+	int thread;              // number given to the thread using it
+	bool inuse;
+	volatile unsigned int head;  // total number of events recorded
+	TraceRecord events[TRACE_RING_SIZE];
+};
+
+static TraceRing *rings[TRACE_MAX_THREADS];
+static int nrings = 0;
+static int nthreads = 0;     // threads which have had a ring
+static QMutex ringMutex;     // guards rings, nrings, nthreads and inuse
+
+
+#ifdef Q_OS_UNIX
+static pthread_key_t ringKey;
+static pthread_once_t ringKeyOnce = PTHREAD_ONCE_INIT;
+
+
+/*
+ * Called when a thread finishes
+ */
+static void
+releaseRing(void *ring)
+{
+	QMutexLocker locker(&ringMutex);
+	((TraceRing*)ring)->inuse = false;
+}
+
+
+static void
+makeRingKey()
+{
+	pthread_key_create(&ringKey, releaseRing);
+}
+
+
+static TraceRing *
+newRing()
+{
+	QMutexLocker locker(&ringMutex);
+	TraceRing *ring;
+	int ii;
+
+	for (ii=0; ii<nrings; ii++)
+		if (!rings[ii]->inuse)
+		{
+			rings[ii]->inuse = true;
+			rings[ii]->thread = nthreads++;
+			return rings[ii];
+		}
+	if (nrings >= TRACE_MAX_THREADS)
+		return 0;
+	ring = new TraceRing;
+	ring->thread = nthreads++;
+	ring->inuse = true;
+	ring->head = 0;
+	rings[nrings++] = ring;
+	return ring;
+}
+#endif
+
+
+void
+traceEvent(const char *name, double a, double b)
+{
+#ifdef Q_OS_UNIX
+	pthread_once(&ringKeyOnce, makeRingKey);
+	TraceRing *ring = (TraceRing*)pthread_getspecific(ringKey);
+	if (ring == 0)
+	{
+		if ((ring = newRing()) == 0)
+			return;
+		pthread_setspecific(ringKey, ring);
+	}
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	TraceRecord &event = ring->events[ring->head & (TRACE_RING_SIZE-1)];
+	event.time = ts.tv_sec + ts.tv_nsec * 1.0e-9;
+	event.thread = ring->thread;
+	event.name = name;
+	event.a = a;
+	event.b = b;
+	ring->head = ring->head + 1;
+#endif
+}
+
+
+/*
+ * One line per event with the time in seconds, the thread number, the
+ * name and the two numbers, oldest first for each thread in turn.
+ */
+int
+traceDump(FILE *fp)
+{
+	unsigned int ii, head, first;
+	int count = 0, rr;
+
+	ringMutex.lock();
+	int n = nrings;
+	ringMutex.unlock();
+	for (rr=0; rr<n; rr++)
+	{
+		TraceRing *ring = rings[rr];
+		head = ring->head;
+		first = (head > TRACE_RING_SIZE) ? head - TRACE_RING_SIZE : 0;
+		for (ii=first; ii<head; ii++)
+		{
+			const TraceRecord &event = ring->events[ii & (TRACE_RING_SIZE-1)];
+			fprintf(fp, "%.6f %2d %-32s %g %g\n", event.time, event.thread, event.name, event.a, event.b);
+			count++;
+		}
+	}
+	return count;
+}
@@ -0,0 +1,32 @@
+/* > trace.h
+ * 1.00 arb
+ */
+
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdio.h>
+
+
+/*
+ * Tracing of events in the hot paths, where debugf would format its
+ * arguments on every call whatever the debug level.  An event is a name,
+ * which must be a string literal as only its address is kept, and two
+ * numbers, stored with the time in a ring buffer belonging to the thread
+ * without taking any lock.  The most recent events of every thread can
+ * be written out at any time by traceDump.
+ * Tracing is only built in when USE_TRACE is defined, otherwise TRACE
+ * compiles to nothing and its arguments are not evaluated.
+ */
+#ifdef USE_TRACE
+#define TRACE(name, a, b) traceEvent(name, (double)(a), (double)(b))
+#else
+#define TRACE(name, a, b) ((void)0)
+#endif
+
+extern void traceEvent(const char *name, double a, double b);
+// Write out the events as text, returning the number written
+extern int traceDump(FILE *fp);
+
+
+#endif // !TRACE_H
@@ -1,10 +1,23 @@
 /* > xqct.cpp
+ * 1.14 arb Mon Oct 19 23:59:55 BST 2026 - particles only in the view
+ * 1.13 arb Mon Oct 19 23:59:53 BST 2026 - stream field only around the view
+ * 1.12 arb Mon Oct 19 23:59:39 BST 2026 - load and select the tidal data in TidalDataset
+ * 1.11 arb Mon Oct 19 23:59:14 BST 2026 - print at the printer's resolution
+ * 1.10 arb Mon Oct 19 23:57:48 BST 2026 - particles carried by the stream
+ * 1.09 arb Mon Oct 19 23:56:12 BST 2026 - stream field
+ * 1.08 arb Mon Oct 19 23:54:37 BST 2026 - play the tides as an animation
+ * 1.07 arb Mon Oct 19 23:41:20 BST 2026 - repaint overlays once per change
+ * 1.06 arb Mon Oct 19 22:38:15 BST 2026 - trace plotting, dump trace
+ * 1.05 arb Mon Oct 19 20:41:07 BST 2026 - tile memory setting
+ * 1.04 arb Mon Oct 19 19:55:18 BST 2026 - fractional zoom about the mouse
+ * 1.03 arb Mon Oct 19 17:48:26 BST 2026 - tile cache settings
+ * 1.02 arb Mon Oct 19 16:20:31 BST 2026 - zoom without reloading the chart
  * 1.01 arb Fri Jul 30 19:05:09 BST 2010 - Finished nice version.
  * 1.00 arb Sat Jul 10 19:47:16 BST 2010 - Finished most basic version.
  * 0.01 arb Mon May 17 10:20:36 BST 2010
  */
 
-static const char SCCSid[] = "@(#)xqct.cpp      1.01 (C) 2010 arb QuickChart display";
+static const char SCCSid[] = "@(#)xqct.cpp      1.14 (C) 2010 arb QuickChart display";
 
 
 /*
@@ -22,8 +35,20 @@ static const char SCCSid[] = "@(#)xqct.cpp      1.01 (C) 2010 arb QuickChart dis
  * Define RESTRICT_TIDAL_LEVELS_TO_SELECTED_CHART similarly.
  * Define ARROW_SCALE to make them visible.
  * Define DEFAULT_CHART as first chart to load
- * Define DEFAULT_TIDE_DATA_DIR as directory containing .C1 and .T1 files
+ * Define DEFAULT_TIDE_DATA_DIR as directory containing the archives of .C1
+ *  and .T1 files (see tidedataset.cpp)
  * Define DEFAULT_HARMONICS_FILE as 
+ * Define SLIDER_STEPS as the number of TIDECALC_INTERVAL_MINS on the slider.
+ * Define ANIMATE_FRAME_MS as the time between frames when playing the tides
+ *  and DEFAULT_ANIMATE_MINS_PER_SEC as how fast the tides go.
+ * Define FIELD_SPACING as the pixels between the arrows of the stream field,
+ *  FIELD_RADIUS as how far from a diamond it reaches (and how far beyond
+ *  the view the field is made, so it isn't made again for small scrolls)
+ *  and FIELD_ARROW_SCALE as the length of its arrows for one knot.
+ * Define PARTICLE_COUNT as the number of particles carried by the stream,
+ *  PARTICLE_FADE as how much of their trails is left after each frame
+ *  (out of 256) and PARTICLE_MAX_STEP_MINS as the longest time they are
+ *  moved in one frame, anything longer is a jump so they stay put.
  */
 #define DEFAULT_TL_MUST_BE_ON_CHART    false // could be on other charts
 #define DEFAULT_TL_MUST_BE_UNIQUE      true  // XXX should be true after debugged
@@ -36,14 +61,26 @@ static const char SCCSid[] = "@(#)xqct.cpp      1.01 (C) 2010 arb QuickChart dis
 //#define DEFAULT_CHART_DIR      "/mnt/hgfs/VM/tide/maptech"
 #define DEFAULT_CHART_DIR       qApp->applicationDirPath()+DIRSEPSTR+"qct"
 #define DEFAULT_TIDE_DATA_DIR   qApp->applicationDirPath()
-#define DEFAULT_TIDEC1_ZIP     "tidec1.zip"
-#define DEFAULT_TIDET1_ZIP     "tidet1.zip"
 #define DEFAULT_TIDE_ZIP_PASSWORD QString::null
 //#define DEFAULT_HARMONICS_FILE "harmonics-dwf-20091227-nonfree.tcd"
 #define DEFAULT_HARMONICS_FILE "tcd/world.tcd"
 #define DEFAULT_ZOOM_OUT_LEVEL 1 // full size
+#define WHEEL_ZOOM_STEP 1.189207115 // fourth root of 2, four wheel clicks to halve
+#define DEFAULT_TILE_CACHE_DIR  QDir::homeDirPath()+DIRSEPSTR+".xqct-tiles"
+#define DEFAULT_TILE_CACHE_MB   512 // 0 to not keep decoded tiles on disk
+#define DEFAULT_TILE_MEMORY_MB  256 // decoded tiles kept in memory for all charts
 #define PRINTER_MARGIN_CM      1 // 1 cm margins
-#define TIDE_MAX_LINE_LEN    512 // typically 450 bytes max
+#define SLIDER_STEPS           (TIDECALC_PERDAY*3) // three days
+#define ANIMATE_FRAME_MS       40 // 25 frames a second
+#define DEFAULT_ANIMATE_MINS_PER_SEC 60 // a tidal hour each second
+#define DEFAULT_SHOW_STREAM_FIELD false
+#define FIELD_SPACING          24
+#define FIELD_RADIUS           240
+#define FIELD_ARROW_SCALE      10
+#define DEFAULT_SHOW_PARTICLES false
+#define PARTICLE_COUNT         4000
+#define PARTICLE_FADE          232
+#define PARTICLE_MAX_STEP_MINS 60
 
 /*
  * Bugs:
@@ -63,20 +100,11 @@ static const char SCCSid[] = "@(#)xqct.cpp      1.01 (C) 2010 arb QuickChart dis
  * Date editing: remember last used date or today's date for next time,
  *  button for today, buttons for prev/next day/week
  *  Slider at bottom for day?
- * Printing:
- *   Print at full resolution
- * Map display:
- *   Load tiles as needed instead of all at once
- *   Scale down uses colour interpolation vertically as well as horiz
- *   Zoom in/out should reload just image data not whole QCT file
- *     (then wouldn't have to reload tide data either)
- *     Same code could be used by printing to get full resolution.
  * Nice to have:
  *   Show moon phase in status bar
  *   Overlays, eg.
  *     positions of wrecks,
  *     boat launch locations,
- *   Zoom should reposition based on mouse position not map center
  *   Collect all output (errors etc) into a log window
  *   Is a graph of tide height or current over time useful?
  */
@@ -86,6 +114,8 @@ static const char SCCSid[] = "@(#)xqct.cpp      1.01 (C) 2010 arb QuickChart dis
 #include <qapplication.h>
 #include <qcolordialog.h>
 #include <qdragobject.h>
+#include <qcursor.h>           // for QCursor::pos
+#include <qdir.h>              // for homeDirPath
 #include <qfile.h>
 #include <qfiledialog.h>
 #include <qgrid.h>
@@ -103,6 +133,7 @@ static const char SCCSid[] = "@(#)xqct.cpp      1.01 (C) 2010 arb QuickChart dis
 #include <qregexp.h>
 #include <qsettings.h>
 #include <qslider.h>
+#include <qspinbox.h>
 #include <qstatusbar.h>
 #include <qtimer.h>
 #include <qtoolbar.h>
@@ -112,13 +143,14 @@ static const char SCCSid[] = "@(#)xqct.cpp      1.01 (C) 2010 arb QuickChart dis
 
 #include <stdio.h>
 #include <string.h>
+#include <math.h>
 #include <errno.h>
 #include "satlib/dundee.h"
+#include "trace.h"
 #include "satqt/qapp.h"        // for UNICODE_ definitions
 #include "satqt/helpdialog.h"
 #include "satqt/mrumenu.h"
 #include "satqt/inputdialog.h"
-#include "satqt/qzip.h"
 #include "satqt/calendardialog.h"
 #include "satqt/fileopen.xpm"
 #include "satqt/filesave.xpm"
@@ -141,42 +173,6 @@ static const char *LOG_E = "error";
 static const char *LOG_I = "xqct";
 
 
-/* ----------------------------------------------------------------------------
- * For checking whether two tidal locations are close enough that they would
- * overlap or in fact are identical duplicates and so only one is necessary.
- * XXX should get pixel resolution in degrees from QCT and return closeEnough
- * if with so many pixels rather than so many degrees.
- */
-static double
-distanceBetween(double lat0, double lon0, double lat1, double lon1)
-{
-	// Should calculate Great Circle distance, but OK for close points
-	// Don't bother to take the square root for speed.
-	//debugf(1,"dist %f->%f and %f->%f = %f\n",lat0,lat1,lon0,lon1,((lat1-lat0)*(lat1-lat0) + (lon1-lon0)*(lon1-lon0)));
-	return ((lat1-lat0)*(lat1-lat0) + (lon1-lon0)*(lon1-lon0));
-}
-
-static bool
-closeEnough(double distSquared)
-{
-	// If absolute difference is less than 0.00045 then close (~50 meters of latitude)
-	// return (distSquared < (0.00045 * 0.00045));
-	// If absolute difference is less than 0.0009 then close (~100 meters of latitude)
-	// return (distSquared < (0.0009 * 0.0009));
-	// Some of the tidal stream locations are so far off that we need to return this to filter them:
-	return (distSquared < (0.00155 * 0.00155));
-}
-
-static bool
-closeEnough(double distSquared, double degreesPerPixel)
-{
-	double dist = sqrt(distSquared);
-	double pixels = dist / degreesPerPixel;
-	//debugf(1,"dist %f deg at %f deg per pix (%f pix per deg) is %f pixels\n",dist,degreesPerPixel,1.0/degreesPerPixel,pixels);
-	return (pixels < 20.0);
-}
-
-
 /* ----------------------------------------------------------------------------
  * Main window
  */
@@ -238,6 +234,10 @@ DisplayWindow::DisplayWindow()
 	tidalStreamMenu = new QPopupMenu(viewMenu);
 	connect(tidalStreamMenu, SIGNAL(aboutToShow()), this, SLOT(showTidalStreamMenu()));
 	id = viewMenu->insertItem("Tidal &Diamond", tidalStreamMenu);
+	streamFieldMenuId = viewMenu->insertItem("Tidal Stream &Field", this, SLOT(toggleStreamField()));
+	viewMenu->setItemChecked(streamFieldMenuId, cfg_showStreamField);
+	particlesMenuId = viewMenu->insertItem("Tidal Stream &Particles", this, SLOT(toggleParticles()));
+	viewMenu->setItemChecked(particlesMenuId, cfg_showParticles);
 
 	// Create "Zoom" menu
 	QPopupMenu *zoomMenu = new QPopupMenu(viewMenu);
@@ -254,6 +254,9 @@ DisplayWindow::DisplayWindow()
 
 	helpMenu->insertItem( "&About", this, SLOT(about()), Key_F1 );
 	helpMenu->insertItem( "&Manual", this, SLOT(helpmanual()) );
+#ifdef USE_TRACE
+	helpMenu->insertItem( "Save &Trace...", this, SLOT(dumpTrace()) );
+#endif
 	helpMenu->insertSeparator();
 	helpMenu->insertItem( "What's &This", this, SLOT(whatsThis()), SHIFT+Key_F1 );
 
@@ -267,6 +270,15 @@ DisplayWindow::DisplayWindow()
 		this, SLOT(printScreen()), fileTools, "print map" );
 	new QToolButton( QPixmap(calendaricon3), "Change Date", QString::null,
 		this, SLOT(editDate()), fileTools, "change date" );
+	playButton = new QToolButton(fileTools, "play");
+	playButton->setTextLabel("Play");
+	playButton->setUsesTextLabel(true);
+	playButton->setToggleButton(true);
+	connect(playButton, SIGNAL(toggled(bool)), this, SLOT(play(bool)));
+	speedBox = new QSpinBox(5, 720, 5, fileTools, "speed");
+	speedBox->setSuffix(" min/s");
+	speedBox->setValue(cfg_animateMinsPerSec);
+	connect(speedBox, SIGNAL(valueChanged(int)), this, SLOT(setAnimateSpeed(int)));
 
 	// Main window contains a vertical box which groups:
 	// the map image, a slider, a label (status bar is at bottom)
@@ -278,8 +290,9 @@ DisplayWindow::DisplayWindow()
 	connect(qctimage, SIGNAL(location(double,double,long)), this, SLOT(mouse_moved(double,double)));
 	connect(qctimage, SIGNAL(mouseWheel(Qt::Orientation, int)), this, SLOT(mouse_wheel(Qt::Orientation, int)));
 	connect(qctimage, SIGNAL(contextMenu(double,double)), this, SLOT(context_menu(double,double)));
+	connect(qctimage, SIGNAL(contentsMoving(int,int)), this, SLOT(view_moving(int,int)));
 
-	slider = new QSlider(0, TIDECALC_PERDAY*3-1, 60/TIDECALC_INTERVAL_MINS, 0, QSlider::Horizontal, main, "slider");
+	slider = new QSlider(0, SLIDER_STEPS-1, 60/TIDECALC_INTERVAL_MINS, 0, QSlider::Horizontal, main, "slider");
 	slider->setFocus();
 	slider->setTickInterval(6);
 	slider->setTickmarks(QSlider::Below);
@@ -305,15 +318,22 @@ DisplayWindow::DisplayWindow()
 	slider_jtime = date_to_jtime(today.year(), today.month(), today.day(), 0, 0);
 	slider_offset = 0.0;
 
+	animateTimer = new QTimer(this);
+	connect(animateTimer, SIGNAL(timeout()), this, SLOT(animateFrame()));
+	framesValid = false;
+
 	// Start collecting maps (this will continue in a background thread)
 	// ie. in the constructor it calls mapCollectionPtr->collectMaps();
 	mapCollectionPtr = new QCTCollection(DEFAULT_CHART_DIR);
 
 	// Internal data
-	tidalStreamList.clear();
-	tidalStreamList.setAutoDelete(true);
-	tidalLevelList.clear();
-	tidalLevelList.setAutoDelete(true);
+	tidalDataset = new TidalDataset();
+	tidalStreamSet = new TidalStreamSet();
+	tidalStreamField = new TidalStreamField();
+	fieldValid = false;
+	tidalParticles = new TidalParticles();
+	particlesValid = false;
+	particleOffset = 0;
 	tideCalcPtr = new TideCalc();
 	moonCalcPtr = new MoonCalc();
 
@@ -342,6 +362,10 @@ DisplayWindow::~DisplayWindow()
 
 	delete tideCalcPtr;
 	delete moonCalcPtr;
+	delete tidalStreamSet;
+	delete tidalStreamField;
+	delete tidalParticles;
+	delete tidalDataset;
 	delete mapCollectionPtr;
 }
 
@@ -383,6 +407,12 @@ void DisplayWindow::loadSettings()
 	cfg_TSmustHaveKnownRef = settings->readBoolEntry("TSmustHaveKnownRef", DEFAULT_TS_MUST_HAVE_KNOWN_REF);
 	// map 0,1,2,3 to 1,2,4,8
 	cfg_zoomOutLevel       = 1 << settings->readNumEntry("zoomOutLevel", DEFAULT_ZOOM_OUT_LEVEL);
+	cfg_tileCacheDir       = settings->readEntry("tileCacheDir", DEFAULT_TILE_CACHE_DIR);
+	cfg_tileCacheMB        = settings->readNumEntry("tileCacheMB", DEFAULT_TILE_CACHE_MB);
+	cfg_tileMemoryMB       = settings->readNumEntry("tileMemoryMB", DEFAULT_TILE_MEMORY_MB);
+	cfg_animateMinsPerSec  = settings->readNumEntry("animateMinsPerSec", DEFAULT_ANIMATE_MINS_PER_SEC);
+	cfg_showStreamField    = settings->readBoolEntry("showStreamField", DEFAULT_SHOW_STREAM_FIELD);
+	cfg_showParticles      = settings->readBoolEntry("showParticles", DEFAULT_SHOW_PARTICLES);
 }
 
 
@@ -390,8 +420,8 @@ void DisplayWindow::loadSettings()
  */
 void DisplayWindow::saveSettings()
 {
-	// map 1,2,4,8 to 0,1,2,3
-	int level = cfg_zoomOutLevel==8?3:(cfg_zoomOutLevel==4?2:(cfg_zoomOutLevel==2?1:0));
+	// map 1,2,4,8 to 0,1,2,3 (zooms in between are saved as the next larger)
+	int level = cfg_zoomOutLevel>=8?3:(cfg_zoomOutLevel>=4?2:(cfg_zoomOutLevel>=2?1:0));
 	//printf("saveSettings zoom %d save %d\n", cfg_zoomOutLevel, level);
 	//printf("saveSettings TSmustBeUnique=%s\n", cfg_TSmustBeUnique?"true":"false");
 	settings->writeEntry("x", x());
@@ -410,6 +440,12 @@ void DisplayWindow::saveSettings()
 	settings->writeEntry("TSmustBeUnique",     cfg_TSmustBeUnique);
 	settings->writeEntry("TSmustHaveKnownRef", cfg_TSmustHaveKnownRef);
 	settings->writeEntry("zoomOutLevel",       level);
+	settings->writeEntry("tileCacheDir",       cfg_tileCacheDir);
+	settings->writeEntry("tileCacheMB",        cfg_tileCacheMB);
+	settings->writeEntry("tileMemoryMB",       cfg_tileMemoryMB);
+	settings->writeEntry("animateMinsPerSec",  cfg_animateMinsPerSec);
+	settings->writeEntry("showStreamField",    cfg_showStreamField);
+	settings->writeEntry("showParticles",      cfg_showParticles);
 }
 
 
@@ -420,12 +456,24 @@ void DisplayWindow::slider_moved(int pos)
 	slider_offset = pos * TIDECALC_INTERVAL_MINS;
 	debugf(1, "slider_moved pos %d is mins %f\n", pos, slider_offset);
 
+	// When playing carry on from the new position
+	if (animateTimer->isActive())
+	{
+		animateStart = slider_offset;
+		animateClock.start();
+		animateLastFrame = 0;
+		plotFrame(slider_offset);
+		return;
+	}
+
 	// Update the current time in the status bar
 	dateLabel->setText(QString(jctime(slider_jtime + slider_offset)));
 
 	QApplication::setOverrideCursor(waitCursor);
+	qctimage->beginPlot();
 	plotTidalStreams();
 	plotTidalLevels();
+	qctimage->commitPlot();
 	QApplication::restoreOverrideCursor();
 }
 
@@ -483,19 +531,11 @@ DisplayWindow::mouse_wheel(Qt::Orientation orient, int delta)
 {
 	if (orient == Qt::Horizontal)
 		return;
-	bool positive = delta > 0;
-	int newzoom = cfg_zoomOutLevel;
-	if (!positive && newzoom < 8)
-	{
-		newzoom <<= 1;
-	}
-	else if (positive && newzoom > 1)
-	{
-		newzoom >>= 1;
-	}
-	debugf(1,"mouse_wheel delta %d new level %d\n",delta,newzoom);
-	if (newzoom != cfg_zoomOutLevel)
-		changeZoom(newzoom);
+	// Each click of the wheel (delta 120) zooms by a step, about the mouse
+	double newzoom = cfg_zoomOutLevel * pow(WHEEL_ZOOM_STEP, -delta / 120.0);
+	QPoint pos = qctimage->viewport()->mapFromGlobal(QCursor::pos());
+	debugf(1,"mouse_wheel delta %d new zoom %f at %d,%d\n",delta,newzoom,pos.x(),pos.y());
+	zoomAt(newzoom, pos.x(), pos.y());
 }
 
 
@@ -535,26 +575,26 @@ DisplayWindow::context_menu(double latN, double lonE)
 
 	// Add an entry for tidal levels
 	nn = 0;
-	for ( TidalLevel *tlpiter = tidalLevelList.first(); tlpiter; tlpiter = tidalLevelList.next() )
+	for (nn=0; nn<(int)tidalLevelList.count(); nn++)
 	{
-		if (closeEnough(distanceBetween(latN, lonE, tlpiter->getLat(), tlpiter->getLon()), qctimage->getQct()->getDegreesPerPixel()))
+		TidalLevel *tlpiter = tidalLevelList[nn];
+		if (TidalDataset::closeTogether(latN, lonE, tlpiter->getLat(), tlpiter->getLon(), qctimage->getDegreesPerPixel()))
 		{
 			//debugf(2, "  %s at %f %f\n", (const char*)tlpiter->getName(), tlpiter->getLat(), tlpiter->getLon());
 			id = contextMenu->insertItem(tlpiter->getName(), this, SLOT(context_menu_level(int)), 0, nn);
 		}
-		nn++;
 	}
 
 	// Add an entry for tidal streams
 	nn = 0;
-	for ( TidalStream *tspiter = tidalStreamList.first(); tspiter; tspiter = tidalStreamList.next() )
+	for (nn=0; nn<(int)tidalStreamList.count(); nn++)
 	{
-		if (closeEnough(distanceBetween(latN, lonE, tspiter->getLat(), tspiter->getLon()), qctimage->getQct()->getDegreesPerPixel()))
+		TidalStream *tspiter = tidalStreamList[nn];
+		if (TidalDataset::closeTogether(latN, lonE, tspiter->getLat(), tspiter->getLon(), qctimage->getDegreesPerPixel()))
 		{
 			//debugf(2, "  %s at %f %f ref %s\n", (const char*)tspiter->getName(), tspiter->getLat(), tspiter->getLon(), (const char*)tspiter->getRef());
-			id = contextMenu->insertItem(tspiter->getName() + " via "+tspiter->getRef(), this, SLOT(context_menu_stream(int)), 0, nn);
+			id = contextMenu->insertItem(tspiter->getName() + " via "+tideCalcPtr->getStationName(tspiter->getRefStation()), this, SLOT(context_menu_stream(int)), 0, nn);
 		}
-		nn++;
 	}
 
 	contextMenu->exec(QCursor::pos());
@@ -580,29 +620,23 @@ void
 DisplayWindow::context_menu_level(int id)
 {
 	debugf(1, "Context menu Level %d\n", id);
-	int nn = 0;
-	for ( TidalLevel *tlpiter = tidalLevelList.first(); tlpiter; tlpiter = tidalLevelList.next() )
-	{
-		if (nn == id)
-		{
-			debugf(1, "  is %s\n", (const char*)tlpiter->getName());
-			QMessageBox::information(this, "Tidal Level",
-				QString("<p>The tidal level %1 has:<ul>"
-				"<li>Mean High Water (Spring) %2"
-				"<li>Mean Low Water (Spring) %3"
-				"<li>Mean High Water (Neap) %4"
-				"<li>Mean Low Water (Neap) %5"
-				"<li>Current Level %6</ul>")
-				.arg(tlpiter->getName())
-				.arg(tlpiter->getMHWS())
-				.arg(tlpiter->getMLWS())
-				.arg(tlpiter->getMHWN())
-				.arg(tlpiter->getMLWN())
-				.arg(tlpiter->getCurrentLevel()));
-			break;
-		}
-		nn++;
-	}
+	if (id < 0 || id >= (int)tidalLevelList.count())
+		return;
+	TidalLevel *tlpiter = tidalLevelList[id];
+	debugf(1, "  is %s\n", (const char*)tlpiter->getName());
+	QMessageBox::information(this, "Tidal Level",
+		QString("<p>The tidal level %1 has:<ul>"
+		"<li>Mean High Water (Spring) %2"
+		"<li>Mean Low Water (Spring) %3"
+		"<li>Mean High Water (Neap) %4"
+		"<li>Mean Low Water (Neap) %5"
+		"<li>Current Level %6</ul>")
+		.arg(tlpiter->getName())
+		.arg(tlpiter->getMHWS())
+		.arg(tlpiter->getMLWS())
+		.arg(tlpiter->getMHWN())
+		.arg(tlpiter->getMLWN())
+		.arg(tlpiter->getCurrentLevel()));
 }
 
 
@@ -610,26 +644,20 @@ void
 DisplayWindow::context_menu_stream(int id)
 {
 	debugf(1, "Context menu Stream %d\n", id);
-	int nn = 0;
-	for ( TidalStream *tspiter = tidalStreamList.first(); tspiter; tspiter = tidalStreamList.next() )
-	{
-		if (nn == id)
-		{
-			debugf(1, "  is %s\n", (const char*)tspiter->getName());
-			float bearing = tspiter->getCurrentBearing();
-			QMessageBox::information(this, "Tidal Stream",
-				QString("<p>The tidal stream %1 is:<ul>"
-				"<li>referenced to the tidal station %2"
-				"<li>current bearing %3 degrees clockwise from North"
-				"<li>current rate %4 knots</ul>")
-				.arg(tspiter->getName())
-				.arg(tspiter->getRef())
-				.arg(bearing < 0 ? bearing+360.0 : bearing)
-				.arg(tspiter->getCurrentRate()));
-			break;
-		}
-		nn++;
-	}
+	if (id < 0 || id >= (int)tidalStreamList.count())
+		return;
+	TidalStream *tspiter = tidalStreamList[id];
+	debugf(1, "  is %s\n", (const char*)tspiter->getName());
+	float bearing = tspiter->getCurrentBearing();
+	QMessageBox::information(this, "Tidal Stream",
+		QString("<p>The tidal stream %1 is:<ul>"
+		"<li>referenced to the tidal station %2"
+		"<li>current bearing %3 degrees clockwise from North"
+		"<li>current rate %4 knots</ul>")
+		.arg(tspiter->getName())
+		.arg(tideCalcPtr->getStationName(tspiter->getRefStation()))
+		.arg(bearing < 0 ? bearing+360.0 : bearing)
+		.arg(tspiter->getCurrentRate()));
 }
 
 
@@ -640,15 +668,33 @@ DisplayWindow::context_menu_stream(int id)
 void
 DisplayWindow::changeZoom(int id)
 {
-	debugf(1,"Changezoom from %d to %d\n", cfg_zoomOutLevel, id);
-	cfg_zoomOutLevel = id;
-	// XXX check map already loaded first??
-	double lat, lon;
-	qctimage->latLonOfCenter(&lat, &lon);
-	debugf(1,"map center before %f %f\n",lat,lon);
-	loadNewMapFile(mapFilename);
-	qctimage->scrollToLatLon(lat, lon);
-	debugf(1,"map center after  %f %f\n",lat,lon);
+	zoomAt(id, qctimage->visibleWidth() / 2, qctimage->visibleHeight() / 2);
+}
+
+
+/*
+ * Zoom to any reduction factor keeping the chart still at the given point
+ * of the view.  The image keeps every zoom level so the file isn't reloaded.
+ */
+void
+DisplayWindow::zoomAt(double newzoom, int x, int y)
+{
+	debugf(1,"Changezoom from %f to %f\n", cfg_zoomOutLevel, newzoom);
+	if (qctimage->getQct() == 0)
+		return;
+	qctimage->zoomAt(newzoom, x, y);
+	cfg_zoomOutLevel = qctimage->getZoom();
+
+	// Reselect the tide info as duplicates depend on the scale
+	loadTidalData();
+
+	// Plot the overlays at the new scale
+	QApplication::setOverrideCursor(waitCursor);
+	qctimage->beginPlot();
+	plotTidalStreams();
+	plotTidalLevels();
+	qctimage->commitPlot();
+	QApplication::restoreOverrideCursor();
 }
 
 
@@ -660,10 +706,11 @@ DisplayWindow::showTidalLevelMenu()
 {
 	int id, nn = 0;
 	tidalLevelMenu->clear();
-	for ( TidalLevel *tlpiter = tidalLevelList.first(); tlpiter; tlpiter = tidalLevelList.next() )
+	for (nn=0; nn<(int)tidalLevelList.count(); nn++)
 	{
+		TidalLevel *tlpiter = tidalLevelList[nn];
 		QString label(tlpiter->getName());
-		id = tidalLevelMenu->insertItem(label, this, SLOT(tidalLevelMenuSelected(int)), 0, nn++);
+		id = tidalLevelMenu->insertItem(label, this, SLOT(tidalLevelMenuSelected(int)), 0, nn);
 	}
 	if (!nn)
 		tidalLevelMenu->setItemEnabled(tidalLevelMenu->insertItem("No Tidal Levels loaded or none on this chart"), false);
@@ -672,10 +719,10 @@ DisplayWindow::showTidalLevelMenu()
 void
 DisplayWindow::tidalLevelMenuSelected(int id)
 {
-	if (id < 0 || id > tidalLevelList.count()-1)
+	if (id < 0 || id >= (int)tidalLevelList.count())
 		return;
-	qctimage->scrollToLatLon(tidalLevelList.at(id)->getLat(),
-		tidalLevelList.at(id)->getLon());
+	qctimage->scrollToLatLon(tidalLevelList[id]->getLat(),
+		tidalLevelList[id]->getLon());
 }
 
 
@@ -687,12 +734,13 @@ DisplayWindow::showTidalStreamMenu()
 {
 	int id, nn = 0;
 	tidalStreamMenu->clear();
-	for ( TidalStream *tspiter = tidalStreamList.first(); tspiter; tspiter = tidalStreamList.next() )
+	for (nn=0; nn<(int)tidalStreamList.count(); nn++)
 	{
+		TidalStream *tspiter = tidalStreamList[nn];
 		QString label(tspiter->getName());
 		label += " on " + tspiter->getChart();
-		label += " via " + tspiter->getRef();
-		id = tidalStreamMenu->insertItem(label, this, SLOT(tidalStreamMenuSelected(int)), 0, nn++);
+		label += " via " + tideCalcPtr->getStationName(tspiter->getRefStation());
+		id = tidalStreamMenu->insertItem(label, this, SLOT(tidalStreamMenuSelected(int)), 0, nn);
 	}
 	if (!nn)
 		tidalStreamMenu->setItemEnabled(tidalStreamMenu->insertItem("No Tidal Streams loaded or none on this chart"), false);
@@ -701,10 +749,10 @@ DisplayWindow::showTidalStreamMenu()
 void
 DisplayWindow::tidalStreamMenuSelected(int id)
 {
-	if (id < 0 || id > tidalStreamList.count()-1)
+	if (id < 0 || id >= (int)tidalStreamList.count())
 		return;
-	qctimage->scrollToLatLon(tidalStreamList.at(id)->getLat(),
-		tidalStreamList.at(id)->getLon());
+	qctimage->scrollToLatLon(tidalStreamList[id]->getLat(),
+		tidalStreamList[id]->getLon());
 }
 
 
@@ -726,7 +774,7 @@ DisplayWindow::saveMapMetadata()
 	if (qctimage->latLonOfCenter(&lat, &lon))
 	{
 		QString metadata;
-		metadata.sprintf("%d;%f;%f", cfg_zoomOutLevel, lat, lon);
+		metadata.sprintf("%g;%f;%f", cfg_zoomOutLevel, lat, lon);
 		mruMenu->setMostRecentMetadata(metadata);
 	}
 }
@@ -759,8 +807,10 @@ DisplayWindow::loadNewMapFile(const QString &qctname, const QString &qctMetadata
 
 	// Plot the overlays
 	QApplication::setOverrideCursor(waitCursor);
+	qctimage->beginPlot();
 	plotTidalStreams();
 	plotTidalLevels();
+	qctimage->commitPlot();
 	QApplication::restoreOverrideCursor();
 
 	// Update the current time in the status bar
@@ -779,18 +829,20 @@ DisplayWindow::loadMapFile(const QString &qctname, const QString &qctMetadata)
 	{
 		QStringList parts = QStringList::split(';', qctMetadata);
 		if (!parts[0].isEmpty())
-			cfg_zoomOutLevel = parts[0].toInt();
+			cfg_zoomOutLevel = parts[0].toDouble();
 		if (!parts[1].isEmpty())
 			lat = parts[1].toDouble();
 		if (!parts[1].isEmpty())
 			lon = parts[2].toDouble();
 	}
 
-	// Free the previous image
+	// Free the previous image (its tiles are kept for a while)
 	qctimage->unload();
 
 	// Load the new image at the configured zoom level
 	// Failure refreshes the screen to remove old one
+	QCTTileCache::instance()->setDiskCache(cfg_tileCacheDir, cfg_tileCacheMB);
+	QCTTileCache::instance()->setBudget(cfg_tileMemoryMB);
 	if (!qctimage->load(qctname, cfg_zoomOutLevel))
 	{
 		qctimage->updateContents();
@@ -822,235 +874,88 @@ DisplayWindow::loadMapFile(const QString &qctname, const QString &qctMetadata)
 
 
 /* ----------------------------------------------------------------------------
- * loadTidalData reads all *.C1 and *.T1 files containing tidal information,
- * sifts out the duplicates according to the cfg_ preferences
- * and appends to the lists tidalLevelList and tidalStreamList.
+ * The *.C1 and *.T1 files containing tidal information are read into
+ * tidalDataset once as they do not depend on the chart.  loadTidalData
+ * then sifts out the records for this chart and the duplicates according
+ * to the cfg_ preferences into the lists tidalLevelList and tidalStreamList,
+ * which keep their capacity so reloading doesn't allocate.  Both are done
+ * by TidalDataset so that xqctrender chooses the same ones.
  */
-
-bool
-DisplayWindow::loadTidalLevelFile(const QString &zipname, const QString &zippassword, const QString &filename)
+void
+DisplayWindow::loadTidalData()
 {
-#ifdef USE_UNZIP
-	ZipFile file(zipname);
-	file.setName(filename, zippassword);
-	if (!file.open(IO_ReadOnly))
-		return false;
-#else
-	QFile file(filename);
-	debugf(1, "load %s\n", (const char*)file.name());
-	if (!file.open(IO_ReadOnly))
-		return false;
-#endif
-	QString line;
-	while (file.readLine(line, TIDE_MAX_LINE_LEN) > 0)
+	int ii;
+
+	debugf(1, "loadTidalData\n");
+
+	if (tidalDataset->isEmpty())
+		tidalDataset->load(DEFAULT_TIDE_DATA_DIR, DEFAULT_TIDE_ZIP_PASSWORD, tideCalcPtr);
+
+	int require = 0;
+	if (cfg_TLmustBeOnChart)    require |= TidalDataset::LevelOnChart;
+	if (cfg_TLmustBeUnique)     require |= TidalDataset::LevelUnique;
+	if (cfg_TSmustBeOnChart)    require |= TidalDataset::StreamOnChart;
+	if (cfg_TSmustBeUnique)     require |= TidalDataset::StreamUnique;
+	if (cfg_TSmustHaveKnownRef) require |= TidalDataset::StreamKnownRef;
+	tidalDataset->select(qctimage->getQct(), qctimage->getDegreesPerPixel(), tideCalcPtr, require,
+		&tidalLevelList, &tidalStreamList);
+	tidalStreamSet->build(tidalStreamList);
+	framesValid = false;
+	fieldValid = false;
+	particlesValid = false;
+
+	debugf(1, "Final list of Tidal Level stations on this chart:\n");
+	for (ii=0; ii<(int)tidalLevelList.count(); ii++)
 	{
-		//debugf(1, "TL::%s", (const char*)line);
-		TidalLevel *tlp, *tlpiter;
-		tlp = new TidalLevel(line);
-		if (!tlp->isOk())
-		{
-			delete tlp;
-			continue;
-		}
-		// Ignore tide levels not on this chart
-		if (cfg_TLmustBeOnChart && (qctimage->getQct()->getIdentifier() != tlp->getChart()))
-		{
-			//debugf(1, "TL: %s != %s\n", (const char*)qctimage->getQct()->getIdentifier(), (const char*)tlp->getChart());
-			delete tlp;
-			continue;
-		}
-		// Ignore tide levels with coords outside boundary of this chart
-		if (!qctimage->getQct()->coordInsideMap(tlp->getLat(), tlp->getLon()))
-		{
-			//debugf(1, "TL: %s at %f,%f is not on this chart\n", (const char*)tlp->getName(), tlp->getLat(), tlp->getLon());
-			delete tlp;
-			continue;
-		}
-		// Check for duplicates, just ignore the new one
-		// assuming they actually are identical and first is ok
-		if (cfg_TLmustBeUnique)
-			for ( tlpiter = tidalLevelList.first(); tlpiter; tlpiter = tidalLevelList.next() )
-		{
-			if (closeEnough(distanceBetween(tlpiter->getLat(), tlpiter->getLon(), tlp->getLat(), tlp->getLon()), qctimage->getQct()->getDegreesPerPixel()))
-			{
-				debugf(2,"  IGNORE %s - same location as %s\n", (const char*)tlp->getName(), (const char*)tlpiter->getName());
-				delete tlp;
-				tlp = 0;
-				break;
-			}
-		}
-		if (tlp == 0)
-			continue;
-		debugf(1, "Tide Level: Spring Tide range %.1f to %.1f at %s\n", tlp->getMLWS(), tlp->getMHWS(), (const char*)tlp->getName());
-		debugf(1, "Tide Level: Neap Tide   range %.1f to %.1f at %s\n", tlp->getMLWN(), tlp->getMHWN(), (const char*)tlp->getName());
-		tidalLevelList.append(tlp);
+		TidalLevel *tlpiter = tidalLevelList[ii];
+		debugf(2, "  %s at %f %f\n", (const char*)tlpiter->getName(), tlpiter->getLat(), tlpiter->getLon());
 	}
-	file.close();
-	return true;
-}
-
 
-bool
-DisplayWindow::loadTidalStreamFile(const QString &zipname, const QString &zippassword, const QString &filename)
-{
-#ifdef USE_UNZIP
-	ZipFile file(zipname);
-	file.setName(filename, zippassword);
-	if (!file.open(IO_ReadOnly))
-		return false;
-#else
-	QFile file(filename);
-	debugf(1, "load %s\n", (const char*)file.name());
-	if (!file.open(IO_ReadOnly))
-		return false;
-#endif
-	QString line;
-	while (file.readLine(line, TIDE_MAX_LINE_LEN) > 0)
+	debugf(1, "Final list of Tidal Streams on this chart:\n");
+	for (ii=0; ii<(int)tidalStreamList.count(); ii++)
 	{
-		TidalStream *tsp, *tspiter;
-		tsp = new TidalStream(line);
-		if (!tsp->isOk())
-		{
-			delete tsp;
-			continue;
-		}
-		// Ignore tide streams not on this chart
-		// Can be useful to see all diamonds from other charts though
-		// (assuming they are within the chart boundary checked below)
-		if (cfg_TSmustBeOnChart && (qctimage->getQct()->getIdentifier() != tsp->getChart()))
-		{
-			//printf("TS: %s != %s\n", (const char*)qctimage->getQct()->getIdentifier(), (const char*)ts.getChart());
-			delete tsp;
-			continue;
-		}
-		// Ignore tide levels off this chart
-		if (!qctimage->getQct()->coordInsideMap(tsp->getLat(), tsp->getLon()))
-		{
-			//printf("TS: %s at %f,%f is not on this chart\n", (const char*)ts.getName(), ts.getLat(), ts.getLon());
-			delete tsp;
-			continue;
-		}
-		//debugf(1, "READ %s\n", (const char*)line);
-		debugf(1, "Tidal Stream %s referenced to %s at %sW (%f, %f)\n", (const char*)tsp->getName(), (const char*)tsp->getRef(), tsp->refAtHW()? "H":"L", tsp->getLat(), tsp->getLon());
-		// Ignore tide streams if ref station is not in tide database
-		if (cfg_TSmustHaveKnownRef)
-		{
-			double lat, lon;
-			if (!tideCalcPtr->getStationLocation(tsp->getRef(), &lat, &lon))
-			{
-				log_message(LOG_I, stderr, "TidalStream ignored because %s is not a recognised location", (const char*)tsp->getRef());
-				debugf(2, "  IGNORED %s - ref not in tide db %s\n", (const char*)tsp->getName(), (const char*)tsp->getRef());
-				delete tsp;
-				continue;
-			}
-		}
-		// See if there's already one at the location
-		if (cfg_TSmustBeUnique)
-			for ( tspiter = tidalStreamList.first(); tspiter; tspiter = tidalStreamList.next() )
-		{
-			if (closeEnough(distanceBetween(tspiter->getLat(), tspiter->getLon(), tsp->getLat(), tsp->getLon()), qctimage->getQct()->getDegreesPerPixel()))
-			{
-				// If both have the same reference station and location then they are
-				// hopefully identical (or we can't tell which is best) so ignore new one
-				if (tspiter->getRef() == tsp->getRef())
-				{
-					debugf(2, "  IGNORED - same location AND ref station, so identical\n");
-					delete tsp;
-					tsp = 0;
-					break;
-				}
-				// Find out which one has the closest reference station
-				double reflat0, reflon0, reflat1, reflon1;
-				double refdist1, refdist2;
-				debugf(2, "  compare %s\n", (const char*)tsp->getRef());
-				tideCalcPtr->getStationLocation(tsp->getRef(), &reflat0, &reflon0);
-				debugf(2, "  to      %s\n", (const char*)tspiter->getRef());
-				tideCalcPtr->getStationLocation(tspiter->getRef(), &reflat1, &reflon1);
-				refdist1 = distanceBetween(reflat0, reflon0, tsp->getLat(), tsp->getLon()); // new
-				refdist2 = distanceBetween(reflat1, reflon1, tsp->getLat(), tsp->getLon()); // old
-				debugf(2, "  REJECT - already in the list %f vs %f\n", refdist1, refdist2);
-				// XXX choose whether to reject the new one or delete the existing one
-				// Remove the one which is furthest away
-				// Could also deliberately choose the one with the same reference station
-				// ref station used by the nearest suborbinate station
-				// (eg. if this tidal diamond is close to Dundee and Dundee is referenced to Aberdeen)
-				if (refdist2 > refdist1)
-				{
-					// Remove the old one it is further away
-					// Could use replace but then the append below would have to be skipped
-					// so easiest to just remove the old one here and fall through to append
-					debugf(2, "    remove old one\n");
-					tidalStreamList.removeRef(tspiter);
-				}
-				else
-				{
-					// Ignore the new one it is further away
-					debugf(2, "    ignore new one\n");
-					delete tsp;
-					tsp = 0;
-				}
-				break;
-			}
-		}
-		if (tsp == 0)
-			continue;
-		tidalStreamList.append(tsp);
+		TidalStream *tspiter = tidalStreamList[ii];
+		debugf(2, "  %s at %f %f ref %s\n", (const char*)tspiter->getName(), tspiter->getLat(), tspiter->getLon(), (const char*)tspiter->getRef());
 	}
-	file.close();
-	return true;
 }
 
 
+/* ----------------------------------------------------------------------------
+ * Find the bearing and rate of all the streams in tidalStreamSet at jtime
+ */
 void
-DisplayWindow::loadTidalData()
+DisplayWindow::evaluateTidalStreams(double jtime)
 {
-#ifndef USE_UNZIP
-	QDir dir(dirname);
-	QStringList c1list = dir.entryList("*C10.C1");
-	QStringList t1list = dir.entryList("*T10.T1");
-		loadTidalLevelFile(dirname+"/"+(*diriter));
-		loadTidalLevelFile(dirname+"/"+(*diriter));
-#endif
-	debugf(1, "loadTidalData\n");
-
-	// Find all the files for year 2010 (have last two digits 10)
-	// Names BAnnTyy.T1 and BAnnCyy.C1
-	QString c1zip(DEFAULT_TIDE_DATA_DIR+DIRSEPSTR+DEFAULT_TIDEC1_ZIP);
-	QString t1zip(DEFAULT_TIDE_DATA_DIR+DIRSEPSTR+DEFAULT_TIDET1_ZIP);
-
-	ZipDir c1zipdir(c1zip);
-	ZipDir t1zipdir(t1zip);
-
-	QStringList c1list = c1zipdir.entryList("*C10.C1");
-	QStringList t1list = t1zipdir.entryList("*T10.T1");
-
-	QStringList::Iterator diriter;
-
-	// Read the Tide Levels files (*.T1) containing mean high/low water
-	tidalLevelList.clear();
-	for (diriter = t1list.begin(); diriter != t1list.end(); ++diriter)
-	{
-		loadTidalLevelFile(t1zip, DEFAULT_TIDE_ZIP_PASSWORD, *diriter);
-	}
+	TidalStream *tsp;
+	float tideHeight;
+	double jtimeHW;
+	double minsFromHW;
+	double lunarPhaseFraction;
+	int refstation;
+	int ii;
 
-	// Read the Tidal Streams files (*.C1) containing tidal diamonds
-	tidalStreamList.clear();
-	for (diriter = c1list.begin(); diriter != c1list.end(); ++diriter)
-	{
-		loadTidalStreamFile(c1zip, DEFAULT_TIDE_ZIP_PASSWORD, *diriter);
-	}
+	// Find how far through the moon's cycle we are
+	lunarPhaseFraction = moonCalcPtr->fractionFromSpringToNeap(jtime);
 
-	debugf(1, "Final list of Tidal Level stations on this chart:\n");
-	for ( TidalLevel *tlpiter = tidalLevelList.first(); tlpiter; tlpiter = tidalLevelList.next() )
+	// Find the time in the tidal cycle of each stream
+	// (the set keeps streams with the same reference station together)
+	refstation = -1;
+	minsFromHW = 0;
+	for (ii=0; ii<tidalStreamSet->count(); ii++)
 	{
-		debugf(2, "  %s at %f %f\n", (const char*)tlpiter->getName(), tlpiter->getLat(), tlpiter->getLon());
+		tsp = tidalStreamSet->getStream(ii);
+		// Find the reference port's nearest HW time
+		if (tsp->getRefStation() != refstation)
+		{
+			refstation = tsp->getRefStation();
+			tideCalcPtr->findNearestHighWater(refstation, jtime, &tideHeight, &jtimeHW);
+			minsFromHW = jtime - jtimeHW;
+		}
+		tidalStreamSet->setMinsFromRef(ii, minsFromHW);
 	}
 
-	debugf(1, "Final list of Tidal Streams on this chart:\n");
-	for ( TidalStream *tspiter = tidalStreamList.first(); tspiter; tspiter = tidalStreamList.next() )
-	{
-		debugf(2, "  %s at %f %f ref %s\n", (const char*)tspiter->getName(), tspiter->getLat(), tspiter->getLon(), (const char*)tspiter->getRef());
-	}
+	// Find the bearing and rate of all the streams at that time in the cycle
+	tidalStreamSet->evaluate(lunarPhaseFraction);
 }
 
 
@@ -1063,40 +968,183 @@ DisplayWindow::plotTidalStreams()
 {
 	TidalStream *tsp;
 	double jtime;
-	float tideHeight;
-	double jtimeHW;
 	float lat, lon;
 	float bearing, rate, length;
-	double minsFromHW;
-	double lunarPhaseFraction;
+	int ii;
 
 	jtime = slider_jtime + slider_offset;
 
-	debugf(1, "plotTidalStreams at %s\n", jctime(jtime));
+	TRACE("plotTidalStreams", jtime, 0);
 
-	// Find how far through the moon's cycle we are
-	lunarPhaseFraction = moonCalcPtr->fractionFromSpringToNeap(jtime);
+	evaluateTidalStreams(jtime);
 
 	// Remove all previously plotted arrows and refresh those screen areas
+	// (in one repaint with the new arrows)
+	qctimage->beginPlot();
 	qctimage->unplotArrows();
 
-	// Calculate new direction of all arrows and plot them
-	for (tsp = tidalStreamList.first(); tsp; tsp = tidalStreamList.next())
+	// Plot the new arrows
+	streamEast.resize(tidalStreamSet->count());
+	streamNorth.resize(tidalStreamSet->count());
+	for (ii=0; ii<tidalStreamSet->count(); ii++)
 	{
-		debugf(1, "plot TidalStream %s\n", (const char*)tsp->getName());
+		tsp = tidalStreamSet->getStream(ii);
+		TRACE("plot TidalStream", ii, 0);
 		// Where is this tidal stream
 		lat = tsp->getLat();
 		lon = tsp->getLon();
-		// Which port does this tidal stream reference
-		QString refstation = tsp->getRef();
-		// Find the port's nearest HW time
-		tideCalcPtr->findNearestHighWater(refstation, jtime, &tideHeight, &jtimeHW);
-		// Find the bearing and rate of the stream at that time in the cycle
-		minsFromHW = jtime - jtimeHW;
-		tsp->getStreamMinsFromRefAndMoon(minsFromHW, lunarPhaseFraction, &bearing, &rate);
+		bearing = tidalStreamSet->getBearing(ii);
+		rate = tidalStreamSet->getRate(ii);
+		tsp->setCurrent(bearing, rate); // used by getCurrentRate later in context menu
 		length = rate * ARROW_SCALE;
 		qctimage->plotArrow(lat, lon, bearing, length);
+		streamEast[ii] = rate * sin(RAD(bearing));
+		streamNorth[ii] = rate * cos(RAD(bearing));
+	}
+	plotStreamField();
+	plotParticles(0);
+	particleOffset = slider_offset;
+	qctimage->commitPlot();
+}
+
+
+/*
+ * Interpolate the streams (in streamEast and streamNorth) between the
+ * diamonds and plot them as a grid of small arrows.  The field only covers
+ * the view and FIELD_RADIUS around it, on a grid lined up with the whole
+ * chart so the arrows stay put when it is made again.  It is only made
+ * again when the streams or zoom change or the view scrolls out of it.
+ */
+void
+DisplayWindow::plotStreamField()
+{
+	int nstreams = tidalStreamSet->count();
+	int ii;
+
+	qctimage->unplotField();
+	if (!(cfg_showStreamField || cfg_showParticles) || qctimage->getQct() == 0 || nstreams == 0)
+		return;
+	if ((int)streamEast.size() != nstreams)
+		return; // not calculated yet
+	// The view can be larger than a chart zoomed out
+	QRect vis(qctimage->contentsX(), qctimage->contentsY(), qctimage->visibleWidth(), qctimage->visibleHeight());
+	vis &= QRect(0, 0, qctimage->contentsWidth(), qctimage->contentsHeight());
+	if (!fieldArea.contains(vis))
+		fieldValid = false;
+	if (!fieldValid)
+	{
+		int left = QMAX(0, vis.left() - FIELD_RADIUS) / FIELD_SPACING * FIELD_SPACING;
+		int top = QMAX(0, vis.top() - FIELD_RADIUS) / FIELD_SPACING * FIELD_SPACING;
+		int right = QMIN(qctimage->contentsWidth(), vis.right() + 1 + FIELD_RADIUS);
+		int bottom = QMIN(qctimage->contentsHeight(), vis.bottom() + 1 + FIELD_RADIUS);
+		fieldArea.setCoords(left, top, right - 1, bottom - 1);
+		QMemArray<float> x(nstreams), y(nstreams);
+		for (ii=0; ii<nstreams; ii++)
+		{
+			TidalStream *tsp = tidalStreamSet->getStream(ii);
+			int px, py;
+			qctimage->latLonToXY(tsp->getLat(), tsp->getLon(), &px, &py);
+			x[ii] = px;
+			y[ii] = py;
+		}
+		tidalStreamField->build(nstreams, x.data(), y.data(), left, top, right - left, bottom - top, FIELD_SPACING, FIELD_RADIUS);
+		fieldValid = true;
+		// The particles carry on but their choice of starting points has gone
+		particleArea = QRect();
 	}
+	tidalStreamField->evaluate(streamEast.data(), streamNorth.data());
+
+	if (!cfg_showStreamField)
+		return;
+	qctimage->plotField(tidalStreamField->getLeft(), tidalStreamField->getTop(),
+		tidalStreamField->getSpacing(), tidalStreamField->getColumns(), tidalStreamField->getRows());
+	for (ii=0; ii<tidalStreamField->count(); ii++)
+		qctimage->plotFieldArrow(tidalStreamField->getCell(ii), tidalStreamField->getBearing(ii),
+			QMIN(tidalStreamField->getRate(ii) * FIELD_ARROW_SCALE, FIELD_SPACING));
+}
+
+
+/*
+ * Move the particles along the stream field for the given minutes and
+ * add to their trails.  They start again whenever the streams change, and
+ * are kept in the view as only the trails in it are kept.
+ */
+void
+DisplayWindow::plotParticles(double minutes)
+{
+	if (!cfg_showParticles || !fieldValid || tidalStreamField->count() == 0 || qctimage->getQct() == 0)
+	{
+		qctimage->unplotTrails();
+		return;
+	}
+	QRect vis(qctimage->contentsX(), qctimage->contentsY(), qctimage->visibleWidth(), qctimage->visibleHeight());
+	if (!particlesValid)
+	{
+		tidalParticles->seed(PARTICLE_COUNT, *tidalStreamField, vis.left(), vis.top(), vis.width(), vis.height());
+		qctimage->unplotTrails();
+		particlesValid = true;
+		particleArea = vis;
+	}
+	else if (particleArea != vis)
+	{
+		tidalParticles->setArea(*tidalStreamField, vis.left(), vis.top(), vis.width(), vis.height());
+		particleArea = vis;
+	}
+	if (minutes <= 0 || minutes > PARTICLE_MAX_STEP_MINS)
+		return;
+	// In an hour a knot goes a nautical mile, a minute of latitude
+	float scale = minutes / 3600.0 / qctimage->getDegreesPerPixel();
+	tidalParticles->advect(*tidalStreamField, scale);
+	qctimage->plotTrails(tidalParticles->count(), tidalParticles->getPrevX(), tidalParticles->getPrevY(),
+		tidalParticles->getX(), tidalParticles->getY(), PARTICLE_FADE);
+}
+
+
+void
+DisplayWindow::toggleParticles()
+{
+	cfg_showParticles = !cfg_showParticles;
+	viewMenu->setItemChecked(particlesMenuId, cfg_showParticles);
+	qctimage->beginPlot();
+	plotStreamField();
+	plotParticles(0);
+	qctimage->commitPlot();
+}
+
+
+/*
+ * When the view scrolls out of the stream field it is made again around
+ * the new view, once the view has moved there.
+ */
+void
+DisplayWindow::view_moving(int x, int y)
+{
+	if (!(cfg_showStreamField || cfg_showParticles) || !fieldValid)
+		return;
+	QRect vis(x, y, qctimage->visibleWidth(), qctimage->visibleHeight());
+	if (!fieldArea.contains(vis & QRect(0, 0, qctimage->contentsWidth(), qctimage->contentsHeight())))
+		QTimer::singleShot(0, this, SLOT(view_moved()));
+}
+
+
+void
+DisplayWindow::view_moved()
+{
+	qctimage->beginPlot();
+	plotStreamField();
+	plotParticles(0);
+	qctimage->commitPlot();
+}
+
+
+void
+DisplayWindow::toggleStreamField()
+{
+	cfg_showStreamField = !cfg_showStreamField;
+	viewMenu->setItemChecked(streamFieldMenuId, cfg_showStreamField);
+	qctimage->beginPlot();
+	plotStreamField();
+	qctimage->commitPlot();
 }
 
 
@@ -1107,17 +1155,21 @@ DisplayWindow::plotTidalLevels()
 	double jtime;
 	float lat, lon;
 	float lowtide, hightide, tideHeight;
+	int ii;
 
 	jtime = slider_jtime + slider_offset;
 
-	debugf(1, "plotTidalLevels at %s\n", jctime(jtime));
+	TRACE("plotTidalLevels", jtime, 0);
 
 	// Remove all previously plotted tides and refresh those screen areas
+	// (in one repaint with the new tides)
+	qctimage->beginPlot();
 	qctimage->unplotTides();
 
 	// Calculate new direction of all arrows and plot them
-	for (tlp = tidalLevelList.first(); tlp; tlp = tidalLevelList.next())
+	for (ii=0; ii<(int)tidalLevelList.count(); ii++)
 	{
+		tlp = tidalLevelList[ii];
 		// Where is this tidal stream
 		lat = tlp->getLat();
 		lon = tlp->getLon();
@@ -1126,11 +1178,186 @@ DisplayWindow::plotTidalLevels()
 		lowtide = tlp->getMLWS();
 		hightide = tlp->getMHWS();
 		// Find the port's tide right now
-		tideCalcPtr->findTide(tlp->getName(), jtime, &tideHeight);
+		tideCalcPtr->findTide(tlp->getStation(), jtime, &tideHeight);
 		tlp->setCurrentLevel(tideHeight); // used by getCurrentLevel later in context menu
-		debugf(1, "plot TidalLevel %s = %f [%f .. %f]\n", (const char*)tlp->getName(), tideHeight, lowtide, hightide);
+		TRACE("plot TidalLevel", ii, tideHeight);
 		qctimage->plotTide(lat, lon, lowtide, hightide, tideHeight);
 	}
+	qctimage->commitPlot();
+}
+
+
+/* ----------------------------------------------------------------------------
+ * Playing the tides moves through the slider's range continuously, at
+ * cfg_animateMinsPerSec, wrapping round at the end.  Each frame shows
+ * the time given by the clock, so when drawing falls behind frames are
+ * dropped rather than the tides slowing down.  The streams and levels at
+ * every slider position are calculated once when needed and interpolated
+ * for the frames between them, so a frame only has to plot the overlays.
+ */
+void
+DisplayWindow::play(bool on)
+{
+	if (on == animateTimer->isActive())
+		return;
+	if (on)
+	{
+		animateStart = slider_offset;
+		animateClock.start();
+		animateReadoutClock.start();
+		animateLastFrame = 0;
+		animateFrames = animateDropped = animateMs = 0;
+		animateTimer->start(ANIMATE_FRAME_MS);
+	}
+	else
+	{
+		animateTimer->stop();
+		statusBar()->clear();
+		// Show the exact tides at the slider position it stopped at
+		slider_moved(slider->value());
+	}
+	if (playButton->isOn() != on)
+		playButton->setOn(on);
+}
+
+
+void
+DisplayWindow::setAnimateSpeed(int minsPerSec)
+{
+	// Carry on from the current position at the new speed
+	animateStart = slider_offset;
+	animateClock.start();
+	animateLastFrame = 0;
+	cfg_animateMinsPerSec = minsPerSec;
+}
+
+
+void
+DisplayWindow::animateFrame()
+{
+	int ms = animateClock.elapsed();
+	double range = SLIDER_STEPS * TIDECALC_INTERVAL_MINS;
+	double offset = fmod(animateStart + ms * cfg_animateMinsPerSec / 1000.0, range);
+
+	// Count the frames which were due since the last one but not shown
+	int frame = ms / ANIMATE_FRAME_MS;
+	if (frame > animateLastFrame + 1)
+		animateDropped += frame - animateLastFrame - 1;
+	animateLastFrame = frame;
+
+	TRACE("animateFrame", offset, frame);
+	QTime frameTime;
+	frameTime.start();
+	plotFrame(offset);
+	animateMs += frameTime.elapsed();
+	animateFrames++;
+
+	// Show how much of the time for each frame it takes to draw
+	if (animateReadoutClock.elapsed() >= 1000)
+	{
+		statusBar()->message(QString("Frame %1 ms of %2 ms, %3 dropped")
+			.arg(animateMs / (double)animateFrames, 0, 'f', 1)
+			.arg(ANIMATE_FRAME_MS)
+			.arg(animateDropped));
+		animateReadoutClock.start();
+		animateFrames = animateDropped = animateMs = 0;
+	}
+}
+
+
+/*
+ * Calculate the streams and levels at every slider position
+ */
+void
+DisplayWindow::precomputeFrames()
+{
+	int nstreams = tidalStreamSet->count(), nlevels = tidalLevelList.count();
+	float bearing, rate, tideHeight;
+	int step, ii;
+
+	TRACE("precomputeFrames", nstreams, nlevels);
+	QApplication::setOverrideCursor(waitCursor);
+	frameStreamU.resize(SLIDER_STEPS * nstreams);
+	frameStreamV.resize(SLIDER_STEPS * nstreams);
+	frameLevel.resize(SLIDER_STEPS * nlevels);
+	for (step=0; step<SLIDER_STEPS; step++)
+	{
+		double jtime = slider_jtime + step * TIDECALC_INTERVAL_MINS;
+		evaluateTidalStreams(jtime);
+		for (ii=0; ii<nstreams; ii++)
+		{
+			bearing = RAD(tidalStreamSet->getBearing(ii));
+			rate = tidalStreamSet->getRate(ii);
+			frameStreamU[step * nstreams + ii] = rate * sin(bearing);
+			frameStreamV[step * nstreams + ii] = rate * cos(bearing);
+		}
+		for (ii=0; ii<nlevels; ii++)
+		{
+			tideCalcPtr->findTide(tidalLevelList[ii]->getStation(), jtime, &tideHeight);
+			frameLevel[step * nlevels + ii] = tideHeight;
+		}
+	}
+	framesValid = true;
+	QApplication::restoreOverrideCursor();
+}
+
+
+/*
+ * Plot the streams and levels at offset minutes along the slider,
+ * moving the slider to match without it replotting everything.
+ */
+void
+DisplayWindow::plotFrame(double offset)
+{
+	int nstreams = tidalStreamSet->count(), nlevels = tidalLevelList.count();
+	float u, v, bearing, rate, tideHeight;
+	int ii;
+
+	if (!framesValid)
+		precomputeFrames();
+
+	double pos = offset / TIDECALC_INTERVAL_MINS;
+	int step0 = QMIN((int)pos, SLIDER_STEPS-1);
+	int step1 = QMIN(step0+1, SLIDER_STEPS-1);
+	float frac = pos - step0;
+
+	slider_offset = offset;
+	if (slider->value() != step0)
+	{
+		slider->blockSignals(true);
+		slider->setValue(step0);
+		slider->blockSignals(false);
+	}
+	dateLabel->setText(QString(jctime(slider_jtime + slider_offset)));
+
+	qctimage->beginPlot();
+	qctimage->unplotArrows();
+	streamEast.resize(nstreams);
+	streamNorth.resize(nstreams);
+	for (ii=0; ii<nstreams; ii++)
+	{
+		TidalStream *tsp = tidalStreamSet->getStream(ii);
+		u = frameStreamU[step0 * nstreams + ii] * (1-frac) + frameStreamU[step1 * nstreams + ii] * frac;
+		v = frameStreamV[step0 * nstreams + ii] * (1-frac) + frameStreamV[step1 * nstreams + ii] * frac;
+		rate = sqrt(u*u + v*v);
+		bearing = DEG(atan2(u, v));
+		tsp->setCurrent(bearing, rate); // used by getCurrentRate later in context menu
+		qctimage->plotArrow(tsp->getLat(), tsp->getLon(), bearing, rate * ARROW_SCALE);
+		streamEast[ii] = u;
+		streamNorth[ii] = v;
+	}
+	plotStreamField();
+	plotParticles(offset - particleOffset);
+	particleOffset = offset;
+	qctimage->unplotTides();
+	for (ii=0; ii<nlevels; ii++)
+	{
+		TidalLevel *tlp = tidalLevelList[ii];
+		tideHeight = frameLevel[step0 * nlevels + ii] * (1-frac) + frameLevel[step1 * nlevels + ii] * frac;
+		tlp->setCurrentLevel(tideHeight);
+		qctimage->plotTide(tlp->getLat(), tlp->getLon(), tlp->getMLWS(), tlp->getMHWS(), tideHeight);
+	}
+	qctimage->commitPlot();
 }
 
 
@@ -1142,6 +1369,7 @@ DisplayWindow::setDate(int Y, int M, int D, int h, int m)
 {
 	slider_jtime = date_to_jtime(Y, M, D, h, m);
 	slider_offset = 0.0;
+	framesValid = false;
 	int newpos = 0; // start at the left hand side
 	int curval = slider->value();
 	slider->setValue(newpos);
@@ -1318,12 +1546,9 @@ DisplayWindow::printMapSection(QRect section)
 			debugf(1, "pap<img, paper now %d,%d %dx%d\n", paper_left, paper_top, paper_width, paper_height);
 		}
 
+		// The chart is drawn at the printer's resolution a band at a time
 		QRect view( paper_left, paper_top, paper_width, paper_height );
-		painter.save();
-		painter.setViewport(view);   // device coordinate system (paper)
-		painter.setWindow(section);  // logical coordinate system (map pixels)
-		qctimage->render(&painter, xx, yy, ww, hh);
-		painter.restore();
+		qctimage->printSection(&painter, section, view);
 
 		QString text(jctime(slider_jtime+slider_offset));
 		//QRect textbbox = painter.boundingRect(xx, yy, 0, 0, AlignLeft|AlignTop, text);
@@ -1384,3 +1609,25 @@ DisplayWindow::helpmanual()
 	static HelpDialog *helpdialog = new HelpDialog(this, "xqct.html");
 	helpdialog->show();
 }
+
+
+/*
+ * Write out the most recent trace events (only in the menu if built with
+ * tracing, see trace.h).
+ */
+void
+DisplayWindow::dumpTrace()
+{
+	QString filename = QFileDialog::getSaveFileName(QString::null, "*.txt", this, "tracedialog");
+	if (filename.isEmpty())
+		return;
+	FILE *fp = fopen(QFile::encodeName(filename), "w");
+	if (fp == NULL)
+	{
+		QMessageBox::warning(this, progname, "Error saving trace");
+		return;
+	}
+	int count = traceDump(fp);
+	fclose(fp);
+	statusBar()->message(QString("%1 trace events saved").arg(count), 2000);
+}
@@ -4,6 +4,9 @@
 #include "satlib/dundee.h"
 #include <qmainwindow.h>
 #include <qpixmap.h>
+#include <qvaluevector.h>
+#include <qmemarray.h>
+#include <qdatetime.h>
 
 
 /*
@@ -18,6 +21,8 @@ class QSlider;
 //class QSettings;
 class KConfig; // replaces QSettings
 class QTimer;
+class QToolButton;
+class QSpinBox;
 class MRUMenu;
 
 class QCTImage;
@@ -25,6 +30,10 @@ class TideCalc;
 class MoonCalc;
 class TidalLevel;
 class TidalStream;
+class TidalStreamSet;
+class TidalStreamField;
+class TidalParticles;
+class TidalDataset;
 class QCTCollection;
 
 
@@ -43,14 +52,18 @@ public slots:
 	void editDate();                                      // prompt for date
 	void editPrefs();
 	void changeZoom(int reductionFactor);                 // 1, 2, 4 or 8
+	void zoomAt(double reductionFactor, int x, int y);    // about a point in the view
 	void saveMap();                                       // whole map without overlay
 	void saveScreen();                                    // just the area displayed with overlay
 	bool printMap();                                      // whole map (no longer used)
 	bool printScreen();                                   // just the area displayed
 
 private:
-	bool loadTidalLevelFile(const QString &zipname, const QString &zippassword, const QString &filename);
-	bool loadTidalStreamFile(const QString &zipname, const QString &zippassword, const QString &filename);
+	void evaluateTidalStreams(double jtime);
+	void precomputeFrames();
+	void plotFrame(double offset);
+	void plotStreamField();
+	void plotParticles(double minutes);
 
 private slots:
 	void loadSettings();
@@ -71,9 +84,17 @@ private slots:
 	void tidalLevelMenuSelected(int id);  // id is index into tidalLevelList
 	void plotTidalStreams();
 	void plotTidalLevels();
+	void toggleStreamField();
+	void toggleParticles();
+	void view_moving(int x, int y);
+	void view_moved();
+	void play(bool on);
+	void setAnimateSpeed(int minsPerSec);
+	void animateFrame();
 	void quit();
 	void about();
 	void helpmanual();
+	void dumpTrace();
 
 private:
 	// Constructing the GUI
@@ -83,6 +104,9 @@ private:
 	KConfig *settings; // was QSettings*
 	MRUMenu *mruMenu;
 	QSlider *slider;
+	int streamFieldMenuId, particlesMenuId;
+	QToolButton *playButton;
+	QSpinBox *speedBox;
 
 	// The map itself
 	QCTCollection *mapCollectionPtr;
@@ -93,18 +117,50 @@ private:
 	TideCalc *tideCalcPtr;
 	MoonCalc *moonCalcPtr;
 
-	// List of tidal streams on the currently-displayed map
-	QPtrList<TidalLevel>  tidalLevelList;
-	QPtrList<TidalStream> tidalStreamList;
+	// All tidal levels and streams, and those on the currently-displayed map
+	TidalDataset *tidalDataset;
+	QValueVector<TidalLevel*>  tidalLevelList;
+	QValueVector<TidalStream*> tidalStreamList;
+	TidalStreamSet *tidalStreamSet; // tidalStreamList ready for evaluation
+	// The streams interpolated between the diamonds, from the east and
+	// north components of each stream in tidalStreamSet
+	TidalStreamField *tidalStreamField;
+	bool fieldValid;
+	QRect fieldArea;             // of the contents it was built over
+	QMemArray<float> streamEast, streamNorth;
+	// Particles carried by the field, moved on each animation frame
+	TidalParticles *tidalParticles;
+	bool particlesValid;
+	QRect particleArea;          // of the contents they're kept in
+	double particleOffset;       // slider offset they were last moved to
 
 	// Slider time at the left and minutes offset
 	double slider_jtime;
 	double slider_offset;
 
+	// Animation, the slider offset is found from the time since it started
+	// so frames are dropped rather than falling behind
+	QTimer *animateTimer;
+	QTime animateClock;
+	double animateStart;         // slider offset when animateClock started
+	int animateLastFrame;        // number of the last frame shown
+	QTime animateReadoutClock;   // for the frame time readout each second
+	int animateFrames, animateDropped, animateMs;
+	// The streams (as east and north components) and levels at each slider
+	// position, precomputed for the animation and interpolated between
+	bool framesValid;
+	QMemArray<float> frameStreamU, frameStreamV, frameLevel;
+
 	// Configurable options
 	bool cfg_TLmustBeOnChart, cfg_TLmustBeUnique;
 	bool cfg_TSmustBeOnChart, cfg_TSmustBeUnique, cfg_TSmustHaveKnownRef;
-	int cfg_zoomOutLevel;        // 1, 2, 4 or 8
+	double cfg_zoomOutLevel;     // 1 is full size, 2 half size, etc.
+	QString cfg_tileCacheDir;    // where decoded chart tiles are kept
+	int cfg_tileCacheMB;         // size limit of the tile cache, 0 for none
+	int cfg_tileMemoryMB;        // size limit of the tiles kept in memory
+	int cfg_animateMinsPerSec;   // animation speed, 60 is an hour a second
+	bool cfg_showStreamField;    // arrows between the diamonds
+	bool cfg_showParticles;      // particles carried by the stream
 };
 
 
@@ -2,10 +2,10 @@ TEMPLATE    = app
 CONFIG      += qt warn_on debug thread unzip #exeprofile
 DEFINES     += DEBUG
 INCLUDEPATH += $(SWDEV)
-LIBS        += -lsatqt -losmap -lsat -lutils -lgif -larb -ltcd
+LIBS        += -lsatqt -losmap -lsat -lutils -lgif -larb -ltcd -lz
 INTERFACES += configdialog.ui
-HEADERS     = xqct.h   qctimage.h   tidedata.h   tidecalc.h   qctcollection.h
-SOURCES     = xqct.cpp qctimage.cpp tidedata.cpp tidecalc.cpp qctcollection.cpp
+HEADERS     = xqct.h   qctimage.h   qctfile.h   qcttiles.h   qctdiskcache.h   tidedata.h   tidecalc.h   tidezip.h   qctcollection.h   trace.h
+SOURCES     = xqct.cpp qctimage.cpp qctfile.cpp qcttiles.cpp qctdiskcache.cpp tidedata.cpp tidedataset.cpp tidecalc.cpp tidezip.cpp qctcollection.cpp trace.cpp
 SOURCES    += xqct_main.cpp
 IMAGES      = splash.png
 TARGET      = xqct
@@ -13,3 +13,12 @@ TARGET      = xqct
 unzip {
 	DEFINES += USE_UNZIP
 }
+
+lz4 {
+	DEFINES += USE_LZ4
+	LIBS    += -llz4
+}
+
+trace {
+	DEFINES += USE_TRACE
+}
@@ -0,0 +1,205 @@
+/* > xqctrender.cpp
+ * 1.01 arb Mon Oct 19 23:59:39 BST 2026 - same levels and streams as xqct
+ * 1.00 arb Mon Oct 19 23:58:21 BST 2026
+ */
+
+static const char SCCSid[] = "@(#)xqctrender.cpp 1.01 (C) 2026 arb Headless chart and tide rendering";
+
+/*
+ * Renders an area of a chart with the tidal stream arrows and tide gauges
+ * at a series of times into PNG files, without a display, eg. for a day
+ * of frames every quarter of an hour around a point:
+ *   ./xqctrender -z 2 -o forth qct/BA0734_1.qct 56.05 -3.0 1024 768 2010-07-30 00:00 15 96
+ * writes forth-0000.png to forth-0095.png.
+ * The diamonds and tide levels shown are chosen by TidalDataset::select
+ * as by xqct with its default settings, then those out of the area left
+ * out.  The tides are calculated first in this thread, as TideCalc keeps
+ * state for each station, then the frames are drawn in parallel.
+ */
+
+/*
+ * Configuration:
+ * The tide data is found as by xqct (see xqct.cpp) unless given by -d.
+ * Define REQUIRE as what TidalDataset::select requires of the levels and
+ * streams, the same as the defaults of xqct.
+ * Define ARROW_SCALE as the length of the arrows for one knot.
+ * Define MARGIN as how far outside the area the arrows and gauges can be
+ * and still reach into it.
+ */
+#define DEFAULT_TIDE_DATA_DIR   qApp->applicationDirPath()
+#define DEFAULT_TIDE_ZIP_PASSWORD QString::null
+#define DEFAULT_HARMONICS_FILE "tcd/world.tcd"
+#define DEFAULT_PREFIX         "frame"
+#define REQUIRE (TidalDataset::LevelUnique | TidalDataset::StreamUnique | TidalDataset::StreamKnownRef)
+#define ARROW_SCALE 40
+#define MARGIN      (ARROW_SCALE * 8)
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <math.h>
+#include <qapplication.h>
+#include <qdatetime.h>
+#include <qvaluevector.h>
+#include "satlib/dundee.h"
+#include "osmap/qct.h"
+#include "qcttiles.h"
+#include "qctrender.h"
+#include "tidedata.h"
+#include "tidecalc.h"
+
+
+static void
+usage()
+{
+	fprintf(stderr, "usage: xqctrender [-z zoom] [-j threads] [-o prefix] [-d tidedir]\n");
+	fprintf(stderr, "         chart.qct lat lon width height YYYY-MM-DD hh:mm interval_mins count\n");
+	exit(1);
+}
+
+
+int
+main(int argc, char *argv[])
+{
+	double zoom = 1;
+	int nthreads = 0;
+	QString prefix(DEFAULT_PREFIX), tidedir;
+	int argi, ii;
+
+	set_program_name(argv[0], NULL);
+	QApplication app(argc, argv, false);  // no display
+	tidedir = DEFAULT_TIDE_DATA_DIR;
+
+	for (argi=1; argi+1<argc && argv[argi][0] == '-' && argv[argi][1] != '\0' && !isdigit(argv[argi][1]); argi+=2)
+	{
+		if (strcmp(argv[argi], "-z") == 0)
+			zoom = atof(argv[argi+1]);
+		else if (strcmp(argv[argi], "-j") == 0)
+			nthreads = atoi(argv[argi+1]);
+		else if (strcmp(argv[argi], "-o") == 0)
+			prefix = argv[argi+1];
+		else if (strcmp(argv[argi], "-d") == 0)
+			tidedir = argv[argi+1];
+		else
+			usage();
+	}
+	if (argc - argi != 10 || zoom < 0.5 || zoom > (1 << (QCTTILES_LEVELS-1)))
+		usage();
+	const char *chartfile = argv[argi];
+	double lat = atof(argv[argi+1]), lon = atof(argv[argi+2]);
+	int width = atoi(argv[argi+3]), height = atoi(argv[argi+4]);
+	int Y, M, D, h, m;
+	if (sscanf(argv[argi+5], "%d-%d-%d", &Y, &M, &D) != 3 || sscanf(argv[argi+6], "%d:%d", &h, &m) != 2)
+		usage();
+	double interval = atof(argv[argi+7]);
+	int nframes = atoi(argv[argi+8]);
+	if (width <= 0 || height <= 0 || nframes <= 0)
+		usage();
+
+	// The georeferencing is for the full size chart
+	QCT qct;
+	if (!qct.openFilename(chartfile, true))
+	{
+		log_error_message("cannot read %s", chartfile);
+		exit(1);
+	}
+	int cx, cy;
+	qct.latlon_to_xy(lat, lon, &cx, &cy);
+	QRect area(NINT(cx / zoom) - width/2, NINT(cy / zoom) - height/2, width, height);
+	QRect reach(area);
+	reach.addCoords(-MARGIN, -MARGIN, MARGIN, MARGIN);
+	double degreesPerPixel = qct.getDegreesPerPixel() * zoom;
+
+	QCTTiles *tiles = QCTTileCache::instance()->open(chartfile);
+	if (tiles == 0)
+	{
+		log_error_message("cannot read %s", chartfile);
+		exit(1);
+	}
+
+	// The diamonds and tide levels which reach into the area
+	TideCalc tideCalc;
+	MoonCalc moonCalc;
+	TidalDataset dataset;
+	tideCalc.loadTideDatabase(DEFAULT_HARMONICS_FILE);
+	dataset.load(tidedir, DEFAULT_TIDE_ZIP_PASSWORD, &tideCalc);
+	QValueVector<TidalLevel*> chartLevels, levels;
+	QValueVector<TidalStream*> chartStreams, streams;
+	QValueVector<QPoint> levelxy, streamxy;
+	dataset.select(&qct, degreesPerPixel, &tideCalc, REQUIRE, &chartLevels, &chartStreams);
+	for (ii=0; ii<(int)chartLevels.count(); ii++)
+	{
+		int x, y;
+		qct.latlon_to_xy(chartLevels[ii]->getLat(), chartLevels[ii]->getLon(), &x, &y);
+		if (!reach.contains(QPoint(NINT(x / zoom), NINT(y / zoom))))
+			continue;
+		levels.push_back(chartLevels[ii]);
+		levelxy.push_back(QPoint(NINT(x / zoom), NINT(y / zoom)));
+	}
+	for (ii=0; ii<(int)chartStreams.count(); ii++)
+	{
+		int x, y;
+		qct.latlon_to_xy(chartStreams[ii]->getLat(), chartStreams[ii]->getLon(), &x, &y);
+		if (reach.contains(QPoint(NINT(x / zoom), NINT(y / zoom))))
+			streams.push_back(chartStreams[ii]);
+	}
+	TidalStreamSet streamSet;
+	streamSet.build(streams);
+	for (ii=0; ii<streamSet.count(); ii++)
+	{
+		int x, y;
+		qct.latlon_to_xy(streamSet.getStream(ii)->getLat(), streamSet.getStream(ii)->getLon(), &x, &y);
+		streamxy.push_back(QPoint(NINT(x / zoom), NINT(y / zoom)));
+	}
+	debugf(1, "%d streams and %d levels in the area\n", streamSet.count(), (int)levels.count());
+
+	// The overlays of every frame, as plotTidalStreams and plotTidalLevels
+	QTime timer;
+	timer.start();
+	QCTRenderer renderer(tiles, zoom, area);
+	double jtime0 = date_to_jtime(Y, M, D, h, m);
+	for (int ff=0; ff<nframes; ff++)
+	{
+		double jtime = jtime0 + ff * interval;
+		QCTRenderFrame frame;
+		frame.filename.sprintf("%s-%04d.png", (const char*)prefix, ff);
+		frame.description = QString(jctime(jtime));
+
+		int refstation = -1;
+		double minsFromHW = 0, jtimeHW;
+		float tideHeight;
+		for (ii=0; ii<streamSet.count(); ii++)
+		{
+			if (streamSet.getStream(ii)->getRefStation() != refstation)
+			{
+				refstation = streamSet.getStream(ii)->getRefStation();
+				tideCalc.findNearestHighWater(refstation, jtime, &tideHeight, &jtimeHW);
+				minsFromHW = jtime - jtimeHW;
+			}
+			streamSet.setMinsFromRef(ii, minsFromHW);
+		}
+		streamSet.evaluate(moonCalc.fractionFromSpringToNeap(jtime));
+		for (ii=0; ii<streamSet.count(); ii++)
+			frame.arrows.append(QCTRenderArrow(streamxy[ii].x(), streamxy[ii].y(),
+				streamSet.getBearing(ii), streamSet.getRate(ii) * ARROW_SCALE));
+
+		for (ii=0; ii<(int)levels.count(); ii++)
+		{
+			tideCalc.findTide(levels[ii]->getStation(), jtime, &tideHeight);
+			frame.tides.append(QCTRenderTide(levelxy[ii].x(), levelxy[ii].y(),
+				levels[ii]->getMLWS(), levels[ii]->getMHWS(), tideHeight));
+		}
+		renderer.addFrame(frame);
+	}
+	int tide_ms = timer.restart();
+
+	int written = renderer.render(nthreads);
+	int render_ms = timer.elapsed();
+	printf("%d of %d frames %d x %d written, tides %d ms, rendering %d ms\n",
+		written, nframes, width, height, tide_ms, render_ms);
+
+	QCTTileCache::instance()->close(tiles);
+	return (written == nframes) ? 0 : 1;
+}
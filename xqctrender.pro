@@ -0,0 +1,22 @@
+TEMPLATE    = app
+CONFIG      += qt warn_on release thread unzip
+DEFINES     +=
+INCLUDEPATH += $(SWDEV)
+LIBS        += -lsatqt -losmap -lsat -lutils -lgif -larb -ltcd -lz
+HEADERS     = qctrender.h   qctimage.h   qctfile.h   qcttiles.h   qctdiskcache.h   tidedata.h   tidecalc.h   tidezip.h   trace.h
+SOURCES     = qctrender.cpp qctimage.cpp qctfile.cpp qcttiles.cpp qctdiskcache.cpp tidedata.cpp tidedataset.cpp tidecalc.cpp tidezip.cpp trace.cpp
+SOURCES    += xqctrender.cpp
+TARGET      = xqctrender
+
+unzip {
+	DEFINES += USE_UNZIP
+}
+
+lz4 {
+	DEFINES += USE_LZ4
+	LIBS    += -llz4
+}
+
+trace {
+	DEFINES += USE_TRACE
+}